@@ -120,6 +120,13 @@ namespace SeganX.Realtime
             return Read(value, length);
         }
 
+        public BufferReader ReadBytes(byte[] value, int offset, int length)
+        {
+            System.Buffer.BlockCopy(buffer, Posision, value, offset, length);
+            Posision += length;
+            return this;
+        }
+
         public string ReadString()
         {
             var length = ReadByte();
@@ -37,6 +37,13 @@ namespace SeganX.Realtime
             return this;
         }
 
+        public BufferWriter Append(System.Array src, int offset, int length)
+        {
+            System.Buffer.BlockCopy(src, offset, buffer, Length, length);
+            Length += length;
+            return this;
+        }
+
         public BufferWriter AppendChar(char value)
         {
             charArray[0] = value;
@@ -0,0 +1,391 @@
+namespace SeganX.Realtime.Internal
+{
+    public static class Cipher
+    {
+        public const int KeyLength = 32;
+        public const int NonceLength = 12;
+        public const int TagLength = 16;
+
+        // scratch buffers of the packets are reused so Seal and Open must only be called on the main thread
+        private static readonly uint[] xorState = new uint[16];
+        private static readonly uint[] xorRounds = new uint[16];
+        private static readonly byte[] xorBlock = new byte[64];
+        private static readonly byte[] polyKey = new byte[64];
+        private static readonly byte[] polyLengths = new byte[16];
+        private static readonly byte[] computedTag = new byte[TagLength];
+        private static readonly Poly1305 poly = new Poly1305();
+
+        //////////////////////////////////////////////////////////////////////////
+        //  ChaCha20
+        //////////////////////////////////////////////////////////////////////////
+        private static uint Rotl(uint x, int b)
+        {
+            return (x << b) | (x >> (32 - b));
+        }
+
+        private static void QuarterRound(uint[] x, int a, int b, int c, int d)
+        {
+            x[a] += x[b]; x[d] ^= x[a]; x[d] = Rotl(x[d], 16);
+            x[c] += x[d]; x[b] ^= x[c]; x[b] = Rotl(x[b], 12);
+            x[a] += x[b]; x[d] ^= x[a]; x[d] = Rotl(x[d], 8);
+            x[c] += x[d]; x[b] ^= x[c]; x[b] = Rotl(x[b], 7);
+        }
+
+        private static uint ReadUint(byte[] p, int offset)
+        {
+            return p[offset] | ((uint)p[offset + 1] << 8) | ((uint)p[offset + 2] << 16) | ((uint)p[offset + 3] << 24);
+        }
+
+        private static void WriteUint(byte[] p, int offset, uint v)
+        {
+            p[offset] = (byte)v; p[offset + 1] = (byte)(v >> 8); p[offset + 2] = (byte)(v >> 16); p[offset + 3] = (byte)(v >> 24);
+        }
+
+        private static void Init(uint[] state, byte[] key, uint counter, byte[] nonce, int nonceOffset)
+        {
+            state[0] = 0x61707865; state[1] = 0x3320646e; state[2] = 0x79622d32; state[3] = 0x6b206574;
+            for (int i = 0; i < 8; i++)
+                state[4 + i] = ReadUint(key, i * 4);
+            state[12] = counter;
+            state[13] = ReadUint(nonce, nonceOffset);
+            state[14] = ReadUint(nonce, nonceOffset + 4);
+            state[15] = ReadUint(nonce, nonceOffset + 8);
+        }
+
+        private static void Rounds(uint[] x)
+        {
+            for (int i = 0; i < 10; i++)
+            {
+                QuarterRound(x, 0, 4, 8, 12);
+                QuarterRound(x, 1, 5, 9, 13);
+                QuarterRound(x, 2, 6, 10, 14);
+                QuarterRound(x, 3, 7, 11, 15);
+                QuarterRound(x, 0, 5, 10, 15);
+                QuarterRound(x, 1, 6, 11, 12);
+                QuarterRound(x, 2, 7, 8, 13);
+                QuarterRound(x, 3, 4, 9, 14);
+            }
+        }
+
+        private static void Xor(byte[] dest, int destOffset, byte[] key, uint counter, byte[] nonce, byte[] src, int srcOffset, int size)
+        {
+            var state = xorState;
+            var x = xorRounds;
+            var block = xorBlock;
+            Init(state, key, counter, nonce, 0);
+            for (int offset = 0; offset < size; offset += 64)
+            {
+                System.Array.Copy(state, x, 16);
+                Rounds(x);
+                for (int i = 0; i < 16; i++)
+                    WriteUint(block, i * 4, x[i] + state[i]);
+                state[12]++;
+
+                int len = size - offset < 64 ? size - offset : 64;
+                for (int i = 0; i < len; i++)
+                    dest[destOffset + offset + i] = (byte)(src[srcOffset + offset + i] ^ block[i]);
+            }
+        }
+
+        public static byte[] HChaCha20(byte[] key, byte[] nonce)
+        {
+            var x = new uint[16];
+            Init(x, key, ReadUint(nonce, 0), nonce, 4);
+            Rounds(x);
+
+            var res = new byte[32];
+            for (int i = 0; i < 4; i++)
+            {
+                WriteUint(res, i * 4, x[i]);
+                WriteUint(res, 16 + i * 4, x[12 + i]);
+            }
+            return res;
+        }
+
+        //////////////////////////////////////////////////////////////////////////
+        //  Poly1305 with 26 bit limbs
+        //////////////////////////////////////////////////////////////////////////
+        private class Poly1305
+        {
+            private readonly uint[] r = new uint[5];
+            private readonly uint[] h = new uint[5];
+            private readonly uint[] pad = new uint[4];
+            private readonly byte[] block = new byte[16];
+
+            public void Reset(byte[] key)
+            {
+                System.Array.Clear(h, 0, 5);
+                r[0] = ReadUint(key, 0) & 0x3ffffff;
+                r[1] = (ReadUint(key, 3) >> 2) & 0x3ffff03;
+                r[2] = (ReadUint(key, 6) >> 4) & 0x3ffc0ff;
+                r[3] = (ReadUint(key, 9) >> 6) & 0x3f03fff;
+                r[4] = (ReadUint(key, 12) >> 8) & 0x00fffff;
+                for (int i = 0; i < 4; i++) pad[i] = ReadUint(key, 16 + i * 4);
+            }
+
+            // process the data in 16 bytes blocks. the last block is padded with zeros as AEAD needs
+            public void Update(byte[] data, int dataOffset, int size)
+            {
+                uint r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+                uint s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+                uint h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+                for (int offset = 0; offset < size; offset += 16)
+                {
+                    int len = size - offset < 16 ? size - offset : 16;
+                    System.Array.Clear(block, 0, 16);
+                    System.Buffer.BlockCopy(data, dataOffset + offset, block, 0, len);
+
+                    h0 += ReadUint(block, 0) & 0x3ffffff;
+                    h1 += (ReadUint(block, 3) >> 2) & 0x3ffffff;
+                    h2 += (ReadUint(block, 6) >> 4) & 0x3ffffff;
+                    h3 += (ReadUint(block, 9) >> 6) & 0x3ffffff;
+                    h4 += (ReadUint(block, 12) >> 8) | (1 << 24);
+
+                    ulong d0 = (ulong)h0 * r0 + (ulong)h1 * s4 + (ulong)h2 * s3 + (ulong)h3 * s2 + (ulong)h4 * s1;
+                    ulong d1 = (ulong)h0 * r1 + (ulong)h1 * r0 + (ulong)h2 * s4 + (ulong)h3 * s3 + (ulong)h4 * s2;
+                    ulong d2 = (ulong)h0 * r2 + (ulong)h1 * r1 + (ulong)h2 * r0 + (ulong)h3 * s4 + (ulong)h4 * s3;
+                    ulong d3 = (ulong)h0 * r3 + (ulong)h1 * r2 + (ulong)h2 * r1 + (ulong)h3 * r0 + (ulong)h4 * s4;
+                    ulong d4 = (ulong)h0 * r4 + (ulong)h1 * r3 + (ulong)h2 * r2 + (ulong)h3 * r1 + (ulong)h4 * r0;
+
+                    uint c;
+                    c = (uint)(d0 >> 26); h0 = (uint)d0 & 0x3ffffff;
+                    d1 += c; c = (uint)(d1 >> 26); h1 = (uint)d1 & 0x3ffffff;
+                    d2 += c; c = (uint)(d2 >> 26); h2 = (uint)d2 & 0x3ffffff;
+                    d3 += c; c = (uint)(d3 >> 26); h3 = (uint)d3 & 0x3ffffff;
+                    d4 += c; c = (uint)(d4 >> 26); h4 = (uint)d4 & 0x3ffffff;
+                    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+                    h1 += c;
+                }
+
+                h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+            }
+
+            public void Finish(byte[] tag, int offset)
+            {
+                uint h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+                uint c;
+
+                c = h1 >> 26; h1 &= 0x3ffffff;
+                h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+                h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+                h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+                h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+                h1 += c;
+
+                // compute h - p and select it if h >= p in constant time
+                uint g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+                uint g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+                uint g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+                uint g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+                uint g4 = h4 + c - (1 << 26);
+
+                uint mask = (g4 >> 31) - 1;
+                h0 = (h0 & ~mask) | (g0 & mask);
+                h1 = (h1 & ~mask) | (g1 & mask);
+                h2 = (h2 & ~mask) | (g2 & mask);
+                h3 = (h3 & ~mask) | (g3 & mask);
+                h4 = (h4 & ~mask) | (g4 & mask);
+
+                ulong f;
+                f = (ulong)(h0 | (h1 << 26)) + pad[0]; WriteUint(tag, offset + 0, (uint)f);
+                f = (ulong)((h1 >> 6) | (h2 << 20)) + pad[1] + (f >> 32); WriteUint(tag, offset + 4, (uint)f);
+                f = (ulong)((h2 >> 12) | (h3 << 14)) + pad[2] + (f >> 32); WriteUint(tag, offset + 8, (uint)f);
+                f = (ulong)((h3 >> 18) | (h4 << 8)) + pad[3] + (f >> 32); WriteUint(tag, offset + 12, (uint)f);
+            }
+        }
+
+        private static void ComputeTag(byte[] tag, int tagOffset, byte[] key, byte[] nonce, byte[] aad, int aadSize, byte[] cipher, int cipherOffset, int size)
+        {
+            System.Array.Clear(polyKey, 0, 64);
+            Xor(polyKey, 0, key, 0, nonce, polyKey, 0, 64);
+
+            poly.Reset(polyKey);
+            poly.Update(aad, 0, aadSize);
+            poly.Update(cipher, cipherOffset, size);
+
+            // the high words of the lengths are never written so they stay zero
+            WriteUint(polyLengths, 0, (uint)aadSize);
+            WriteUint(polyLengths, 8, (uint)size);
+            poly.Update(polyLengths, 0, 16);
+            poly.Finish(tag, tagOffset);
+        }
+
+        // encrypt the source to the destination and write the tag right after the cipher text
+        public static void Seal(byte[] dest, int destOffset, byte[] key, byte[] nonce, byte[] aad, int aadSize, byte[] src, int srcOffset, int size)
+        {
+            Xor(dest, destOffset, key, 1, nonce, src, srcOffset, size);
+            ComputeTag(dest, destOffset + size, key, nonce, aad, aadSize, dest, destOffset, size);
+        }
+
+        // the tag is read right after the cipher text and nothing is written if it is invalid
+        public static bool Open(byte[] dest, int destOffset, byte[] key, byte[] nonce, byte[] aad, int aadSize, byte[] src, int srcOffset, int size)
+        {
+            ComputeTag(computedTag, 0, key, nonce, aad, aadSize, src, srcOffset, size);
+
+            int diff = 0;
+            for (int i = 0; i < TagLength; i++)
+                diff |= computedTag[i] ^ src[srcOffset + size + i];
+            if (diff != 0) return false;
+
+            Xor(dest, destOffset, key, 1, nonce, src, srcOffset, size);
+            return true;
+        }
+
+        //////////////////////////////////////////////////////////////////////////
+        //  X25519 with 16 bit limbs in 64 bit integers
+        //////////////////////////////////////////////////////////////////////////
+        private static void Carry(long[] o)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                o[i] += 1L << 16;
+                long c = o[i] >> 16;
+                o[i < 15 ? i + 1 : 0] += c - 1 + (i == 15 ? 37 * (c - 1) : 0);
+                o[i] -= c << 16;
+            }
+        }
+
+        private static void Swap(long[] p, long[] q, int b)
+        {
+            long c = ~(b - 1L);
+            for (int i = 0; i < 16; i++)
+            {
+                long t = c & (p[i] ^ q[i]);
+                p[i] ^= t;
+                q[i] ^= t;
+            }
+        }
+
+        private static void Pack(byte[] o, long[] n)
+        {
+            var m = new long[16];
+            var t = (long[])n.Clone();
+            Carry(t);
+            Carry(t);
+            Carry(t);
+            for (int j = 0; j < 2; j++)
+            {
+                m[0] = t[0] - 0xffed;
+                for (int i = 1; i < 15; i++)
+                {
+                    m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+                    m[i - 1] &= 0xffff;
+                }
+                m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+                int b = (int)((m[15] >> 16) & 1);
+                m[14] &= 0xffff;
+                Swap(t, m, 1 - b);
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                o[2 * i] = (byte)(t[i] & 0xff);
+                o[2 * i + 1] = (byte)(t[i] >> 8);
+            }
+        }
+
+        private static void Unpack(long[] o, byte[] n)
+        {
+            for (int i = 0; i < 16; i++)
+                o[i] = n[2 * i] + ((long)n[2 * i + 1] << 8);
+            o[15] &= 0x7fff;
+        }
+
+        private static void Add(long[] o, long[] a, long[] b)
+        {
+            for (int i = 0; i < 16; i++) o[i] = a[i] + b[i];
+        }
+
+        private static void Sub(long[] o, long[] a, long[] b)
+        {
+            for (int i = 0; i < 16; i++) o[i] = a[i] - b[i];
+        }
+
+        private static void Mul(long[] o, long[] a, long[] b)
+        {
+            var t = new long[31];
+            for (int i = 0; i < 16; i++)
+                for (int j = 0; j < 16; j++)
+                    t[i + j] += a[i] * b[j];
+            for (int i = 0; i < 15; i++)
+                t[i] += 38 * t[i + 16];
+            System.Array.Copy(t, o, 16);
+            Carry(o);
+            Carry(o);
+        }
+
+        private static void Inverse(long[] o, long[] i)
+        {
+            var c = (long[])i.Clone();
+            for (int a = 253; a >= 0; a--)
+            {
+                Mul(c, c, c);
+                if (a != 2 && a != 4) Mul(c, c, i);
+            }
+            System.Array.Copy(c, o, 16);
+        }
+
+        public static byte[] X25519(byte[] scalar, byte[] point)
+        {
+            var a24 = new long[16]; a24[0] = 0xdb41; a24[1] = 1;
+            var z = (byte[])scalar.Clone();
+            z[31] = (byte)((scalar[31] & 127) | 64);
+            z[0] &= 248;
+
+            var x = new long[16];
+            long[] a = new long[16], b = new long[16], c = new long[16], d = new long[16], e = new long[16], f = new long[16];
+            Unpack(x, point);
+            System.Array.Copy(x, b, 16);
+            a[0] = d[0] = 1;
+
+            for (int i = 254; i >= 0; --i)
+            {
+                int r = (z[i >> 3] >> (i & 7)) & 1;
+                Swap(a, b, r);
+                Swap(c, d, r);
+                Add(e, a, c);
+                Sub(a, a, c);
+                Add(c, b, d);
+                Sub(b, b, d);
+                Mul(d, e, e);
+                Mul(f, a, a);
+                Mul(a, c, a);
+                Mul(c, b, e);
+                Add(e, a, c);
+                Sub(a, a, c);
+                Mul(b, a, a);
+                Sub(c, d, f);
+                Mul(a, c, a24);
+                Add(a, a, d);
+                Mul(c, c, a);
+                Mul(a, d, f);
+                Mul(d, b, x);
+                Mul(b, e, e);
+                Swap(a, b, r);
+                Swap(c, d, r);
+            }
+
+            Inverse(c, c);
+            Mul(a, a, c);
+
+            var res = new byte[32];
+            Pack(res, a);
+            return res;
+        }
+
+        public static byte[] X25519Public(byte[] scalar)
+        {
+            var basePoint = new byte[32];
+            basePoint[0] = 9;
+            return X25519(scalar, basePoint);
+        }
+
+        public static byte[] CreatePrivateKey()
+        {
+            var res = new byte[32];
+            using (var random = System.Security.Cryptography.RandomNumberGenerator.Create())
+                random.GetBytes(res);
+            return res;
+        }
+    }
+}
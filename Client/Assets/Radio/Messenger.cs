@@ -10,6 +10,12 @@ namespace SeganX.Realtime.Internal
         private ClientInfo clientInfo = new ClientInfo();
         private readonly Transmitter transmitter = new Transmitter();
         private readonly BufferWriter sendBuffer = new BufferWriter(256);
+        private readonly byte[] cookie = new byte[12];
+
+        // microseconds since epoch from a monotonic clock anchored to the wall clock at startup like the server
+        private static readonly System.Diagnostics.Stopwatch clock = System.Diagnostics.Stopwatch.StartNew();
+        private static readonly ulong clockBase = (ulong)System.DateTimeOffset.UtcNow.ToUnixTimeMilliseconds() * 1000;
+        public static ulong Now => clockBase + (ulong)(clock.Elapsed.Ticks / 10);
 
         public bool Started => clientInfo.device != null;
         public bool Stopped => clientInfo.device == null;
@@ -20,10 +26,16 @@ namespace SeganX.Realtime.Internal
         public bool Loggedin => clientInfo.token != 0;
 
         public float DelayFactor { get; set; } = 1;
+        public bool Secure { get; set; } = false;
         public Flag Flag { get; private set; } = 0;
-        public ulong ServerTime { get; private set; } = 0;
-
-        public void Start(byte[] devicebytes, IPEndPoint serverAddress, System.Action<Error, sbyte, BufferReader, byte> OnReceivedMessage)
+        public byte Members { get; private set; } = 0;
+        public long ClockOffset { get; private set; } = 0;
+        public ushort LogFirst { get; private set; } = 0;
+        public ushort LogLast { get; private set; } = 0;
+        public float RelaySentTime => transmitter.RelaySentTime;
+        public float ReceivedTime => transmitter.ReceivedTime;
+
+        public void Start(byte[] devicebytes, IPEndPoint serverAddress, System.Action<Error, sbyte, BufferReader, int> OnReceivedMessage, System.Action<MessageType, sbyte, BufferReader> OnReceivedEvent)
         {
             if (Started)
             {
@@ -38,7 +50,12 @@ namespace SeganX.Realtime.Internal
             }
 
             clientInfo.device = devicebytes;
-            transmitter.Start(clientInfo, serverAddress, OnReceivedMessage);
+            transmitter.Start(clientInfo, serverAddress, OnReceivedMessage, (type, index, buffer) =>
+            {
+                if (type == MessageType.Master)
+                    Flag = (index >= 0 && index == clientInfo.index) ? Flag | Flag.Master : Flag & ~Flag.Master;
+                OnReceivedEvent?.Invoke(type, index, buffer);
+            });
         }
 
         public void Stop()
@@ -62,27 +79,48 @@ namespace SeganX.Realtime.Internal
                 return;
             }
 
+            // a new key pair for every login so the keys of the old sessions are not reused
+            var privateKey = Secure ? Cipher.CreatePrivateKey() : null;
             sendBuffer.Reset()
                 .AppendByte((byte)MessageType.Login)
                 .AppendBytes(clientInfo.device, 32)
-                .AppendUint(ComputeChecksum(sendBuffer.Bytes, sendBuffer.Length));
+                .AppendByte((byte)(Secure ? 1 : 0))
+                .AppendBytes(Secure ? Cipher.X25519Public(privateKey) : new byte[32], 32)
+                .AppendBytes(cookie, cookie.Length);
 
             Debug.Log($"{logName} Login {clientInfo.device}");
             transmitter.SendRequestToServer(MessageType.Login, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) =>
             {
+                // the server asks to prove our address by sending the login again with its cookie
+                if (error == Error.Cookie)
+                {
+                    buffer.ReadBytes(cookie, cookie.Length);
+                    Login(callback);
+                    return;
+                }
+
                 if (error == Error.NoError)
                 {
                     var rectoken = buffer.ReadUint();
                     var reclobby = buffer.ReadShort();
                     var recroom = buffer.ReadShort();
                     var recindex = buffer.ReadSbyte();
-                    var checksum = buffer.ReadUint();
-                    if (checksum == ComputeChecksum(buffer.Bytes, 11))
+                    var reckey = buffer.ReadUshort();
+                    var recsecret = new byte[16];
+                    buffer.ReadBytes(recsecret, 16);
+                    var recpublic = new byte[32];
+                    buffer.ReadBytes(recpublic, 32);
+                    var mac = buffer.ReadUint();
+                    var cipherKey = privateKey != null ? DeriveCipherKey(privateKey, recpublic) : null;
+                    if (mac == SipHash.ComputeMac(SipHash.LoginKey, buffer.Bytes, 61) && (privateKey == null || cipherKey != null))
                     {
                         clientInfo.token = rectoken;
+                        clientInfo.key = reckey;
+                        System.Buffer.BlockCopy(recsecret, 0, clientInfo.secret, 0, 16);
                         clientInfo.id = reclobby;
                         clientInfo.room = recroom;
                         clientInfo.index = recindex;
+                        transmitter.SetCipher(cipherKey);
 
                         Debug.Log($"{logName} Login response Token:{clientInfo.token} Id:{clientInfo.id} Room:{clientInfo.room} Index:{clientInfo.index}");
                         callback?.Invoke(error);
@@ -94,6 +132,17 @@ namespace SeganX.Realtime.Internal
             });
         }
 
+        private static byte[] DeriveCipherKey(byte[] privateKey, byte[] serverPublic)
+        {
+            var shared = Cipher.X25519(privateKey, serverPublic);
+
+            // reject the low order points of the server which lead to a known shared key
+            int check = 0;
+            for (int i = 0; i < shared.Length; i++)
+                check |= shared[i];
+            return check != 0 ? Cipher.HChaCha20(shared, new byte[16]) : null;
+        }
+
         public void Logout(System.Action callback)
         {
             if (clientInfo.token == 0 || clientInfo.device == null) return;
@@ -103,36 +152,47 @@ namespace SeganX.Realtime.Internal
                 .AppendUint(clientInfo.token)
                 .AppendShort(clientInfo.id)
                 .AppendShort(clientInfo.room)
-                .AppendSbyte(clientInfo.index)
-                .AppendUint(ComputeChecksum(sendBuffer.Bytes, sendBuffer.Length));
+                .AppendSbyte(clientInfo.index);
 
             transmitter.SendRequestToServer(MessageType.Logout, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) => callback?.Invoke());
         }
 
+        // the callback receives the round trip time in microseconds
         public void SendPing(System.Action<Error, ulong> callback)
         {
             if (clientInfo.token == 0 || clientInfo.device == null) return;
 
-            ulong Tick() => (ulong)System.DateTimeOffset.Now.ToUnixTimeMilliseconds();
-
             sendBuffer.Reset()
                 .AppendByte((byte)MessageType.Ping)
                 .AppendUint(clientInfo.token)
                 .AppendShort(clientInfo.id)
                 .AppendShort(clientInfo.room)
                 .AppendSbyte(clientInfo.index)
-                .AppendUlong(Tick());
+                .AppendUlong(Now);
 
             transmitter.SendRequestToServer(MessageType.Ping, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) =>
             {
-                ulong sentTick = buffer.ReadUlong();
-                ServerTime = buffer.ReadUlong();
+                if (error != Error.NoError)
+                {
+                    callback?.Invoke(error, 0);
+                    return;
+                }
+
+                var clientTransmit = buffer.ReadUlong();
+                var serverReceive = buffer.ReadUlong();
+                var serverTransmit = buffer.ReadUlong();
+                var clientReceive = Now;
                 Flag = (Flag)buffer.ReadByte();
-                callback?.Invoke(error, Tick() - sentTick);
+                Members = buffer.ReadByte();
+
+                // like NTP the processing time of the server is excluded and the paths are assumed symmetric
+                var roundTrip = (long)(clientReceive - clientTransmit) - (long)(serverTransmit - serverReceive);
+                ClockOffset = ((long)(serverReceive - clientTransmit) + (long)(serverTransmit - clientReceive)) / 2;
+                callback?.Invoke(error, roundTrip > 0 ? (ulong)roundTrip : 0);
             });
         }
 
-        public void CreateRoom(ushort openTimeout, byte[] properties, MatchmakingParams matchmaking, System.Action<Error, short, sbyte> callback)
+        public void CreateRoom(ushort openTimeout, byte[] properties, MatchmakingParams matchmaking, byte[] meta, System.Action<Error, short, sbyte> callback)
         {
             if (clientInfo.device == null || clientInfo.token == 0) return;
 
@@ -153,7 +213,8 @@ namespace SeganX.Realtime.Internal
                 .AppendInt(matchmaking.a)
                 .AppendInt(matchmaking.b)
                 .AppendInt(matchmaking.c)
-                .AppendInt(matchmaking.d);
+                .AppendInt(matchmaking.d)
+                .AppendBytes(meta, 32);
 
             Debug.Log($"{logName} Create room Token:{clientInfo.token} Id:{clientInfo.id} Timeout:{openTimeout} Matchmaking:{matchmaking}");
             transmitter.SendRequestToServer(MessageType.CreateRoom, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) =>
@@ -171,7 +232,7 @@ namespace SeganX.Realtime.Internal
             });
         }
 
-        public void JoinRoom(MatchmakingRanges matchmaking, System.Action<Error, short, sbyte, byte[]> callback = null)
+        public void JoinRoom(MatchmakingRanges matchmaking, byte[] meta, System.Action<Error, short, sbyte, byte[], RoomMember[]> callback = null)
         {
             if (clientInfo.device == null || clientInfo.token == 0) return;
 
@@ -186,7 +247,8 @@ namespace SeganX.Realtime.Internal
                 .AppendInt(matchmaking.cMin)
                 .AppendInt(matchmaking.cMax)
                 .AppendInt(matchmaking.dMin)
-                .AppendInt(matchmaking.dMax);
+                .AppendInt(matchmaking.dMax)
+                .AppendBytes(meta, 32);
 
             Debug.Log($"{logName} Join room Token:{clientInfo.token} Id:{clientInfo.id} Matchmaking:{matchmaking}");
             transmitter.SendRequestToServer(MessageType.Join, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) =>
@@ -200,10 +262,22 @@ namespace SeganX.Realtime.Internal
                     var properties = new byte[32];
                     buffer.ReadBytes(properties, 32);
 
-                    Debug.Log($"{logName} Join Room response Token:{clientInfo.token} Id:{clientInfo.id} Room:{clientInfo.room} Index:{clientInfo.index}");
-                    callback?.Invoke(error, clientInfo.room, clientInfo.index, properties);
+                    LogFirst = buffer.ReadUshort();
+                    LogLast = buffer.ReadUshort();
+
+                    var members = new RoomMember[buffer.ReadByte()];
+                    for (int i = 0; i < members.Length; i++)
+                    {
+                        members[i] = new RoomMember();
+                        members[i].index = buffer.ReadSbyte();
+                        members[i].flag = (Flag)buffer.ReadByte();
+                        buffer.ReadBytes(members[i].meta, 32);
+                    }
+
+                    Debug.Log($"{logName} Join Room response Token:{clientInfo.token} Id:{clientInfo.id} Room:{clientInfo.room} Index:{clientInfo.index} Members:{members.Length}");
+                    callback?.Invoke(error, clientInfo.room, clientInfo.index, properties, members);
                 }
-                else callback?.Invoke(error, -1, -1, null);
+                else callback?.Invoke(error, -1, -1, null, null);
 
             });
         }
@@ -229,24 +303,95 @@ namespace SeganX.Realtime.Internal
             });
         }
 
-        public void SendUnreliable(Target target, BufferWriter data, sbyte targetId = -1)
+        public void Persist(byte ack, byte[] data, byte dataSize, System.Action<Error> callback)
         {
             if (clientInfo.device == null || clientInfo.token == 0) return;
-            transmitter.SendMessageUnreliable(target, data.Bytes, (byte)data.Length, targetId);
+
+            sendBuffer.Reset()
+                .AppendByte((byte)MessageType.Persist)
+                .AppendUint(clientInfo.token)
+                .AppendShort(clientInfo.id)
+                .AppendShort(clientInfo.room)
+                .AppendSbyte(clientInfo.index)
+                .AppendByte(ack)
+                .AppendByte(dataSize)
+                .AppendBytes(data, dataSize);
+
+            transmitter.SendRequestToServer(MessageType.Persist, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) => callback?.Invoke(error));
         }
 
-        public void SendReliable(sbyte targetId, BufferWriter data)
+        public void RequestLog(ushort seq, System.Action<Error, sbyte, BufferReader> callback)
+        {
+            if (clientInfo.device == null || clientInfo.token == 0) return;
+
+            sendBuffer.Reset()
+                .AppendByte((byte)MessageType.Log)
+                .AppendUint(clientInfo.token)
+                .AppendShort(clientInfo.id)
+                .AppendShort(clientInfo.room)
+                .AppendSbyte(clientInfo.index)
+                .AppendUshort(seq);
+
+            transmitter.SendRequestToServer(MessageType.Log, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) =>
+            {
+                // sender index has been read by transmitter as the second byte of the response
+                var sender = error == Error.NoError ? (sbyte)buffer.Bytes[1] : (sbyte)-1;
+                callback?.Invoke(error, sender, buffer);
+            });
+        }
+
+        public void SetState(ushort key, byte[] data, byte dataSize, System.Action<Error> callback)
         {
             if (clientInfo.device == null || clientInfo.token == 0) return;
-            transmitter.SendMessageReliable(targetId, data.Bytes, (byte)data.Length);
+
+            sendBuffer.Reset()
+                .AppendByte((byte)MessageType.StateSet)
+                .AppendUint(clientInfo.token)
+                .AppendShort(clientInfo.id)
+                .AppendShort(clientInfo.room)
+                .AppendSbyte(clientInfo.index)
+                .AppendUshort(key)
+                .AppendByte(dataSize)
+                .AppendBytes(data, dataSize);
+
+            transmitter.SendRequestToServer(MessageType.StateSet, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) => callback?.Invoke(error));
         }
 
-        private uint ComputeChecksum(byte[] buffer, int length)
+        public void RequestStateSnapshot(ushort offset, System.Action<Error, ushort, ushort, ushort, BufferReader> callback)
         {
-            uint checksum = 0;
-            for (int i = 0; i < length; i++)
-                checksum += 64548 + (uint)buffer[i] * 6597;
-            return checksum;
+            if (clientInfo.device == null || clientInfo.token == 0) return;
+
+            sendBuffer.Reset()
+                .AppendByte((byte)MessageType.StateSnapshot)
+                .AppendUint(clientInfo.token)
+                .AppendShort(clientInfo.id)
+                .AppendShort(clientInfo.room)
+                .AppendSbyte(clientInfo.index)
+                .AppendUshort(offset);
+
+            transmitter.SendRequestToServer(MessageType.StateSnapshot, sendBuffer.Bytes, sendBuffer.Length, DelayFactor, (error, buffer) =>
+            {
+                if (error == Error.NoError)
+                {
+                    var version = buffer.ReadUshort();
+                    var size = buffer.ReadUshort();
+                    var recoffset = buffer.ReadUshort();
+                    callback?.Invoke(error, version, size, recoffset, buffer);
+                }
+                else callback?.Invoke(error, 0, 0, 0, null);
+            });
+        }
+
+        public void SendUnreliable(Target target, BufferWriter data, sbyte targetId = -1)
+        {
+            if (clientInfo.device == null || clientInfo.token == 0) return;
+            transmitter.SendMessageUnreliable(target, data.Bytes, data.Length, targetId);
+        }
+
+        public void SendReliable(sbyte targetId, BufferWriter data)
+        {
+            if (clientInfo.device == null || clientInfo.token == 0) return;
+            transmitter.SendMessageReliable(targetId, data.Bytes, data.Length);
         }
     }
 }
\ No newline at end of file
@@ -10,7 +10,7 @@ namespace SeganX.Realtime
         private NetPlayer owner = null;
 
         public ushort Id { get; private set; } = 0;
-        public event Action<byte, byte[], byte> OnReceived = null;
+        public event Action<byte, byte[], int> OnReceived = null;
 
         public NetPlayer Owner => owner;
         public bool IsMine => owner == null || owner.IsMine;
@@ -48,7 +48,7 @@ namespace SeganX.Realtime
         //////////////////////////////////////////////////////
         private static readonly List<NetView> all = new List<NetView>();
         private static readonly BufferReader reader = new BufferReader(null);
-        private static readonly BufferWriter writer = new BufferWriter(256);
+        private static readonly BufferWriter writer = new BufferWriter(Internal.Reliable.MaxMessageSize);
 
         public static event Action<NetView, byte[], int> OnViewCreated = null;
         public static event Action<NetView> OnViewRemoved = null;
@@ -79,7 +79,7 @@ namespace SeganX.Realtime
 
         static NetView()
         {
-            var cacheBytes = new byte[256];
+            var cacheBytes = new byte[Internal.Reliable.MaxMessageSize];
 
             Radio.OnPlayerRemoved += netPlayer =>
             {
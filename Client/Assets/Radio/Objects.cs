@@ -12,7 +12,19 @@ namespace SeganX.Realtime
         Leave = 31,
         Unreliable = 40,
         Reliable = 41,
-        Relied = 42
+        Relied = 42,
+        Persist = 43,
+        Log = 44,
+        Logged = 45,
+        CompactUnreliable = 46,
+        CompactReliable = 47,
+        CompactRelied = 48,
+        Fragment = 49,
+        Master = 50,
+        Member = 51,
+        StateSet = 60,
+        State = 61,
+        StateSnapshot = 62
     }
 
     public enum Target : byte
@@ -29,9 +41,17 @@ namespace SeganX.Realtime
         Expired = -2,
         IsFull = -3,
         JoinFailed = -4,
+        Cookie = -5,
         Disconnected = -100
     }
 
+    public enum MemberEvent : byte
+    {
+        Join = 1,
+        Leave = 2,
+        Timeout = 3
+    }
+
     [System.Flags]
     public enum Flag : byte
     {
@@ -79,11 +99,20 @@ namespace SeganX.Realtime
         {
             public byte[] device = null;
             public uint token = 0;
+            public ushort key = 0;
+            public readonly byte[] secret = new byte[16];
             public short id = -1;
             public short room = -1;
             public sbyte index = -1;
         }
 
+        public class RoomMember
+        {
+            public sbyte index = -1;
+            public Flag flag = 0;
+            public readonly byte[] meta = new byte[32];
+        }
+
         public class Message
         {
             public float delayTime = 0;
@@ -101,8 +130,9 @@ namespace SeganX.Realtime
         public class ReliableMessage : Message
         {
             public byte ack = 0;
+            public byte group = 0;
             public sbyte targetIndex = 0;
-            public BufferWriter buffer = new BufferWriter(512);
+            public BufferWriter buffer = new BufferWriter(Reliable.MaxPacketSize);
             public int retryCount = 0;
         }
 
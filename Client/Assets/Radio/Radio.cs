@@ -17,6 +17,9 @@ namespace SeganX.Realtime
         private const int maxPlayers = 16;
         private bool connectionState = false;
         private int taskOrder = 0;
+        private int skippedPings = 0;
+        private const int maxSkippedPings = 4;
+        private float masterHeartbeatTime = 0;
 
         private IEnumerator Start()
         {
@@ -27,18 +30,29 @@ namespace SeganX.Realtime
                 {
                     var player = players[i];
                     if (player == null || player.IsMine) continue;
-
-                    var deltaTime = player.Update(PlayerActiveTimeout);
-                    if (deltaTime > PlayerDestoryTimeout)
-                        RemovePlayer(i);
+                    player.Update(PlayerActiveTimeout);
                 }
 
                 if (messenger.Loggedin)
                 {
-                    if (IsJoined && taskOrder++ % 2 == 0)
-                        Send(EventCode.Alive, false, sendBuffer);
-                    else
-                        SendPing();
+                    // room members are pushed by the server so just keep alive with pings
+                    if (IsJoined == false || taskOrder++ % 2 == 0)
+                    {
+                        // relay packets keep the session alive so pings are only needed now and then to sync the clock
+                        if (PingPiggyback && IsJoined && Time.realtimeSinceStartup - messenger.RelaySentTime < 2 && skippedPings < maxSkippedPings)
+                            skippedPings++;
+                        else
+                        {
+                            skippedPings = 0;
+                            SendPing();
+                        }
+                    }
+
+                    if (PingPiggyback && messenger.ReceivedTime > aliveTime)
+                        aliveTime = messenger.ReceivedTime;
+
+                    if (IsJoined)
+                        roomLog.Update();
 
                     if (connectionState != IsConnected)
                     {
@@ -56,10 +70,20 @@ namespace SeganX.Realtime
 
         private void Update()
         {
-            var now = (ulong)DateTimeOffset.Now.ToUnixTimeMilliseconds();
-            ServerTime = now + deltaTime;
+            ServerTime = (ulong)((long)Messenger.Now + messenger.ClockOffset) / 1000;
 
             messenger.Update(Time.unscaledDeltaTime);
+
+            // the server replaces a silent master after master_heartbeat_timeout so the master keeps a faster cadence
+            if (IsMaster && IsJoined && messenger.Loggedin)
+            {
+                var now = Time.realtimeSinceStartup;
+                if (now - masterHeartbeatTime >= MasterHeartbeatInterval && now - messenger.RelaySentTime >= MasterHeartbeatInterval)
+                {
+                    masterHeartbeatTime = now;
+                    SendPing();
+                }
+            }
         }
 
 #if UNITY_EDITOR
@@ -71,38 +95,22 @@ namespace SeganX.Realtime
         }
 #endif
 
-        private void SendContinuousMyName(byte eventCode, sbyte otherId, int count)
-        {
-            StartCoroutine(ISendContinuousMyName(eventCode, otherId, count));
-        }
-
-        private IEnumerator ISendContinuousMyName(byte eventCode, sbyte otherId, int count)
-        {
-            var wait = new WaitForSecondsRealtime(0.2f);
-            while (count-- > 0)
-            {
-                if (otherId >= 0)
-                    Send(eventCode, false, new BufferWriter(128).AppendString(Player.Name), Target.Player, otherId);
-                else
-                    Send(eventCode, false, new BufferWriter(128).AppendString(Player.Name));
-                yield return wait;
-            }
-        }
-
-
         //////////////////////////////////////////////////////
         /// STATIC MEMBERS
         //////////////////////////////////////////////////////
         private static Radio instance = null;
         private static Action onConnected = null;
-        private static readonly byte[] cacheBytes = new byte[512];
-        private static readonly BufferWriter sendBuffer = new BufferWriter(512);
+        private static readonly byte[] cacheBytes = new byte[Reliable.MaxMessageSize];
+        private static readonly byte[] metaBytes = new byte[32];
+        private static readonly BufferWriter sendBuffer = new BufferWriter(Reliable.MaxMessageSize + 1);
         private static readonly NetPlayer myPlayer = new NetPlayer();
         private static readonly Messenger messenger = new Messenger();
+        private static readonly RoomState roomState = new RoomState(messenger);
+        private static readonly RoomLog roomLog = new RoomLog(messenger, OnReceivedMessage);
         private static readonly NetPlayer[] players = new NetPlayer[maxPlayers];
 
         private static bool logingin = false;
-        private static ulong deltaTime = 0;
+        private static float membersTime = 0;
         private static float aliveTime = -10;
         private static float DeathTime => Time.realtimeSinceStartup - aliveTime;
 
@@ -110,13 +118,25 @@ namespace SeganX.Realtime
         public static event Action OnMasterChanged = null;
         public static event Action<NetPlayer> OnPlayerConnected = null;
         public static event Action<NetPlayer> OnPlayerRemoved = null;
-        public static event Action<NetPlayer, byte, byte[], byte> OnReceived = null;
+        public static event Action<NetPlayer, byte, byte[], int> OnReceived = null;
+
+        public static event Action<ushort, byte[]> OnStateChanged
+        {
+            add => roomState.OnChanged += value;
+            remove => roomState.OnChanged -= value;
+        }
 
         public static float ConnectionTimeout { get; set; } = 15;
+        // skip pings while sending relay packets. any packet from the server keeps the connection alive
+        public static bool PingPiggyback { get; set; } = false;
         public static float PlayerActiveTimeout { get; set; } = 5;
+        // seconds between the heartbeats of the master which must be well below master_heartbeat_timeout of the server
+        public static float MasterHeartbeatInterval { get; set; } = 0.1f;
+        [Obsolete("Players are removed by membership events of the server")]
         public static float PlayerDestoryTimeout { get; set; } = 30;
         public static byte PlayersCount { get; private set; } = 0;
         public static ulong Ping { get; private set; } = 0;
+        public static float RoundTripTime { get; private set; } = 0;   //  milliseconds with the precision of microseconds
         public static bool IsMaster { get; private set; } = true;
         public static ulong ServerTime { get; private set; } = 0;
 
@@ -126,8 +146,16 @@ namespace SeganX.Realtime
         public static sbyte PlayerId => messenger.Index;
         public static bool IsConnected => messenger.Loggedin && DeathTime < ConnectionTimeout;
         public static bool IsJoined => RoomId >= 0;
+        public static ushort StateVersion => roomState.Version;
 
 
+        // encrypt the whole session after the next login. must be set before connecting
+        public static bool Secure
+        {
+            get => messenger.Secure;
+            set => messenger.Secure = value;
+        }
+
         public static float DebugDelayFactor
         {
             get => messenger.DelayFactor;
@@ -147,7 +175,7 @@ namespace SeganX.Realtime
             onConnected = onConnectedToServer;
             var addressParts = serverAddress.Split(':');
             var serverIpPort = new IPEndPoint(IPAddress.Parse(addressParts[0]), int.Parse(addressParts[1]));
-            messenger.Start(deviceId, serverIpPort, OnReceivedMessage);
+            messenger.Start(deviceId, serverIpPort, OnReceivedMessage, OnReceivedEvent);
         }
 
         public static void Disconnect(Action callback)
@@ -161,7 +189,10 @@ namespace SeganX.Realtime
             messenger.Logout(() =>
             {
                 messenger.Stop();
+                roomState.Clear();
+                roomLog.Clear();
                 Ping = 0;
+                RoundTripTime = 0;
 
                 for (int i = 0; i < maxPlayers; i++)
                     RemovePlayer(i);
@@ -189,9 +220,12 @@ namespace SeganX.Realtime
 
         public static void CreateRoom(string playerName, ushort openTimeout, byte[] properties, MatchmakingParams matchmaking, Action<short, sbyte> callback)
         {
-            messenger.CreateRoom(openTimeout, properties, matchmaking, (error, roomId, playerId) =>
+            messenger.CreateRoom(openTimeout, properties, matchmaking, CreateMeta(playerName), (error, roomId, playerId) =>
             {
                 if (ErrorExist(error, () => CreateRoom(playerName, openTimeout, properties, matchmaking, callback))) return;
+                roomState.Clear();
+                roomLog.Clear();
+                membersTime = Time.realtimeSinceStartup;
                 callback?.Invoke(roomId, playerId);
                 AddPlayer(playerId, playerName);
             });
@@ -201,13 +235,20 @@ namespace SeganX.Realtime
         {
             if (IsJoined) return;
 
-            messenger.JoinRoom(matchmaking, (error, roomId, playerId, properties) =>
+            messenger.JoinRoom(matchmaking, CreateMeta(playerName), (error, roomId, playerId, properties, members) =>
             {
                 if (error == Error.NoError)
                 {
+                    roomState.Clear();
+                    roomState.RequestSnapshot();
+                    roomLog.Clear();
+                    membersTime = Time.realtimeSinceStartup;
                     onJoined?.Invoke(roomId, playerId, properties);
                     AddPlayer(playerId, playerName);
-                    instance.SendContinuousMyName(EventCode.Checkin, -1, 20);
+                    foreach (var member in members)
+                        if (member.index != playerId)
+                            AddPlayer(member.index, ReadMetaName(member.meta)).Stamptime();
+                    roomLog.Begin(messenger.LogFirst, messenger.LogLast);
                 }
                 else if (error == Error.Expired)
                     ErrorExist(error, () => JoinRoom(playerName, matchmaking, onJoined));
@@ -223,31 +264,80 @@ namespace SeganX.Realtime
             messenger.LeaveRoom(error =>
             {
                 if (ErrorExist(error)) return;
+                roomState.Clear();
+                roomLog.Clear();
                 callback?.Invoke();
             });
         }
 
+        // the room state is kept by the server and shared with all players in the room
+        public static byte[] GetState(ushort key)
+        {
+            return roomState.Get(key);
+        }
+
+        // data must be less than 256 bytes. OnStateChanged will be called when the server applied the change
+        public static void SetState(ushort key, byte[] data, Action<Error> callback = null)
+        {
+            if (IsJoined == false) return;
+
+            roomState.Set(key, data, error =>
+            {
+                if (ErrorExist(error, () => SetState(key, data, callback))) return;
+                callback?.Invoke(error);
+            });
+        }
+
+        public static void DeleteState(ushort key, Action<Error> callback = null)
+        {
+            SetState(key, null, callback);
+        }
+
         private static void SendPing()
         {
-            messenger.SendPing((error, pingTime) =>
+            var sentTime = Time.realtimeSinceStartup;
+            messenger.SendPing((error, roundTrip) =>
             {
                 if (ErrorExist(error)) return;
-                var now = (ulong)DateTimeOffset.Now.ToUnixTimeMilliseconds();
-                deltaTime = messenger.ServerTime - now;
                 aliveTime = Time.realtimeSinceStartup;
-                Ping = pingTime;
+                Ping = roundTrip / 1000;
+                RoundTripTime = roundTrip / 1000f;
+
+                UpdateMaster();
+
+                // the members of the response may be older than a membership event received meanwhile
+                if (membersTime < sentTime)
+                    UpdateMembers(messenger.Members);
 
-                var newMaster = messenger.Flag.HasFlag(Flag.Master);
-                if (IsMaster != newMaster)
-                {
-                    IsMaster = newMaster;
-                    OnMasterChanged?.Invoke();
-                }
                 onConnected?.Invoke();
                 onConnected = null;
             });
         }
 
+        // converge to the room members in case of missed events
+        private static void UpdateMembers(byte members)
+        {
+            if (IsJoined == false) return;
+            for (sbyte i = 0; i < 8; i++)
+            {
+                if (i == PlayerId) continue;
+                if ((members & (1 << i)) == 0)
+                    RemovePlayer(i);
+                else if (players[i] == null)
+                    AddPlayer(i, string.Empty).Stamptime();
+            }
+        }
+
+        private static void UpdateMaster()
+        {
+            var newMaster = messenger.Flag.HasFlag(Flag.Master);
+            if (IsMaster != newMaster)
+            {
+                IsMaster = newMaster;
+                OnMasterChanged?.Invoke();
+            }
+        }
+
         private static bool ErrorExist(Error error, Action OnExpiredAndLoggedin = null)
         {
             if (error == Error.NoError) return false;
@@ -275,6 +365,19 @@ namespace SeganX.Realtime
                 SendUnreliable(target, sendBuffer, otherId);
         }
 
+        // send data reliably to the other players and keep it on the server for the players who join later
+        public static void SendPersistent(byte eventCode, BufferWriter data)
+        {
+            if (IsConnected == false || IsJoined == false) return;
+
+            sendBuffer.Reset();
+            sendBuffer.AppendByte(eventCode);
+            sendBuffer.AppendBytes(data.Bytes, data.Length);
+
+            roomLog.Persist(sendBuffer.Bytes, (byte)sendBuffer.Length);
+            SendReliable(Target.Other, sendBuffer, -1);
+        }
+
         private static void SendUnreliable(Target target, BufferWriter data, sbyte otherId)
         {
             messenger.SendUnreliable(target, data, otherId);
@@ -300,7 +403,7 @@ namespace SeganX.Realtime
             }
         }
 
-        private static void OnReceivedMessage(Error error, sbyte senderId, BufferReader buffer, byte dataSize)
+        private static void OnReceivedMessage(Error error, sbyte senderId, BufferReader buffer, int dataSize)
         {
             if (IsConnected == false || ErrorExist(error)) return;
 
@@ -319,13 +422,9 @@ namespace SeganX.Realtime
 
                 case EventCode.Checkin:
                 case EventCode.Welcome:
-                    if (player == null)
-                    {
-                        var playerName = buffer.ReadString();
-                        AddPlayer(senderId, playerName).Stamptime();
-                        if (code == EventCode.Checkin)
-                            instance.SendContinuousMyName(EventCode.Welcome, senderId, 20);
-                    }
+                    // names are shared by the server on join. just accept them from older clients
+                    if (player != null && player.Name.Length == 0)
+                        player.SetName(buffer.ReadString());
                     break;
 
                 default:
@@ -339,6 +438,59 @@ namespace SeganX.Realtime
             }
         }
 
+        private static void OnReceivedEvent(MessageType type, sbyte index, BufferReader buffer)
+        {
+            switch (type)
+            {
+                case MessageType.Master:
+                    UpdateMaster();
+                    break;
+
+                case MessageType.Member:
+                    {
+                        var memberEvent = (MemberEvent)buffer.ReadByte();
+                        var members = buffer.ReadByte();
+                        if (memberEvent == MemberEvent.Join)
+                        {
+                            buffer.ReadBytes(metaBytes, 32);
+                            var playerName = ReadMetaName(metaBytes);
+                            AddPlayer(index, playerName).Stamptime();
+                            players[index].SetName(playerName);
+                        }
+                        else
+                            RemovePlayer(index);
+
+                        membersTime = Time.realtimeSinceStartup;
+                        UpdateMembers(members);
+                    }
+                    break;
+
+                case MessageType.State:
+                    roomState.Received(buffer);
+                    break;
+
+                case MessageType.Logged:
+                    roomLog.Received(index, buffer);
+                    break;
+            }
+        }
+
+        // player meta data contains the name of the player as a string
+        private static byte[] CreateMeta(string playerName)
+        {
+            var res = new byte[32];
+            var bytes = System.Text.Encoding.UTF8.GetBytes(playerName ?? string.Empty);
+            var length = Math.Min(bytes.Length, res.Length - 1);
+            res[0] = (byte)length;
+            Buffer.BlockCopy(bytes, 0, res, 1, length);
+            return res;
+        }
+
+        private static string ReadMetaName(byte[] meta)
+        {
+            return new BufferReader(meta).ReadString();
+        }
+
         private static NetPlayer AddPlayer(sbyte id, string playerName)
         {
             var player = players[id];
@@ -10,19 +10,36 @@ namespace SeganX.Realtime.Internal
     {
         private const string logName = "[Network] [Reliable]";
 
+        public const int MaxPacketSize = 1200;
+        public const int MaxFragmentSize = 1180;
+        public const int MaxMessageSize = 32 * 1024;
+
+        private class Assembly
+        {
+            public int first = -1;
+            public int last = -1;
+            public int count = 0;
+            public int pending = 0;
+            public int size = 0;
+            public ulong received = 0;
+            public readonly byte[] data = new byte[MaxMessageSize];
+        }
+
         private Socket socket = null;
         private ClientInfo clientInfo = null;
         private IPEndPoint serverAddress = null;
         private readonly BufferWriter sendBuffer = new BufferWriter(512);
-        private Action<Error, sbyte, BufferReader, byte> OnReceivedMessage = null;
+        private Action<Error, sbyte, BufferReader, int> OnReceivedMessage = null;
 
         private byte AckNumber = 0;
         private readonly List<int> AcksCache = new List<int>(64);
         private readonly List<ReliableMessage> ReadyMessages = new List<ReliableMessage>(128);
         private readonly List<ReliableMessage> SendingMessages = new List<ReliableMessage>(64);
         private readonly Pool<ReliableMessage> messagePool = new Pool<ReliableMessage>(128);
+        private readonly Assembly[] assemblies = new Assembly[64];
+        private readonly BufferReader assemblyReader = new BufferReader(null);
 
-        public Reliable(Socket socket, IPEndPoint serverAddress, ClientInfo clientInfo, Action<Error, sbyte, BufferReader, byte> OnReceivedMessage)
+        public Reliable(Socket socket, IPEndPoint serverAddress, ClientInfo clientInfo, Action<Error, sbyte, BufferReader, int> OnReceivedMessage)
         {
             this.socket = socket;
             this.clientInfo = clientInfo;
@@ -33,11 +50,17 @@ namespace SeganX.Realtime.Internal
                 AcksCache.Add(-1);
         }
 
-        public void SendReliable(sbyte targetIndex, byte[] data, byte dataSize, int retryCount = 10, float retryDelay = 0.5f)
+        public void SendReliable(sbyte targetIndex, byte[] data, int dataSize, int retryCount = 10, float retryDelay = 0.5f)
         {
+            if (dataSize > MaxMessageSize)
+            {
+                Debug.LogError($"{logName} Data length must be lees that {MaxMessageSize} byes");
+                return;
+            }
+
             if (dataSize > 235)
             {
-                Debug.LogError($"{logName} Data length must be lees that 235 byes");
+                SendFragments(targetIndex, data, dataSize, retryCount, retryDelay);
                 return;
             }
 
@@ -47,32 +70,88 @@ namespace SeganX.Realtime.Internal
             message.maxDelayTime = retryDelay;
             message.delayTime = 0;
             message.ack = AckNumber;
+            message.group = 0;
             message.targetIndex = targetIndex;
             message.retryCount = retryCount;
             message.buffer.Reset()
-                .AppendByte((byte)MessageType.Reliable)
-                .AppendUint(clientInfo.token)
-                .AppendShort(clientInfo.id)
-                .AppendShort(clientInfo.room)
-                .AppendSbyte(clientInfo.index)
+                .AppendByte((byte)MessageType.CompactReliable)
+                .AppendUshort((ushort)clientInfo.id)
+                .AppendUshort(clientInfo.key)
                 .AppendSbyte(targetIndex)
                 .AppendByte(AckNumber)
-                .AppendByte(dataSize)
-                .AppendBytes(data, dataSize);
+                .AppendByte((byte)dataSize)
+                .AppendBytes(data, dataSize)
+                .AppendMac(clientInfo.secret);
+
+            Enqueue(message);
+
+            //Debug.Log($"{logName} Send Reliable Target:{targetIndex} Ack:{AckNumber}");
+        }
+
+        // split the data into the fewest fragments that fit in a datagram and send them back to back.
+        // each fragment is acknowledged on its own so only the missing ones are sent again. the acks of
+        // a message are consecutive so the receiver finds the first ack of the message by ack - index
+        private void SendFragments(sbyte targetIndex, byte[] data, int dataSize, int retryCount, float retryDelay)
+        {
+            var count = (dataSize + MaxFragmentSize - 1) / MaxFragmentSize;
+            if (AckNumber + count > byte.MaxValue) AckNumber = 0;
+            var group = (byte)(AckNumber + 1);
+
+            for (int i = 0, offset = 0; i < count; i++, offset += MaxFragmentSize)
+            {
+                while (++AckNumber == 0) ;
+
+                var size = System.Math.Min(MaxFragmentSize, dataSize - offset);
+                var message = messagePool.Peek();
+                message.maxDelayTime = retryDelay;
+                message.delayTime = 0;
+                message.ack = AckNumber;
+                message.group = group;
+                message.targetIndex = targetIndex;
+                message.retryCount = retryCount;
+                message.buffer.Reset()
+                    .AppendByte((byte)MessageType.Fragment)
+                    .AppendUshort((ushort)clientInfo.id)
+                    .AppendUshort(clientInfo.key)
+                    .AppendSbyte(targetIndex)
+                    .AppendByte(AckNumber)
+                    .AppendByte((byte)i)
+                    .AppendByte((byte)count)
+                    .AppendUshort((ushort)size);
+                message.buffer.Append(data, offset, size)
+                    .AppendMac(clientInfo.secret);
+
+                Enqueue(message);
+            }
+        }
 
-            if (SendingMessages.AddUnique(message, x => x.targetIndex == targetIndex))
+        // one message per target is in flight at a time except the fragments of the same message.
+        // a message waits behind the ready messages of its target to keep them in order
+        private bool AddSending(ReliableMessage message, int readyIndex)
+        {
+            if (ReadyMessages.FindIndex(0, readyIndex, x => x.targetIndex == message.targetIndex) >= 0) return false;
+            return SendingMessages.AddUnique(message, x => x.targetIndex == message.targetIndex && (x.group == 0 || x.group != message.group));
+        }
+
+        private void Enqueue(ReliableMessage message)
+        {
+            if (AddSending(message, ReadyMessages.Count))
                 socket.Send(serverAddress, message.buffer.Bytes, message.buffer.Length);
             else
                 ReadyMessages.Add(message);
-
-            //Debug.Log($"{logName} Send Reliable Target:{targetIndex} Ack:{AckNumber}");
         }
 
         public void Update(float elapsedTime)
         {
             for (int i = 0; i < ReadyMessages.Count; i++)
-                if (SendingMessages.AddUnique(ReadyMessages[i], x => x.targetIndex == ReadyMessages[i].targetIndex))
+            {
+                var message = ReadyMessages[i];
+                if (AddSending(message, i))
+                {
                     ReadyMessages.RemoveAt(i--);
+                    socket.Send(serverAddress, message.buffer.Bytes, message.buffer.Length);
+                }
+            }
 
             for (int i = 0; i < SendingMessages.Count; i++)
                 SendReliable(SendingMessages[i], elapsedTime);
@@ -99,6 +178,54 @@ namespace SeganX.Realtime.Internal
             OnReceivedMessage(Error.NoError, sender, receivedBuffer, datasize);
         }
 
+        public void ReceivedFragment(Error error, sbyte sender, BufferReader receivedBuffer)
+        {
+            if (error != Error.NoError)
+            {
+                OnReceivedMessage(error, 0, receivedBuffer, 0);
+                return;
+            }
+            if (sender < 0 || sender >= AcksCache.Capacity) return;
+
+            byte ack = receivedBuffer.ReadByte();
+            SendRelied(sender, ack);
+
+            var fragment = receivedBuffer.ReadByte();
+            var count = receivedBuffer.ReadByte();
+            var datasize = receivedBuffer.ReadUshort();
+            var offset = fragment * MaxFragmentSize;
+            if (fragment >= count || offset + datasize > MaxMessageSize) return;
+            if (fragment < count - 1 && datasize != MaxFragmentSize) return;
+
+            // fragments arrive in any order. a message with a new first ack means the sender
+            // has given up the previous one, and a retry of the last finished message is ignored
+            var first = (byte)(ack - fragment);
+            var assembly = assemblies[sender] ?? (assemblies[sender] = new Assembly());
+            if (first == assembly.last) return;
+            if (first != assembly.first || count != assembly.count)
+            {
+                assembly.first = first;
+                assembly.count = count;
+                assembly.pending = count;
+                assembly.size = 0;
+                assembly.received = 0;
+            }
+
+            var bit = 1UL << fragment;
+            if ((assembly.received & bit) != 0) return;
+            assembly.received |= bit;
+
+            receivedBuffer.ReadBytes(assembly.data, offset, datasize);
+            assembly.size += datasize;
+
+            if (--assembly.pending == 0)
+            {
+                assembly.last = first;
+                assembly.first = -1;
+                OnReceivedMessage(Error.NoError, sender, assemblyReader.Reset(assembly.data), assembly.size);
+            }
+        }
+
         public void ReceivedRelied(Error error, sbyte sender, BufferReader receivedBuffer)
         {
             if (error != Error.NoError)
@@ -128,19 +255,21 @@ namespace SeganX.Realtime.Internal
 
                 //Debug.Log($"{logName} Send Reliable Target:{message.targetIndex} Ack:{message.ack}");
             }
-            else SendingMessages.Remove(message);
+            else if (message.group != 0)
+                SendingMessages.RemoveAll(x => x.targetIndex == message.targetIndex && x.group == message.group);
+            else
+                SendingMessages.Remove(message);
         }
 
         private void SendRelied(sbyte sender, byte ack)
         {
             sendBuffer.Reset()
-                .AppendByte((byte)MessageType.Relied)
-                .AppendUint(clientInfo.token)
-                .AppendShort(clientInfo.id)
-                .AppendShort(clientInfo.room)
-                .AppendSbyte(clientInfo.index)
+                .AppendByte((byte)MessageType.CompactRelied)
+                .AppendUshort((ushort)clientInfo.id)
+                .AppendUshort(clientInfo.key)
                 .AppendSbyte(sender)
-                .AppendByte(ack);
+                .AppendByte(ack)
+                .AppendMac(clientInfo.secret);
             socket.Send(serverAddress, sendBuffer.Bytes, sendBuffer.Length);
 
             //Debug.Log($"{logName} Send Relied Target:{sender} Ack:{ack}");
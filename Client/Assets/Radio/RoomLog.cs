@@ -0,0 +1,136 @@
+using System.Collections.Generic;
+using UnityEngine;
+
+namespace SeganX.Realtime.Internal
+{
+    public class RoomLog
+    {
+        private const string logName = "[Network] [RoomLog]";
+
+        private class Entry
+        {
+            public sbyte sender = -1;
+            public byte dataSize = 0;
+            public readonly byte[] data = new byte[235];
+        }
+
+        private class Pending
+        {
+            public byte ack = 0;
+            public byte[] data = null;
+        }
+
+        private readonly Messenger messenger = null;
+        private readonly System.Action<Error, sbyte, BufferReader, int> OnReceivedMessage = null;
+        private readonly Dictionary<ushort, Entry> received = new Dictionary<ushort, Entry>();
+        private readonly Queue<Pending> pendings = new Queue<Pending>();
+        private readonly BufferReader reader = new BufferReader(null);
+        private byte ack = 0;
+        private bool sending = false;
+        private bool requesting = false;
+        private bool started = false;
+        private ushort next = 0;
+        private ushort last = 0;
+
+        public bool CatchingUp => started && next != last;
+
+        public RoomLog(Messenger messenger, System.Action<Error, sbyte, BufferReader, int> OnReceivedMessage)
+        {
+            this.messenger = messenger;
+            this.OnReceivedMessage = OnReceivedMessage;
+        }
+
+        public void Clear()
+        {
+            received.Clear();
+            pendings.Clear();
+            sending = false;
+            requesting = false;
+            started = false;
+            next = last = 0;
+        }
+
+        // messages in [first, last) are streamed by the server right after the join response
+        public void Begin(ushort first, ushort last)
+        {
+            started = true;
+            next = first;
+            this.last = last;
+            Deliver();
+        }
+
+        public void Received(sbyte sender, BufferReader buffer)
+        {
+            var seq = buffer.ReadUshort();
+            var dataSize = buffer.ReadByte();
+            if (started && (short)(seq - next) < 0) return;
+            if (received.ContainsKey(seq)) return;
+
+            var entry = new Entry() { sender = sender, dataSize = dataSize };
+            buffer.ReadBytes(entry.data, dataSize);
+            received.Add(seq, entry);
+            Deliver();
+        }
+
+        // request the first missed message. the server may have overwritten it in the ring
+        public void Update()
+        {
+            if (CatchingUp == false || requesting) return;
+            requesting = true;
+
+            var seq = next;
+            messenger.RequestLog(seq, (error, sender, buffer) =>
+            {
+                if (requesting == false) return;
+                requesting = false;
+
+                if (error == Error.NoError)
+                    Received(sender, buffer);
+                else if (error == Error.Invalid && seq == next)
+                {
+                    Debug.LogWarning($"{logName} Missed persistent message Seq:{seq}");
+                    next++;
+                    Deliver();
+                }
+            });
+        }
+
+        public void Persist(byte[] data, byte dataSize)
+        {
+            while (++ack == 0) ;
+
+            var pending = new Pending() { ack = ack, data = new byte[dataSize] };
+            System.Buffer.BlockCopy(data, 0, pending.data, 0, dataSize);
+            pendings.Enqueue(pending);
+            SendNext();
+        }
+
+        // there is only one persist request in flight at a time
+        private void SendNext()
+        {
+            if (sending || pendings.Count < 1) return;
+            sending = true;
+
+            var pending = pendings.Peek();
+            messenger.Persist(pending.ack, pending.data, (byte)pending.data.Length, error =>
+            {
+                if (sending == false) return;
+                sending = false;
+                pendings.Dequeue();
+                if (error != Error.NoError)
+                    Debug.LogWarning($"{logName} Persist failed Error:{error}");
+                SendNext();
+            });
+        }
+
+        private void Deliver()
+        {
+            while (CatchingUp && received.TryGetValue(next, out var entry))
+            {
+                received.Remove(next++);
+                reader.Reset(entry.data);
+                OnReceivedMessage(Error.NoError, entry.sender, reader, entry.dataSize);
+            }
+        }
+    }
+}
@@ -0,0 +1,176 @@
+using System.Collections.Generic;
+using UnityEngine;
+
+namespace SeganX.Realtime.Internal
+{
+    public class RoomState
+    {
+        private const string logName = "[Network] [RoomState]";
+        private const int maxStateSize = 1024;
+
+        private class Pending
+        {
+            public ushort key = 0;
+            public byte[] data = null;
+            public System.Action<Error> callback = null;
+        }
+
+        private readonly Messenger messenger = null;
+        private readonly Dictionary<ushort, byte[]> values = new Dictionary<ushort, byte[]>();
+        private readonly Queue<Pending> pendings = new Queue<Pending>();
+        private readonly byte[] snapshot = new byte[maxStateSize];
+        private ushort snapshotVersion = 0;
+        private bool sending = false;
+        private bool syncing = false;
+
+        public ushort Version { get; private set; } = 0;
+        public event System.Action<ushort, byte[]> OnChanged = null;
+
+        public RoomState(Messenger messenger)
+        {
+            this.messenger = messenger;
+        }
+
+        public byte[] Get(ushort key)
+        {
+            return values.TryGetValue(key, out var data) ? data : null;
+        }
+
+        public void Clear()
+        {
+            values.Clear();
+            pendings.Clear();
+            Version = 0;
+            sending = false;
+            syncing = false;
+        }
+
+        // the change will be applied when the server pushes it back to all players
+        public void Set(ushort key, byte[] data, System.Action<Error> callback)
+        {
+            if (data != null && data.Length > 255)
+            {
+                Debug.LogError($"{logName} Set: Data length must be less than 256 bytes");
+                return;
+            }
+
+            pendings.Enqueue(new Pending() { key = key, data = data, callback = callback });
+            SendNext();
+        }
+
+        // there is only one state set request in flight at a time
+        private void SendNext()
+        {
+            if (sending || pendings.Count < 1) return;
+            sending = true;
+
+            var pending = pendings.Peek();
+            var dataSize = (byte)(pending.data == null ? 0 : pending.data.Length);
+            messenger.SetState(pending.key, pending.data, dataSize, error =>
+            {
+                if (sending == false) return;
+                sending = false;
+                pendings.Dequeue();
+                pending.callback?.Invoke(error);
+                SendNext();
+            });
+        }
+
+        public void Received(BufferReader buffer)
+        {
+            var version = buffer.ReadUshort();
+            var key = buffer.ReadUshort();
+            var dataSize = buffer.ReadByte();
+            if (syncing) return;
+
+            // ignore duplicated versions and resync on a missed one
+            var distance = (short)(version - Version);
+            if (distance <= 0) return;
+            if (distance > 1)
+            {
+                Debug.Log($"{logName} Missed state version Current:{Version} Received:{version}");
+                RequestSnapshot();
+                return;
+            }
+
+            Version = version;
+            if (dataSize > 0)
+            {
+                var data = new byte[dataSize];
+                buffer.ReadBytes(data, dataSize);
+                values[key] = data;
+                OnChanged?.Invoke(key, data);
+            }
+            else if (values.Remove(key))
+                OnChanged?.Invoke(key, null);
+        }
+
+        public void RequestSnapshot()
+        {
+            syncing = true;
+            RequestSnapshot(0);
+        }
+
+        private void RequestSnapshot(ushort offset)
+        {
+            messenger.RequestStateSnapshot(offset, (error, version, size, recoffset, buffer) =>
+            {
+                if (syncing == false) return;
+
+                if (error != Error.NoError)
+                {
+                    syncing = false;
+                    return;
+                }
+
+                // start over if the state has been changed between the chunks
+                if (recoffset > 0 && version != snapshotVersion)
+                {
+                    RequestSnapshot(0);
+                    return;
+                }
+
+                snapshotVersion = version;
+                var dataSize = buffer.ReadByte();
+                if (recoffset + dataSize > maxStateSize)
+                {
+                    syncing = false;
+                    return;
+                }
+
+                System.Buffer.BlockCopy(buffer.Bytes, buffer.Posision, snapshot, recoffset, dataSize);
+
+                if (recoffset + dataSize < size)
+                    RequestSnapshot((ushort)(recoffset + dataSize));
+                else
+                    ApplySnapshot(version, size);
+            });
+        }
+
+        private void ApplySnapshot(ushort version, int size)
+        {
+            syncing = false;
+            Version = version;
+
+            var removed = new List<ushort>(values.Keys);
+            values.Clear();
+
+            var reader = new BufferReader(snapshot);
+            while (reader.Posision < size)
+            {
+                var key = reader.ReadUshort();
+                var data = new byte[reader.ReadByte()];
+                reader.ReadBytes(data, data.Length);
+                values[key] = data;
+                removed.Remove(key);
+            }
+
+            Debug.Log($"{logName} Applied snapshot Version:{Version} Size:{size} Keys:{values.Count}");
+
+            foreach (var key in removed)
+                OnChanged?.Invoke(key, null);
+            foreach (var item in values)
+                OnChanged?.Invoke(item.Key, item.Value);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+namespace SeganX.Realtime.Internal
+{
+    public static class SipHash
+    {
+        // login packets are sent before the session secret is known so they use the key shared with the server
+        public static readonly byte[] LoginKey = { 0x5e, 0x9a, 0x11, 0xc4, 0x73, 0x2d, 0xe8, 0x06, 0xb1, 0x4f, 0x97, 0x3a, 0xd2, 0x68, 0x0c, 0xf5 };
+
+        // SipHash-2-4 of the data with a 128 bit key
+        public static ulong Compute(byte[] key, byte[] data, int size)
+        {
+            ulong k0 = ReadUlong(key, 0);
+            ulong k1 = ReadUlong(key, 8);
+            ulong v0 = 0x736f6d6570736575UL ^ k0;
+            ulong v1 = 0x646f72616e646f6dUL ^ k1;
+            ulong v2 = 0x6c7967656e657261UL ^ k0;
+            ulong v3 = 0x7465646279746573UL ^ k1;
+
+            int end = size & ~7;
+            for (int i = 0; i < end; i += 8)
+            {
+                ulong m = ReadUlong(data, i);
+                v3 ^= m;
+                Round(ref v0, ref v1, ref v2, ref v3);
+                Round(ref v0, ref v1, ref v2, ref v3);
+                v0 ^= m;
+            }
+
+            ulong b = (ulong)size << 56;
+            for (int i = size & 7; i > 0; i--)
+                b |= (ulong)data[end + i - 1] << (8 * (i - 1));
+
+            v3 ^= b;
+            Round(ref v0, ref v1, ref v2, ref v3);
+            Round(ref v0, ref v1, ref v2, ref v3);
+            v0 ^= b;
+
+            v2 ^= 0xff;
+            Round(ref v0, ref v1, ref v2, ref v3);
+            Round(ref v0, ref v1, ref v2, ref v3);
+            Round(ref v0, ref v1, ref v2, ref v3);
+            Round(ref v0, ref v1, ref v2, ref v3);
+
+            return v0 ^ v1 ^ v2 ^ v3;
+        }
+
+        public static uint ComputeMac(byte[] key, byte[] data, int size)
+        {
+            return (uint)Compute(key, data, size);
+        }
+
+        private static void Round(ref ulong v0, ref ulong v1, ref ulong v2, ref ulong v3)
+        {
+            v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+            v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+        }
+
+        private static ulong Rotl(ulong x, int b)
+        {
+            return (x << b) | (x >> (64 - b));
+        }
+
+        private static ulong ReadUlong(byte[] data, int offset)
+        {
+            ulong res = 0;
+            for (int i = 7; i >= 0; i--)
+                res = (res << 8) | data[offset + i];
+            return res;
+        }
+    }
+
+    public static partial class Extension
+    {
+        // every packet to the server ends with the MAC of the packet
+        public static BufferWriter AppendMac(this BufferWriter self, byte[] key)
+        {
+            return self.AppendUint(SipHash.ComputeMac(key, self.Bytes, self.Length));
+        }
+    }
+}
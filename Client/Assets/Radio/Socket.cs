@@ -10,6 +10,33 @@ namespace SeganX.Realtime.Internal
 
         private EndPoint anyIP = new IPEndPoint(IPAddress.Any, 0);
 
+        private const byte secureType = 70;
+        private const int secureUpHeader = 11;
+        private const int secureDownHeader = 9;
+        private byte[] cipherKey = null;
+        private short cipherHandle = 0;
+        private ulong cipherCounter = 0;
+        private ulong replayTop = 0;
+        private ulong replayMask = 0;
+        private readonly byte[] nonce = new byte[Cipher.NonceLength];
+        private readonly byte[] header = new byte[secureUpHeader];
+        private readonly byte[] sealBuffer = new byte[secureUpHeader + Reliable.MaxPacketSize + Cipher.TagLength];
+        private readonly byte[] openBuffer = new byte[secureUpHeader + Reliable.MaxPacketSize + Cipher.TagLength];
+
+        public bool Secure => cipherKey != null;
+        public float RelaySentTime { get; private set; } = 0;
+        public float ReceivedTime { get; private set; } = 0;
+
+        // all packets except login are sealed with the key after the session is secured
+        public void SetCipher(byte[] key, short handle)
+        {
+            cipherKey = key;
+            cipherHandle = handle;
+            cipherCounter = 0;
+            replayTop = 0;
+            replayMask = 0;
+        }
+
         // open a udp socket on a port in range and return the port number
         public int Open(int minPort, int maxPort)
         {
@@ -35,12 +62,23 @@ namespace SeganX.Realtime.Internal
 
         public bool Send(IPEndPoint destination, byte[] buffer, int size)
         {
-            if (udpClient == null || buffer == null || buffer.Length < size || size < 1)
+            if (udpClient == null || buffer == null || buffer.Length < size || size < 1 || size > Reliable.MaxPacketSize)
             {
                 Debug.LogError("Send failed!");
                 return false;
             }
 
+            // relay packets refresh the session on the server as well as pings
+            if (buffer[0] >= (byte)MessageType.Unreliable && buffer[0] <= (byte)MessageType.Fragment)
+                RelaySentTime = Time.realtimeSinceStartup;
+
+            if (cipherKey != null && buffer[0] != (byte)MessageType.Login)
+            {
+                Seal(buffer, size);
+                buffer = sealBuffer;
+                size += secureUpHeader + Cipher.TagLength;
+            }
+
             try
             {
                 int sentBytes = udpClient.Send(buffer, size, destination);
@@ -54,15 +92,86 @@ namespace SeganX.Realtime.Internal
 
         public int Receive(byte[] buffer)
         {
-            if (udpClient.Client.Available < 1) return 0;
+            while (udpClient.Client.Available > 0)
+            {
+                int size = 0;
+                try
+                {
+                    size = udpClient.Client.ReceiveFrom(cipherKey == null ? buffer : openBuffer, ref anyIP);
+                }
+                catch { };
 
-            try
+                if (size < 1) return 0;
+                if (cipherKey != null) size = Open(buffer, size);
+                if (size < 1) continue;
+
+                ReceivedTime = Time.realtimeSinceStartup;
+                return size;
+            }
+            return 0;
+        }
+
+        private void Seal(byte[] buffer, int size)
+        {
+            var counter = ++cipherCounter;
+            sealBuffer[0] = secureType;
+            sealBuffer[1] = (byte)cipherHandle;
+            sealBuffer[2] = (byte)(cipherHandle >> 8);
+            for (int i = 0; i < 8; i++)
+                sealBuffer[3 + i] = nonce[4 + i] = (byte)(counter >> (8 * i));
+
+            // the first word of the nonce separates the directions of the session
+            nonce[0] = 0;
+            System.Buffer.BlockCopy(sealBuffer, 0, header, 0, secureUpHeader);
+            Cipher.Seal(sealBuffer, secureUpHeader, cipherKey, nonce, header, secureUpHeader, buffer, 0, size);
+        }
+
+        // return the size of the opened packet or zero if it must be dropped
+        private int Open(byte[] buffer, int size)
+        {
+            // login responses and errors are the only packets which are not sealed by the server
+            if (openBuffer[0] != secureType)
             {
-                return udpClient.Client.ReceiveFrom(buffer, ref anyIP);
+                if (openBuffer[0] != (byte)MessageType.Login && size != 2) return 0;
+                System.Buffer.BlockCopy(openBuffer, 0, buffer, 0, size);
+                return size;
             }
-            catch { };
 
-            return 0;
+            int innerSize = size - secureDownHeader - Cipher.TagLength;
+            if (innerSize < 1 || innerSize > buffer.Length) return 0;
+
+            nonce[0] = 1;
+            System.Buffer.BlockCopy(openBuffer, 1, nonce, 4, 8);
+            System.Buffer.BlockCopy(openBuffer, 0, header, 0, secureDownHeader);
+            if (Cipher.Open(buffer, 0, cipherKey, nonce, header, secureDownHeader, openBuffer, secureDownHeader, innerSize) == false) return 0;
+
+            // the counter is trusted only after the tag is verified
+            ulong counter = 0;
+            for (int i = 0; i < 8; i++)
+                counter |= (ulong)openBuffer[1 + i] << (8 * i);
+            return AcceptCounter(counter) ? innerSize : 0;
+        }
+
+        // sliding window of the last 64 counters. bit n of the mask marks the counter n behind the top
+        private bool AcceptCounter(ulong counter)
+        {
+            if (counter == 0) return false;
+
+            if (counter > replayTop)
+            {
+                ulong shift = counter - replayTop;
+                replayMask = shift < 64 ? (replayMask << (int)shift) | 1 : 1;
+                replayTop = counter;
+                return true;
+            }
+
+            ulong offset = replayTop - counter;
+            if (offset >= 64) return false;
+
+            ulong bit = 1UL << (int)offset;
+            if ((replayMask & bit) != 0) return false;
+            replayMask |= bit;
+            return true;
         }
     }
 }
\ No newline at end of file
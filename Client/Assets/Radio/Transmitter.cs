@@ -14,16 +14,18 @@ namespace SeganX.Realtime.Internal
         private Pool<RequestMessage> requestsPool = null;
         private IPEndPoint serverAddress = new IPEndPoint(0, 0);
         private readonly BufferWriter sendBuffer = new BufferWriter(512);
-        private readonly BufferReader receivedBuffer = new BufferReader(512);
+        private readonly BufferReader receivedBuffer = new BufferReader(Reliable.MaxPacketSize);
 
         private Reliable reliable = null;
-        private System.Action<Error, sbyte, BufferReader, byte> OnReceivedMessage = null;
+        private System.Action<Error, sbyte, BufferReader, int> OnReceivedMessage = null;
+        private System.Action<MessageType, sbyte, BufferReader> OnReceivedEvent = null;
 
-        public Transmitter Start(ClientInfo clientInfo, IPEndPoint serverAddress, System.Action<Error, sbyte, BufferReader, byte> OnReceivedMessage)
+        public Transmitter Start(ClientInfo clientInfo, IPEndPoint serverAddress, System.Action<Error, sbyte, BufferReader, int> OnReceivedMessage, System.Action<MessageType, sbyte, BufferReader> OnReceivedEvent)
         {
             this.clientInfo = clientInfo;
             this.serverAddress = serverAddress;
             this.OnReceivedMessage = OnReceivedMessage;
+            this.OnReceivedEvent = OnReceivedEvent;
 
             requestsPool = new Pool<RequestMessage>(32);
             reliable = new Reliable(socket, serverAddress, clientInfo, OnReceivedMessage);
@@ -32,10 +34,20 @@ namespace SeganX.Realtime.Internal
             return this;
         }
 
+        public float RelaySentTime => socket.RelaySentTime;
+        public float ReceivedTime => socket.ReceivedTime;
+
+        public void SetCipher(byte[] key)
+        {
+            socket.SetCipher(key, clientInfo.id);
+        }
+
         public void Stop()
         {
             OnReceivedMessage = null;
+            OnReceivedEvent = null;
             requestsPool.Clear();
+            socket.SetCipher(null, 0);
             socket.Close();
         }
 
@@ -49,21 +61,26 @@ namespace SeganX.Realtime.Internal
             request.maxDelayTime = retryDelay;
             request.delayTime = 0;
             request.callback = callback;
-            request.dataSize = dataSize;
+            request.dataSize = dataSize + 4;
             System.Buffer.BlockCopy(data, 0, request.data, 0, dataSize);
 
+            // login is sent before the session secret is received
+            var key = messageType == MessageType.Login ? SipHash.LoginKey : clientInfo.secret;
+            var mac = System.BitConverter.GetBytes(SipHash.ComputeMac(key, request.data, dataSize));
+            System.Buffer.BlockCopy(mac, 0, request.data, dataSize, 4);
+
             socket.Send(serverAddress, request.data, request.dataSize);
 
             if (messageType != MessageType.Ping)
                 Debug.Log($"{logName} Sent request to server Type:{messageType} Size:{dataSize}");
         }
 
-        public void SendMessageReliable(sbyte targetIndex, byte[] data, byte dataSize, int retryCount = 20, float retryDelay = 0.5f)
+        public void SendMessageReliable(sbyte targetIndex, byte[] data, int dataSize, int retryCount = 20, float retryDelay = 0.5f)
         {
             reliable?.SendReliable(targetIndex, data, dataSize, retryCount, retryDelay);
         }
 
-        public void SendMessageUnreliable(Target targetType, byte[] data, byte dataSize, sbyte otherIndex = -1)
+        public void SendMessageUnreliable(Target targetType, byte[] data, int dataSize, sbyte otherIndex = -1)
         {
             if (dataSize > 235)
             {
@@ -79,15 +96,15 @@ namespace SeganX.Realtime.Internal
                 case Target.Player: target = otherIndex; break;
             }
 
+            // relay packets use the compact session header which the server maps directly to the player
             sendBuffer.Reset()
-                .AppendByte((byte)MessageType.Unreliable)
-                .AppendUint(clientInfo.token)
-                .AppendShort(clientInfo.id)
-                .AppendShort(clientInfo.room)
-                .AppendSbyte(clientInfo.index)
+                .AppendByte((byte)MessageType.CompactUnreliable)
+                .AppendUshort((ushort)clientInfo.id)
+                .AppendUshort(clientInfo.key)
                 .AppendSbyte(target)
-                .AppendByte(dataSize)
-                .AppendBytes(data, dataSize);
+                .AppendByte((byte)dataSize)
+                .AppendBytes(data, dataSize)
+                .AppendMac(clientInfo.secret);
 
             socket.Send(serverAddress, sendBuffer.Bytes, sendBuffer.Length);
         }
@@ -116,6 +133,12 @@ namespace SeganX.Realtime.Internal
             if ((byte)messageType < 1) return true;
 
             var sender = receivedBuffer.ReadSbyte();
+            if (messageType == MessageType.Master || messageType == MessageType.Member || messageType == MessageType.State || messageType == MessageType.Logged)
+            {
+                OnReceivedEvent?.Invoke(messageType, sender, receivedBuffer);
+                return true;
+            }
+
             var error = sender < 0 ? (Error)sender : Error.NoError;
 
             if (error == Error.Expired)
@@ -126,6 +149,7 @@ namespace SeganX.Realtime.Internal
                 case MessageType.Unreliable: OnReceivedMessage(error, sender, receivedBuffer, receivedBuffer.ReadByte()); break;
                 case MessageType.Reliable: reliable.ReceivedReliable(error, sender, receivedBuffer); break;
                 case MessageType.Relied: reliable.ReceivedRelied(error, sender, receivedBuffer); break;
+                case MessageType.Fragment: reliable.ReceivedFragment(error, sender, receivedBuffer); break;
                 default: ReceivedRequest(messageType, error); break;
             }
 
@@ -129,7 +129,7 @@ public class Test : MonoBehaviour
 
     }
 
-    private void CurrentView_OnReceived(byte code, byte[] data, byte size)
+    private void CurrentView_OnReceived(byte code, byte[] data, int size)
     {
         Debug.Log($"view received code:{code} data:{data} size:{size}");
     }
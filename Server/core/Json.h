@@ -12,7 +12,7 @@
 #ifndef DEFINED_Json
 #define DEFINED_Json
 
-#include "Def.h"
+#include "def.h"
 
 typedef enum json_type
 {
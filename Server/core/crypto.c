@@ -0,0 +1,654 @@
+#include "crypto.h"
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment( lib, "bcrypt.lib" )
+#else
+#include <errno.h>
+#include <sys/random.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SX_CHACHA_SSE2      1
+#endif
+#define SX_CHACHA_LANES     4   //  blocks of ChaCha20 which are computed side by side in one pass
+#define SX_CHACHA_BATCH     8   //  items of a batch whose states are kept at once
+
+SEGAN_LIB_API bool sx_random(void* dest, const uint size)
+{
+#if defined(_WIN32)
+    return BCRYPT_SUCCESS(BCryptGenRandom(NULL, (PUCHAR)dest, (ULONG)size, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#else
+    // the system call reads the pool of the kernel without opening a file in each call
+    byte* res = (byte*)dest;
+    uint remain = size;
+    while (remain > 0)
+    {
+        ssize_t count = getrandom(res, remain, 0);
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        res += count;
+        remain -= (uint)count;
+    }
+    return true;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+//	SipHash-2-4
+//////////////////////////////////////////////////////////////////////////
+#define sx_rotl(x, b)   (ulong)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define sx_sipround(v0, v1, v2, v3)     \
+    v0 += v1; v1 = sx_rotl(v1, 13);     \
+    v1 ^= v0; v0 = sx_rotl(v0, 32);     \
+    v2 += v3; v3 = sx_rotl(v3, 16);     \
+    v3 ^= v2;                           \
+    v0 += v3; v3 = sx_rotl(v3, 21);     \
+    v3 ^= v0;                           \
+    v2 += v1; v1 = sx_rotl(v1, 17);     \
+    v1 ^= v2; v2 = sx_rotl(v2, 32);
+
+static ulong sx_read_ulong(const byte* p)
+{
+    return (ulong)p[0] | ((ulong)p[1] << 8) | ((ulong)p[2] << 16) | ((ulong)p[3] << 24) |
+        ((ulong)p[4] << 32) | ((ulong)p[5] << 40) | ((ulong)p[6] << 48) | ((ulong)p[7] << 56);
+}
+
+SEGAN_LIB_API ulong sx_siphash(const byte* key, const void* data, const uint size)
+{
+    const byte* src = (const byte*)data;
+    ulong k0 = sx_read_ulong(key);
+    ulong k1 = sx_read_ulong(key + 8);
+    ulong v0 = 0x736f6d6570736575ULL ^ k0;
+    ulong v1 = 0x646f72616e646f6dULL ^ k1;
+    ulong v2 = 0x6c7967656e657261ULL ^ k0;
+    ulong v3 = 0x7465646279746573ULL ^ k1;
+
+    const byte* end = src + (size & ~7u);
+    for (; src != end; src += 8)
+    {
+        ulong m = sx_read_ulong(src);
+        v3 ^= m;
+        sx_sipround(v0, v1, v2, v3);
+        sx_sipround(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    ulong b = (ulong)size << 56;
+    switch (size & 7)
+    {
+    case 7: b |= (ulong)src[6] << 48;
+    case 6: b |= (ulong)src[5] << 40;
+    case 5: b |= (ulong)src[4] << 32;
+    case 4: b |= (ulong)src[3] << 24;
+    case 3: b |= (ulong)src[2] << 16;
+    case 2: b |= (ulong)src[1] << 8;
+    case 1: b |= (ulong)src[0];
+    }
+
+    v3 ^= b;
+    sx_sipround(v0, v1, v2, v3);
+    sx_sipround(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    sx_sipround(v0, v1, v2, v3);
+    sx_sipround(v0, v1, v2, v3);
+    sx_sipround(v0, v1, v2, v3);
+    sx_sipround(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//	ChaCha20
+//////////////////////////////////////////////////////////////////////////
+#define sx_rotl32(x, b)     (uint32_t)(((x) << (b)) | ((x) >> (32 - (b))))
+
+#define sx_quarterround(a, b, c, d)                     \
+    a += b; d ^= a; d = sx_rotl32(d, 16);               \
+    c += d; b ^= c; b = sx_rotl32(b, 12);               \
+    a += b; d ^= a; d = sx_rotl32(d, 8);                \
+    c += d; b ^= c; b = sx_rotl32(b, 7);
+
+static uint32_t sx_read_uint(const byte* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void sx_write_uint(byte* p, const uint32_t v)
+{
+    p[0] = (byte)v; p[1] = (byte)(v >> 8); p[2] = (byte)(v >> 16); p[3] = (byte)(v >> 24);
+}
+
+static void sx_chacha20_init(uint32_t* state, const byte* key, const uint32_t counter, const byte* nonce)
+{
+    state[0] = 0x61707865; state[1] = 0x3320646e; state[2] = 0x79622d32; state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++)
+        state[4 + i] = sx_read_uint(key + i * 4);
+    state[12] = counter;
+    state[13] = sx_read_uint(nonce);
+    state[14] = sx_read_uint(nonce + 4);
+    state[15] = sx_read_uint(nonce + 8);
+}
+
+static void sx_chacha20_rounds(uint32_t* x)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        sx_quarterround(x[0], x[4], x[8], x[12]);
+        sx_quarterround(x[1], x[5], x[9], x[13]);
+        sx_quarterround(x[2], x[6], x[10], x[14]);
+        sx_quarterround(x[3], x[7], x[11], x[15]);
+        sx_quarterround(x[0], x[5], x[10], x[15]);
+        sx_quarterround(x[1], x[6], x[11], x[12]);
+        sx_quarterround(x[2], x[7], x[8], x[13]);
+        sx_quarterround(x[3], x[4], x[9], x[14]);
+    }
+}
+
+#if SX_CHACHA_SSE2
+#define sx_rotl128(x, b)    _mm_or_si128(_mm_slli_epi32(x, b), _mm_srli_epi32(x, 32 - (b)))
+#define sx_rotl128_16(x)    _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1)
+
+#define sx_quarterround128(a, b, c, d)                                          \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = sx_rotl128_16(d);     \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = sx_rotl128(b, 12);    \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = sx_rotl128(d, 8);     \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = sx_rotl128(b, 7);
+#endif
+
+#if SX_CHACHA_SSE2
+//! swap the rows and the columns of a 4x4 matrix of words
+static inline void sx_transpose128(__m128i* r)
+{
+    __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]), t1 = _mm_unpacklo_epi32(r[2], r[3]);
+    __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]), t3 = _mm_unpackhi_epi32(r[2], r[3]);
+    r[0] = _mm_unpacklo_epi64(t0, t1);
+    r[1] = _mm_unpackhi_epi64(t0, t1);
+    r[2] = _mm_unpacklo_epi64(t2, t3);
+    r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+//! each lane of the vectors holds a word of one state
+static void sx_chacha20_vectors(byte* dest, const __m128i* s)
+{
+    __m128i x[16];
+    for (int w = 0; w < 16; w++) x[w] = s[w];
+
+    for (int i = 0; i < 10; i++)
+    {
+        sx_quarterround128(x[0], x[4], x[8], x[12]);
+        sx_quarterround128(x[1], x[5], x[9], x[13]);
+        sx_quarterround128(x[2], x[6], x[10], x[14]);
+        sx_quarterround128(x[3], x[7], x[11], x[15]);
+        sx_quarterround128(x[0], x[5], x[10], x[15]);
+        sx_quarterround128(x[1], x[6], x[11], x[12]);
+        sx_quarterround128(x[2], x[7], x[8], x[13]);
+        sx_quarterround128(x[3], x[4], x[9], x[14]);
+    }
+
+    // transpose the words back to the blocks of the lanes. x86 stores the words in little endian order
+    for (int w = 0; w < 16; w += 4)
+    {
+        __m128i r[4] = {
+            _mm_add_epi32(x[w + 0], s[w + 0]), _mm_add_epi32(x[w + 1], s[w + 1]),
+            _mm_add_epi32(x[w + 2], s[w + 2]), _mm_add_epi32(x[w + 3], s[w + 3])
+        };
+        sx_transpose128(r);
+        for (int lane = 0; lane < SX_CHACHA_LANES; lane++)
+            _mm_storeu_si128((__m128i*)(dest + lane * 64 + w * 4), r[lane]);
+    }
+}
+#endif
+
+//! compute the blocks of the states side by side so the states may have different keys, nonces and counters
+static void sx_chacha20_lanes(byte* dest, const uint32_t* const* states)
+{
+#if SX_CHACHA_SSE2
+    __m128i s[16];
+    for (int w = 0; w < 16; w += 4)
+    {
+        for (int lane = 0; lane < SX_CHACHA_LANES; lane++)
+            s[w + lane] = _mm_loadu_si128((const __m128i*)(states[lane] + w));
+        sx_transpose128(s + w);
+    }
+    sx_chacha20_vectors(dest, s);
+#else
+    for (int lane = 0; lane < SX_CHACHA_LANES; lane++)
+    {
+        uint32_t x[16];
+        for (int i = 0; i < 16; i++) x[i] = states[lane][i];
+        sx_chacha20_rounds(x);
+        for (int i = 0; i < 16; i++)
+            sx_write_uint(dest + lane * 64 + i * 4, x[i] + states[lane][i]);
+    }
+#endif
+}
+
+//! compute the consecutive blocks of the state from its counter
+static void sx_chacha20_blocks(byte* dest, const uint32_t* state)
+{
+#if SX_CHACHA_SSE2
+    // the lanes differ only in the counter
+    __m128i s[16];
+    for (int w = 0; w < 16; w++)
+        s[w] = _mm_set1_epi32((int)state[w]);
+    s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+    sx_chacha20_vectors(dest, s);
+#else
+    uint32_t lanes[SX_CHACHA_LANES][16];
+    const uint32_t* states[SX_CHACHA_LANES];
+    for (int lane = 0; lane < SX_CHACHA_LANES; lane++)
+    {
+        for (int i = 0; i < 16; i++) lanes[lane][i] = state[i];
+        lanes[lane][12] += lane;
+        states[lane] = lanes[lane];
+    }
+    sx_chacha20_lanes(dest, states);
+#endif
+}
+
+static void sx_chacha20_xor(byte* dest, const byte* key, const uint32_t counter, const byte* nonce, const byte* src, const uint32_t size)
+{
+    uint32_t state[16];
+    byte block[64 * SX_CHACHA_LANES];
+    sx_chacha20_init(state, key, counter, nonce);
+    for (uint32_t offset = 0; offset < size; offset += sizeof(block))
+    {
+        sx_chacha20_blocks(block, state);
+        state[12] += SX_CHACHA_LANES;
+        uint32_t len = (size - offset < sizeof(block)) ? size - offset : sizeof(block);
+        for (uint32_t i = 0; i < len; i++)
+            dest[offset + i] = src[offset + i] ^ block[i];
+    }
+}
+
+SEGAN_LIB_API void sx_hchacha20(byte* dest, const byte* key, const byte* nonce)
+{
+    uint32_t x[16];
+    sx_chacha20_init(x, key, sx_read_uint(nonce), nonce + 4);
+    sx_chacha20_rounds(x);
+    for (int i = 0; i < 4; i++)
+    {
+        sx_write_uint(dest + i * 4, x[i]);
+        sx_write_uint(dest + 16 + i * 4, x[12 + i]);
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//	Poly1305 with 26 bit limbs
+//////////////////////////////////////////////////////////////////////////
+typedef struct sx_poly1305
+{
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+}
+sx_poly1305;
+
+static void sx_poly1305_init(sx_poly1305* st, const byte* key)
+{
+    st->r[0] = (sx_read_uint(key + 0)) & 0x3ffffff;
+    st->r[1] = (sx_read_uint(key + 3) >> 2) & 0x3ffff03;
+    st->r[2] = (sx_read_uint(key + 6) >> 4) & 0x3ffc0ff;
+    st->r[3] = (sx_read_uint(key + 9) >> 6) & 0x3f03fff;
+    st->r[4] = (sx_read_uint(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 5; i++) st->h[i] = 0;
+    for (int i = 0; i < 4; i++) st->pad[i] = sx_read_uint(key + 16 + i * 4);
+}
+
+//! process the data in 16 bytes blocks. the last block is padded with zeros as AEAD needs
+static void sx_poly1305_update(sx_poly1305* st, const byte* data, const uint32_t size)
+{
+    const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2], r3 = st->r[3], r4 = st->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+
+    for (uint32_t offset = 0; offset < size; offset += 16)
+    {
+        // only the last block is copied to be padded
+        byte block[16];
+        const byte* p = data + offset;
+        if (size - offset < 16)
+        {
+            for (uint32_t i = 0; i < 16; i++) block[i] = (offset + i < size) ? data[offset + i] : 0;
+            p = block;
+        }
+
+        h0 += (sx_read_uint(p + 0)) & 0x3ffffff;
+        h1 += (sx_read_uint(p + 3) >> 2) & 0x3ffffff;
+        h2 += (sx_read_uint(p + 6) >> 4) & 0x3ffffff;
+        h3 += (sx_read_uint(p + 9) >> 6) & 0x3ffffff;
+        h4 += (sx_read_uint(p + 12) >> 8) | (1 << 24);
+
+        ulong d0 = (ulong)h0 * r0 + (ulong)h1 * s4 + (ulong)h2 * s3 + (ulong)h3 * s2 + (ulong)h4 * s1;
+        ulong d1 = (ulong)h0 * r1 + (ulong)h1 * r0 + (ulong)h2 * s4 + (ulong)h3 * s3 + (ulong)h4 * s2;
+        ulong d2 = (ulong)h0 * r2 + (ulong)h1 * r1 + (ulong)h2 * r0 + (ulong)h3 * s4 + (ulong)h4 * s3;
+        ulong d3 = (ulong)h0 * r3 + (ulong)h1 * r2 + (ulong)h2 * r1 + (ulong)h3 * r0 + (ulong)h4 * s4;
+        ulong d4 = (ulong)h0 * r4 + (ulong)h1 * r3 + (ulong)h2 * r2 + (ulong)h3 * r1 + (ulong)h4 * r0;
+
+        uint32_t c;
+        c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+        d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+        d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+        d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+        d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+    }
+
+    st->h[0] = h0; st->h[1] = h1; st->h[2] = h2; st->h[3] = h3; st->h[4] = h4;
+}
+
+static void sx_poly1305_finish(sx_poly1305* st, byte* tag)
+{
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+    uint32_t c;
+
+    c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // compute h - p and select it if h >= p in constant time
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1 << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    ulong f;
+    f = (ulong)(h0 | (h1 << 26)) + st->pad[0];                     sx_write_uint(tag + 0, (uint32_t)f);
+    f = (ulong)((h1 >> 6) | (h2 << 20)) + st->pad[1] + (f >> 32);   sx_write_uint(tag + 4, (uint32_t)f);
+    f = (ulong)((h2 >> 12) | (h3 << 14)) + st->pad[2] + (f >> 32);  sx_write_uint(tag + 8, (uint32_t)f);
+    f = (ulong)((h3 >> 18) | (h4 << 8)) + st->pad[3] + (f >> 32);   sx_write_uint(tag + 12, (uint32_t)f);
+}
+
+static void sx_chacha20poly1305_tag(byte* tag, const byte* polykey, const byte* aad, const uint32_t aadsize, const byte* cipher, const uint32_t size)
+{
+    sx_poly1305 st;
+    sx_poly1305_init(&st, polykey);
+    sx_poly1305_update(&st, aad, aadsize);
+    sx_poly1305_update(&st, cipher, size);
+
+    byte lengths[16];
+    sx_write_uint(lengths + 0, aadsize);
+    sx_write_uint(lengths + 4, 0);
+    sx_write_uint(lengths + 8, size);
+    sx_write_uint(lengths + 12, 0);
+    sx_poly1305_update(&st, lengths, 16);
+    sx_poly1305_finish(&st, tag);
+}
+
+// the first pass gives the key of Poly1305 in block 0 and the key stream of the blocks of the data after it.
+// small packets need no other pass
+#define SX_CHACHA_HEAD      (64 * (SX_CHACHA_LANES - 1))
+
+SEGAN_LIB_API void sx_chacha20poly1305_seal(byte* dest, byte* tag, const byte* key, const byte* nonce, const byte* aad, const uint aadsize, const byte* src, const uint size)
+{
+    uint32_t state[16];
+    byte block[64 * SX_CHACHA_LANES];
+    sx_chacha20_init(state, key, 0, nonce);
+    sx_chacha20_blocks(block, state);
+
+    uint32_t head = size < SX_CHACHA_HEAD ? size : SX_CHACHA_HEAD;
+    for (uint32_t i = 0; i < head; i++)
+        dest[i] = src[i] ^ block[64 + i];
+    if (size > head)
+        sx_chacha20_xor(dest + head, key, SX_CHACHA_LANES, nonce, src + head, size - head);
+
+    sx_chacha20poly1305_tag(tag, block, aad, aadsize, dest, size);
+}
+
+SEGAN_LIB_API bool sx_chacha20poly1305_open(byte* dest, const byte* key, const byte* nonce, const byte* aad, const uint aadsize, const byte* src, const uint size, const byte* tag)
+{
+    uint32_t state[16];
+    byte block[64 * SX_CHACHA_LANES];
+    sx_chacha20_init(state, key, 0, nonce);
+    sx_chacha20_blocks(block, state);
+
+    byte computed[SX_POLY1305_TAG_LEN];
+    sx_chacha20poly1305_tag(computed, block, aad, aadsize, src, size);
+
+    byte diff = 0;
+    for (int i = 0; i < SX_POLY1305_TAG_LEN; i++)
+        diff |= computed[i] ^ tag[i];
+    if (diff != 0) return false;
+
+    uint32_t head = size < SX_CHACHA_HEAD ? size : SX_CHACHA_HEAD;
+    for (uint32_t i = 0; i < head; i++)
+        dest[i] = src[i] ^ block[64 + i];
+    if (size > head)
+        sx_chacha20_xor(dest + head, key, SX_CHACHA_LANES, nonce, src + head, size - head);
+    return true;
+}
+
+// the blocks of all items are numbered item by item and computed in groups of the lanes, so the
+// key of Poly1305 and the data of a small packet to several players take a single pass for every two of them
+SEGAN_LIB_API void sx_chacha20poly1305_seal_many(const sx_chacha20poly1305_item* items, const uint count, const byte* src, const uint size)
+{
+    const uint32_t blocks = 1 + (size + 63) / 64;
+    uint32_t states[SX_CHACHA_BATCH][16];
+    byte polykeys[SX_CHACHA_BATCH][32];
+
+    for (uint first = 0; first < count; first += SX_CHACHA_BATCH)
+    {
+        const uint n = (count - first < SX_CHACHA_BATCH) ? count - first : SX_CHACHA_BATCH;
+        for (uint i = 0; i < n; i++)
+            sx_chacha20_init(states[i], items[first + i].key, 0, items[first + i].nonce);
+
+        const uint32_t jobs = n * blocks;
+        for (uint32_t job = 0; job < jobs; job += SX_CHACHA_LANES)
+        {
+            // the lanes after the last job repeat it and are ignored
+            uint32_t lanes[SX_CHACHA_LANES][16];
+            const uint32_t* ptrs[SX_CHACHA_LANES];
+            for (uint32_t lane = 0; lane < SX_CHACHA_LANES; lane++)
+            {
+                uint32_t j = (job + lane < jobs) ? job + lane : jobs - 1;
+                for (int w = 0; w < 16; w++) lanes[lane][w] = states[j / blocks][w];
+                lanes[lane][12] = j % blocks;
+                ptrs[lane] = lanes[lane];
+            }
+
+            byte stream[64 * SX_CHACHA_LANES];
+            sx_chacha20_lanes(stream, ptrs);
+
+            for (uint32_t lane = 0; lane < SX_CHACHA_LANES && job + lane < jobs; lane++)
+            {
+                const uint32_t j = job + lane, block = j % blocks;
+                const byte* ks = stream + lane * 64;
+                if (block == 0)
+                {
+                    for (int i = 0; i < 32; i++) polykeys[j / blocks][i] = ks[i];
+                    continue;
+                }
+
+                byte* dest = items[first + j / blocks].dest;
+                const uint32_t offset = (block - 1) * 64;
+                const uint32_t len = (size - offset < 64) ? size - offset : 64;
+                for (uint32_t i = 0; i < len; i++)
+                    dest[offset + i] = src[offset + i] ^ ks[i];
+            }
+        }
+
+        for (uint i = 0; i < n; i++)
+        {
+            const sx_chacha20poly1305_item* item = &items[first + i];
+            sx_chacha20poly1305_tag(item->dest + size, polykeys[i], item->aad, item->aadsize, item->dest, size);
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//	X25519 with 16 bit limbs in 64 bit integers
+//////////////////////////////////////////////////////////////////////////
+typedef int64 sx_fe[16];
+
+static void sx_fe_carry(sx_fe o)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        o[i] += (int64)1 << 16;
+        int64 c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c << 16;
+    }
+}
+
+static void sx_fe_swap(sx_fe p, sx_fe q, const int b)
+{
+    int64 c = ~(b - 1);
+    for (int i = 0; i < 16; i++)
+    {
+        int64 t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void sx_fe_pack(byte* o, const sx_fe n)
+{
+    sx_fe m, t;
+    for (int i = 0; i < 16; i++) t[i] = n[i];
+    sx_fe_carry(t);
+    sx_fe_carry(t);
+    sx_fe_carry(t);
+    for (int j = 0; j < 2; j++)
+    {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++)
+        {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int b = (int)((m[15] >> 16) & 1);
+        m[14] &= 0xffff;
+        sx_fe_swap(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        o[2 * i] = (byte)(t[i] & 0xff);
+        o[2 * i + 1] = (byte)(t[i] >> 8);
+    }
+}
+
+static void sx_fe_unpack(sx_fe o, const byte* n)
+{
+    for (int i = 0; i < 16; i++)
+        o[i] = n[2 * i] + ((int64)n[2 * i + 1] << 8);
+    o[15] &= 0x7fff;
+}
+
+static void sx_fe_add(sx_fe o, const sx_fe a, const sx_fe b)
+{
+    for (int i = 0; i < 16; i++) o[i] = a[i] + b[i];
+}
+
+static void sx_fe_sub(sx_fe o, const sx_fe a, const sx_fe b)
+{
+    for (int i = 0; i < 16; i++) o[i] = a[i] - b[i];
+}
+
+static void sx_fe_mul(sx_fe o, const sx_fe a, const sx_fe b)
+{
+    int64 t[31] = { 0 };
+    for (int i = 0; i < 16; i++)
+        for (int j = 0; j < 16; j++)
+            t[i + j] += a[i] * b[j];
+    for (int i = 0; i < 15; i++)
+        t[i] += 38 * t[i + 16];
+    for (int i = 0; i < 16; i++) o[i] = t[i];
+    sx_fe_carry(o);
+    sx_fe_carry(o);
+}
+
+static void sx_fe_inverse(sx_fe o, const sx_fe i)
+{
+    sx_fe c;
+    for (int a = 0; a < 16; a++) c[a] = i[a];
+    for (int a = 253; a >= 0; a--)
+    {
+        sx_fe_mul(c, c, c);
+        if (a != 2 && a != 4) sx_fe_mul(c, c, i);
+    }
+    for (int a = 0; a < 16; a++) o[a] = c[a];
+}
+
+SEGAN_LIB_API void sx_x25519(byte* dest, const byte* scalar, const byte* point)
+{
+    static const sx_fe a24 = { 0xdb41, 1 };
+    byte z[32];
+    sx_fe x;
+    sx_fe a, b, c, d, e, f;
+
+    for (int i = 0; i < 31; i++) z[i] = scalar[i];
+    z[31] = (scalar[31] & 127) | 64;
+    z[0] &= 248;
+
+    sx_fe_unpack(x, point);
+    for (int i = 0; i < 16; i++)
+    {
+        b[i] = x[i];
+        d[i] = a[i] = c[i] = 0;
+    }
+    a[0] = d[0] = 1;
+
+    for (int i = 254; i >= 0; --i)
+    {
+        int r = (z[i >> 3] >> (i & 7)) & 1;
+        sx_fe_swap(a, b, r);
+        sx_fe_swap(c, d, r);
+        sx_fe_add(e, a, c);
+        sx_fe_sub(a, a, c);
+        sx_fe_add(c, b, d);
+        sx_fe_sub(b, b, d);
+        sx_fe_mul(d, e, e);
+        sx_fe_mul(f, a, a);
+        sx_fe_mul(a, c, a);
+        sx_fe_mul(c, b, e);
+        sx_fe_add(e, a, c);
+        sx_fe_sub(a, a, c);
+        sx_fe_mul(b, a, a);
+        sx_fe_sub(c, d, f);
+        sx_fe_mul(a, c, a24);
+        sx_fe_add(a, a, d);
+        sx_fe_mul(c, c, a);
+        sx_fe_mul(a, d, f);
+        sx_fe_mul(d, b, x);
+        sx_fe_mul(b, e, e);
+        sx_fe_swap(a, b, r);
+        sx_fe_swap(c, d, r);
+    }
+
+    sx_fe_inverse(c, c);
+    sx_fe_mul(a, a, c);
+    sx_fe_pack(dest, a);
+}
+
+SEGAN_LIB_API void sx_x25519_public(byte* dest, const byte* scalar)
+{
+    static const byte base[32] = { 9 };
+    sx_x25519(dest, scalar, base);
+}
@@ -0,0 +1,64 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	Crypto.h
+	Author:		agent
+	Desc:		This file contains functions to generate random keys and
+                authenticate packets with keyed hashes
+*********************************************************************/
+#ifndef DEFINED_CRYPTO
+#define DEFINED_CRYPTO
+
+#include "def.h"
+
+#define SX_SIPHASH_KEY_LEN      16
+#define SX_CHACHA_KEY_LEN       32
+#define SX_CHACHA_NONCE_LEN     12
+#define SX_POLY1305_TAG_LEN     16
+#define SX_X25519_KEY_LEN       32
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! fill the destination with random bytes from the operating system
+SEGAN_LIB_API bool sx_random(void* dest, const uint size);
+
+//! compute SipHash-2-4 of the data with a 128 bit key
+SEGAN_LIB_API ulong sx_siphash(const byte* key, const void* data, const uint size);
+
+//! encrypt the source to destination and compute the tag of the additional data and the cipher text (RFC 8439)
+//! source and destination can be the same
+SEGAN_LIB_API void sx_chacha20poly1305_seal(byte* dest, byte* tag, const byte* key, const byte* nonce, const byte* aad, const uint aadsize, const byte* src, const uint size);
+
+//! verify the tag and decrypt the source to destination. return false if the tag is invalid
+//! source and destination can be the same
+SEGAN_LIB_API bool sx_chacha20poly1305_open(byte* dest, const byte* key, const byte* nonce, const byte* aad, const uint aadsize, const byte* src, const uint size, const byte* tag);
+
+typedef struct sx_chacha20poly1305_item
+{
+    byte*       dest;           //  cipher text followed by the tag
+    const byte* key;
+    const byte* nonce;
+    const byte* aad;
+    uint        aadsize;
+}
+sx_chacha20poly1305_item;
+
+//! seal the same source for each item with its own key, nonce and additional data. the blocks of
+//! the items are computed side by side with SIMD. the source must not overlap the destinations
+SEGAN_LIB_API void sx_chacha20poly1305_seal_many(const sx_chacha20poly1305_item* items, const uint count, const byte* src, const uint size);
+
+//! derive a 256 bit key from a key and a 128 bit nonce
+SEGAN_LIB_API void sx_hchacha20(byte* dest, const byte* key, const byte* nonce);
+
+//! compute the shared point of a secret scalar and a public point on Curve25519 (RFC 7748)
+SEGAN_LIB_API void sx_x25519(byte* dest, const byte* scalar, const byte* point);
+
+//! compute the public key of a secret scalar
+SEGAN_LIB_API void sx_x25519_public(byte* dest, const byte* scalar);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // DEFINED_CRYPTO
@@ -16,8 +16,14 @@
 typedef signed char				sbyte;
 typedef unsigned char		    byte;
 typedef unsigned short		    ushort, wchar;
+#if defined(_WIN32)
 typedef signed long			    sint;
 typedef unsigned long		    uint, dword;
+#else
+// keep them 32 bits like on Windows so the packed structures have the same layout everywhere
+typedef signed int			    sint;
+typedef unsigned int		    uint, dword;
+#endif
 typedef long long			    int64;
 typedef unsigned long long		ulong, uint64;
 typedef void*                   handle;
@@ -105,7 +111,28 @@ typedef unsigned char bool;
 
 #define SEGANX_TRACE_CALLSTACK              1
 
-#define SEGANX_TRACE_PROFILER               0
+//  the diagnostic tools below cost the hot path even while they are disabled at runtime so release builds
+//  compile them out. enable one for a diagnostic build by the compiler, like
+//  cmake -DCMAKE_C_FLAGS="-DSEGANX_TRACE_PROFILER=1 -DSEGANX_TRACE_SAMPLER=1"
+#ifndef SEGANX_TRACE_PROFILER
+#define SEGANX_TRACE_PROFILER               0       //  aggregate the time of sx_trace functions while it is enabled at runtime
+#endif
+
+#ifndef SEGANX_TRACE_MUTEX
+#define SEGANX_TRACE_MUTEX                  0       //  record waits and holds of sx_mutex by call site while it is enabled at runtime
+#endif
+
+#ifndef SEGANX_TRACE_SAMPLER
+#define SEGANX_TRACE_SAMPLER                0       //  sampling profiler of SIGPROF which is started at runtime, only on linux
+#endif
+
+#ifndef SEGANX_TRACE_RECORDER
+#define SEGANX_TRACE_RECORDER               0       //  ring of the last packets and events of each thread which is printed in the crash reports
+#endif
+
+//  highest trace level of each subsystem. sx_trace_at and sx_record_event_at calls above the level compile to nothing
+#define SEGANX_TRACE_NET                    SX_TRACE_CONTROL
+#define SEGANX_TRACE_ROOM                   SX_TRACE_CONTROL
 
 
 #define SEGAN_LIB_MULTI_THREADED			0		//	enable core library multi-threaded safe 
@@ -178,5 +205,19 @@ typedef unsigned char bool;
 #include <stdlib.h>
 #include <math.h>
 
+//! map the secure functions of MSVC runtime to the standard ones on other platforms
+#if !defined(_WIN32)
+#include <string.h>
+#include <time.h>
+#define _TRUNCATE                                   ((size_t)-1)
+#define fopen_s(pfile, name, mode)                  ((*(pfile) = fopen(name, mode)) == NULL)
+#define fread_s(dest, destsize, size, count, file)  fread(dest, size, count, file)
+#define localtime_s(dest, timer)                    localtime_r((const time_t*)(timer), dest)
+#define _snprintf_s(dest, size, count, fmt, ...)    snprintf(dest, size, fmt, ##__VA_ARGS__)
+#define vsnprintf_s(dest, size, count, fmt, args)   vsnprintf(dest, size, fmt, args)
+#define strcpy_s(dest, size, src)                   (snprintf(dest, size, "%s", src), 0)   //  always terminated unlike strncpy
+#define sscanf_s                                    sscanf  //  only valid for formats without strings
+#endif
+
 
 #endif	//	DEFINED_def
@@ -0,0 +1,115 @@
+#include "histogram.h"
+#include "memory.h"
+
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+
+static uint histogram_msb(const ulong value)
+{
+#if defined(_WIN32)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, value);
+    return (uint)index;
+#else
+    return 63 - (uint)__builtin_clzll(value);
+#endif
+}
+
+// small values map to themselves. larger ones keep their top bits so the bucket width grows with the value
+static uint histogram_index(const ulong value)
+{
+    if (value < 2 * SX_HISTOGRAM_HALF) return (uint)value;
+    uint shift = histogram_msb(value) - (SX_HISTOGRAM_BITS - 1);
+    return shift * SX_HISTOGRAM_HALF + (uint)(value >> shift);
+}
+
+// return the highest value which falls in the bucket
+static ulong histogram_value(const uint index)
+{
+    if (index < 2 * SX_HISTOGRAM_HALF) return index;
+    uint shift = index / SX_HISTOGRAM_HALF - 1;
+    ulong mantissa = index - shift * SX_HISTOGRAM_HALF;
+    return (mantissa << shift) + ((1ull << shift) - 1);
+}
+
+SEGAN_LIB_API void sx_histogram_reset(sx_histogram* histogram)
+{
+    sx_mem_set(histogram, 0, sizeof(sx_histogram));
+    histogram->min = (ulong)-1;
+}
+
+SEGAN_LIB_API void sx_histogram_record(sx_histogram* histogram, const ulong value)
+{
+    histogram->buckets[histogram_index(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+SEGAN_LIB_API void sx_histogram_merge(sx_histogram* dest, const sx_histogram* src)
+{
+    if (src->count < 1) return;
+    for (uint i = 0; i < SX_HISTOGRAM_BUCKETS; i++)
+        dest->buckets[i] += src->buckets[i];
+    dest->count += src->count;
+    dest->sum += src->sum;
+    if (src->min < dest->min) dest->min = src->min;
+    if (src->max > dest->max) dest->max = src->max;
+}
+
+SEGAN_LIB_API ulong sx_histogram_percentile(const sx_histogram* histogram, const double percentile)
+{
+    if (histogram->count < 1) return 0;
+    if (percentile >= 100) return histogram->max;
+
+    ulong target = (ulong)(percentile * histogram->count / 100 + 0.5);
+    if (target < 1) target = 1;
+
+    ulong total = 0;
+    for (uint i = 0; i < SX_HISTOGRAM_BUCKETS; i++)
+    {
+        total += histogram->buckets[i];
+        if (total >= target)
+        {
+            ulong value = histogram_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+SEGAN_LIB_API double sx_histogram_mean(const sx_histogram* histogram)
+{
+    return histogram->count > 0 ? (double)histogram->sum / histogram->count : 0;
+}
+
+SEGAN_LIB_API void sx_histogram_write(const sx_histogram* histogram, FILE* file, const double scale)
+{
+    fprintf(file, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    // five steps in each half of the remaining distance to 100 percent like the tools of HdrHistogram
+    double percentile = 0, step = 10;
+    while (histogram->count > 0)
+    {
+        ulong value = sx_histogram_percentile(histogram, percentile);
+        ulong total = 0;
+        for (uint i = 0, last = histogram_index(value); i <= last; i++)
+            total += histogram->buckets[i];
+
+        double fraction = percentile / 100;
+        if (total >= histogram->count || fraction >= 1)
+        {
+            fprintf(file, "%12.3f %14.12f %10llu\n", histogram->max / scale, 1.0, histogram->count);
+            break;
+        }
+        fprintf(file, "%12.3f %14.12f %10llu %14.2f\n", value / scale, fraction, total, 1 / (1 - fraction));
+
+        percentile += step;
+        if (percentile >= 100 - step * 5 + 1e-9) step /= 2;
+    }
+
+    fprintf(file, "#[Mean    = %12.3f, Total count = %12llu]\n", sx_histogram_mean(histogram) / scale, histogram->count);
+    fprintf(file, "#[Max     = %12.3f, Min         = %12.3f]\n", histogram->max / scale, histogram->count ? histogram->min / scale : 0.0);
+}
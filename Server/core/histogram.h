@@ -0,0 +1,58 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	Histogram.h
+	Author:		agent
+	Desc:		This file contains a log-linear histogram in the manner of
+                HdrHistogram to record latencies of any range in a fixed
+                memory with a bounded relative error
+
+                NOTE: the histogram is not thread safe. each thread should
+                record to its own histogram and merge them at the end
+*********************************************************************/
+#ifndef DEFINED_HISTOGRAM
+#define DEFINED_HISTOGRAM
+
+#include "def.h"
+#include <stdio.h>
+
+#define SX_HISTOGRAM_BITS       8   //  each power of two is split to 128 buckets so the error is less than 1%
+#define SX_HISTOGRAM_HALF       (1 << (SX_HISTOGRAM_BITS - 1))
+#define SX_HISTOGRAM_BUCKETS    ((66 - SX_HISTOGRAM_BITS) * SX_HISTOGRAM_HALF)
+
+typedef struct sx_histogram
+{
+    ulong count;
+    ulong min;
+    ulong max;
+    ulong sum;
+    ulong buckets[SX_HISTOGRAM_BUCKETS];
+}
+sx_histogram;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! clear all recorded values
+SEGAN_LIB_API void sx_histogram_reset(sx_histogram* histogram);
+
+//! record a value. values of the same bucket are not distinguished later
+SEGAN_LIB_API void sx_histogram_record(sx_histogram* histogram, const ulong value);
+
+//! add all values of the source to the destination
+SEGAN_LIB_API void sx_histogram_merge(sx_histogram* dest, const sx_histogram* src);
+
+//! return the highest value which percentile of all values are less or equal to it. percentile is in range of [0, 100]
+SEGAN_LIB_API ulong sx_histogram_percentile(const sx_histogram* histogram, const double percentile);
+
+//! return the average of recorded values
+SEGAN_LIB_API double sx_histogram_mean(const sx_histogram* histogram);
+
+//! write the percentile distribution in the format of HdrHistogram to plot it by its tools. values are divided by scale
+SEGAN_LIB_API void sx_histogram_write(const sx_histogram* histogram, FILE* file, const double scale);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // DEFINED_HISTOGRAM
@@ -0,0 +1,442 @@
+#include "log.h"
+#include "timer.h"
+#include "platform.h"
+#include <stdarg.h>
+#include <string.h>
+
+#define SX_LOG_DATA_LEN     (SX_LOG_ENTRY_SIZE - 2 * sizeof(ulong) - sizeof(const char*))
+
+enum
+{
+    SX_LOG_ARG_NONE = 0,
+    SX_LOG_ARG_INT,
+    SX_LOG_ARG_LONG,
+    SX_LOG_ARG_LLONG,
+    SX_LOG_ARG_SIZE,
+    SX_LOG_ARG_CHAR,
+    SX_LOG_ARG_DOUBLE,
+    SX_LOG_ARG_LDOUBLE,
+    SX_LOG_ARG_STRING,
+    SX_LOG_ARG_POINTER
+};
+
+// a slot of the ring which is free for the producer of position p while seq == p and ready for
+// the consumer while seq == p + 1. the consumer frees it for the next round by seq = p + SX_LOG_ENTRIES
+typedef struct sx_log_entry
+{
+    volatile ulong  seq;
+    const char*     format;
+    uint            size;                   //  bytes of the data
+    uint            suppressed;
+    byte            data[SX_LOG_DATA_LEN];  //  arguments in the order of the format
+}
+sx_log_entry;
+
+// a conversion of the format
+typedef struct sx_log_spec
+{
+    const char*     end;            //  first character after the conversion
+    char            text[32];       //  flags, width and precision without the length modifier
+    sint            precision;      //  digits of the precision or -1
+    bool            precision_star;
+    byte            kind;
+    bool            is_signed;
+    char            conversion;
+}
+sx_log_spec;
+
+typedef struct sx_log
+{
+    volatile ulong          head;           //  next position of the producers
+    byte                    pad[64];        //  keep the producers away from the cache line of the consumer
+    ulong                   tail;           //  next position of the consumer
+    volatile ulong          dropped;
+    volatile ulong          running;
+    volatile ulong          writers;        //  producers which may still publish into the ring
+    sx_log_entry*           entries;
+    FILE*                   file;
+    struct sx_thread*       thread;
+    struct sx_semaphore*    stopped;
+}
+sx_log;
+
+static sx_log s_log = { 0 };
+
+// parse the conversion which starts after the percent sign
+static void sx_log_parse(const char* c, sx_log_spec* spec)
+{
+    uint len = 0, longs = 0;
+    bool size = false, ldouble = false;
+    const uint max_len = sizeof(spec->text) - 1;
+
+    spec->precision = -1;
+    spec->precision_star = false;
+
+    while (*c && strchr("-+ #0", *c) && len < max_len)
+        spec->text[len++] = *c++;
+
+    if (*c == '*')
+        spec->text[len++] = *c++;
+    else while (*c >= '0' && *c <= '9' && len < max_len)
+        spec->text[len++] = *c++;
+
+    if (*c == '.' && len < max_len)
+    {
+        spec->text[len++] = *c++;
+        if (*c == '*')
+        {
+            spec->precision_star = true;
+            spec->text[len++] = *c++;
+        }
+        else
+        {
+            spec->precision = 0;
+            while (*c >= '0' && *c <= '9' && len < max_len)
+            {
+                spec->precision = spec->precision * 10 + (*c - '0');
+                spec->text[len++] = *c++;
+            }
+        }
+    }
+    spec->text[len] = 0;
+
+    for (bool length = true; length; )
+    {
+        switch (*c)
+        {
+        case 'h': c++; break;
+        case 'l': c++; longs++; break;
+        case 'z': case 'j': case 't': c++; size = true; break;
+        case 'L': c++; ldouble = true; break;
+        default: length = false;
+        }
+    }
+
+    spec->conversion = *c;
+    spec->is_signed = (*c == 'd' || *c == 'i');
+    switch (*c)
+    {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        spec->kind = size ? SX_LOG_ARG_SIZE : (longs > 1 ? SX_LOG_ARG_LLONG : (longs > 0 ? SX_LOG_ARG_LONG : SX_LOG_ARG_INT));
+        break;
+    case 'c': spec->kind = SX_LOG_ARG_CHAR; break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->kind = ldouble ? SX_LOG_ARG_LDOUBLE : SX_LOG_ARG_DOUBLE;
+        break;
+    case 's': spec->kind = SX_LOG_ARG_STRING; break;
+    case 'p': spec->kind = SX_LOG_ARG_POINTER; break;
+    default: spec->kind = SX_LOG_ARG_NONE;
+    }
+
+    spec->end = *c ? c + 1 : c;
+}
+
+// copy the arguments into the data and return the size of them. the arguments which do not fit are skipped
+static uint sx_log_encode(byte* const buffer, const char* format, va_list args)
+{
+    byte* data = buffer;
+    byte* end = buffer + SX_LOG_DATA_LEN;
+    sx_log_spec spec;
+    for (const char* c = format; *c; )
+    {
+        if (*c++ != '%') continue;
+        sx_log_parse(c, &spec);
+        c = spec.end;
+
+        sint star = -1;
+        for (const char* t = spec.text; *t; t++)
+        {
+            if (*t != '*') continue;
+            if (end - data < (sint)sizeof(ulong)) return (uint)(data - buffer);
+            star = va_arg(args, int);
+            long long value = star;
+            memcpy(data, &value, sizeof(value));
+            data += sizeof(value);
+        }
+
+        if (spec.kind == SX_LOG_ARG_STRING)
+        {
+            const char* str = va_arg(args, const char*);
+            if (str == null) str = "(null)";
+            if (end - data < 1) return (uint)(data - buffer);
+
+            size_t len = end - data - 1;
+            sint precision = spec.precision_star ? star : spec.precision;
+            if (precision >= 0 && (size_t)precision < len) len = precision;
+            const char* zero = (const char*)memchr(str, 0, len);
+            if (zero != null) len = zero - str;
+
+            memcpy(data, str, len);
+            data[len] = 0;
+            data += len + 1;
+            continue;
+        }
+
+        if (spec.kind == SX_LOG_ARG_NONE) continue;
+        if (end - data < (sint)sizeof(ulong)) return (uint)(data - buffer);
+
+        union { long long i; double d; } value;
+        switch (spec.kind)
+        {
+        case SX_LOG_ARG_INT: value.i = spec.is_signed ? (long long)va_arg(args, int) : (long long)va_arg(args, unsigned int); break;
+        case SX_LOG_ARG_LONG: value.i = spec.is_signed ? (long long)va_arg(args, long) : (long long)va_arg(args, unsigned long); break;
+        case SX_LOG_ARG_LLONG: value.i = va_arg(args, long long); break;
+        case SX_LOG_ARG_SIZE: value.i = (long long)va_arg(args, size_t); break;
+        case SX_LOG_ARG_CHAR: value.i = va_arg(args, int); break;
+        case SX_LOG_ARG_DOUBLE: value.d = va_arg(args, double); break;
+        case SX_LOG_ARG_LDOUBLE: value.d = (double)va_arg(args, long double); break;
+        case SX_LOG_ARG_POINTER: value.i = (long long)(size_t)va_arg(args, void*); break;
+        }
+        memcpy(data, &value, sizeof(value));
+        data += sizeof(value);
+    }
+    return (uint)(data - buffer);
+}
+
+// format the entry to the file. conversions which have no data left are written as they are
+static void sx_log_decode(FILE* file, const sx_log_entry* entry)
+{
+    const byte* data = entry->data;
+    const byte* end = entry->data + entry->size;
+    sx_log_spec spec;
+    const char* c = entry->format;
+    while (*c)
+    {
+        const char* start = c;
+        while (*c && *c != '%') c++;
+        if (c > start) fwrite(start, 1, c - start, file);
+        if (*c == 0) break;
+
+        start = c++;
+        sx_log_parse(c, &spec);
+        c = spec.end;
+
+        if (spec.conversion == '%')
+        {
+            fputc('%', file);
+            continue;
+        }
+
+        // build the conversion again with the values of the stars and the length of the stored value
+        char conversion[64] = "%";
+        uint len = 1;
+        bool missing = false;
+        for (const char* t = spec.text; *t; t++)
+        {
+            if (*t != '*')
+            {
+                conversion[len++] = *t;
+                continue;
+            }
+            if (end - data < (sint)sizeof(ulong))
+            {
+                missing = true;
+                break;
+            }
+            long long star;
+            memcpy(&star, data, sizeof(star));
+            data += sizeof(star);
+            if (star < 0 && len > 1 && conversion[len - 1] == '.')
+                len--;
+            else
+                len += snprintf(conversion + len, sizeof(conversion) - len - 4, "%d", (int)star);
+        }
+
+        if (missing || spec.kind == SX_LOG_ARG_NONE || end - data < (spec.kind == SX_LOG_ARG_STRING ? 1 : (sint)sizeof(ulong)))
+        {
+            fwrite(start, 1, c - start, file);
+            continue;
+        }
+
+        if (spec.kind != SX_LOG_ARG_STRING && spec.kind != SX_LOG_ARG_CHAR && spec.kind != SX_LOG_ARG_POINTER &&
+            spec.kind != SX_LOG_ARG_DOUBLE && spec.kind != SX_LOG_ARG_LDOUBLE)
+        {
+            conversion[len++] = 'l';
+            conversion[len++] = 'l';
+        }
+        conversion[len++] = spec.conversion;
+        conversion[len] = 0;
+
+        if (spec.kind == SX_LOG_ARG_STRING)
+        {
+            const char* str = (const char*)data;
+            fprintf(file, conversion, str);
+            data += strlen(str) + 1;
+            continue;
+        }
+
+        union { long long i; double d; } value;
+        memcpy(&value, data, sizeof(value));
+        data += sizeof(value);
+        switch (spec.kind)
+        {
+        case SX_LOG_ARG_CHAR: fprintf(file, conversion, (int)value.i); break;
+        case SX_LOG_ARG_DOUBLE:
+        case SX_LOG_ARG_LDOUBLE: fprintf(file, conversion, value.d); break;
+        case SX_LOG_ARG_POINTER: fprintf(file, conversion, (void*)(size_t)value.i); break;
+        default: fprintf(file, conversion, value.i);
+        }
+    }
+}
+
+// write the ready entries and return the number of them
+static uint sx_log_flush(void)
+{
+    uint res = 0;
+    for (;;)
+    {
+        sx_log_entry* entry = &s_log.entries[s_log.tail & (SX_LOG_ENTRIES - 1)];
+        if (sx_atomic_load64(&entry->seq) != s_log.tail + 1) break;
+
+        sx_log_decode(s_log.file, entry);
+        if (entry->suppressed > 0)
+            fprintf(s_log.file, "Warning: %u similar messages were suppressed\n", entry->suppressed);
+
+        sx_atomic_store64(&entry->seq, s_log.tail + SX_LOG_ENTRIES);
+        s_log.tail++;
+        res++;
+    }
+    return res;
+}
+
+static void sx_log_thread(void* param)
+{
+    ulong dropped = 0;
+    for (;;)
+    {
+        bool running = sx_atomic_load64(&s_log.running) != 0;
+        uint count = sx_log_flush();
+
+        ulong dropped_now = sx_atomic_load64(&s_log.dropped);
+        if (dropped_now != dropped)
+        {
+            fprintf(s_log.file, "Warning: %llu log messages were dropped because the ring was full\n", dropped_now - dropped);
+            dropped = dropped_now;
+        }
+
+        // after the stop the ring is drained until no producer can publish into it anymore
+        if (count > 0)
+            fflush(s_log.file);
+        else if (running)
+            sx_sleep(5);
+        else if (sx_atomic_load64(&s_log.writers) == 0 && sx_atomic_load64(&s_log.head) == s_log.tail)
+            break;
+    }
+    sx_semaphore_post(s_log.stopped);
+}
+
+// take the state of the site and return false if the message must be dropped
+static bool sx_log_site_pass(sx_log_site* site, ulong* suppressed)
+{
+    ulong now = sx_time_cached();
+    ulong last = sx_atomic_load64(&site->time);
+    if ((last > 0 && now - last < site->interval) || sx_atomic_cas64(&site->time, last, now) == false)
+    {
+        sx_atomic_inc64(&site->suppressed);
+        return false;
+    }
+
+    do *suppressed = sx_atomic_load64(&site->suppressed);
+    while (sx_atomic_cas64(&site->suppressed, *suppressed, 0) == false);
+    return true;
+}
+
+SEGAN_LIB_API bool sx_log_initialize(FILE* file)
+{
+    if (sx_atomic_load64(&s_log.running)) return true;
+
+    // the ring is never released because the other threads may still be writing into it at exit
+    if (s_log.entries == null)
+    {
+        s_log.entries = (sx_log_entry*)calloc(SX_LOG_ENTRIES, sizeof(sx_log_entry));
+        if (s_log.entries == null)
+        {
+            sx_print("Error: Can't allocate memory for log!");
+            return false;
+        }
+    }
+    for (ulong i = 0; i < SX_LOG_ENTRIES; i++)
+        s_log.entries[i].seq = i;
+
+    s_log.head = s_log.tail = 0;
+    s_log.file = file;
+    s_log.stopped = sx_semaphore_create(0, 1);
+    sx_atomic_store64(&s_log.running, 1);
+
+    s_log.thread = sx_thread_create(0, sx_log_thread, null);
+    if (s_log.thread == null)
+    {
+        sx_atomic_store64(&s_log.running, 0);
+        sx_semaphore_destroy(s_log.stopped);
+        return false;
+    }
+    return true;
+}
+
+SEGAN_LIB_API void sx_log_finalize(void)
+{
+    if (sx_atomic_load64(&s_log.running) == 0) return;
+
+    // the producers print synchronously from now
+    sx_atomic_store64(&s_log.running, 0);
+    sx_semaphore_wait(s_log.stopped);
+    sx_semaphore_destroy(s_log.stopped);
+    sx_thread_destroy(s_log.thread);
+    s_log.thread = null;
+}
+
+SEGAN_LIB_API void sx_log_write(sx_log_site* site, const char* format, ...)
+{
+    ulong suppressed = 0;
+    if (site != null && sx_log_site_pass(site, &suppressed) == false) return;
+
+    va_list args;
+    va_start(args, format);
+
+    // the writer is counted before the check so the consumer waits for it if it sees the ring running
+    sx_log_entry* entry = null;
+    sx_atomic_inc64(&s_log.writers);
+    if (sx_atomic_load64(&s_log.running))
+    {
+        ulong pos = sx_atomic_load64(&s_log.head);
+        for (;;)
+        {
+            entry = &s_log.entries[pos & (SX_LOG_ENTRIES - 1)];
+            ulong seq = sx_atomic_load64(&entry->seq);
+            if (seq == pos)
+            {
+                if (sx_atomic_cas64(&s_log.head, pos, pos + 1)) break;
+                pos = sx_atomic_load64(&s_log.head);
+            }
+            else if (seq < pos)
+            {
+                // the consumer has not freed the slot of the previous round yet
+                sx_atomic_inc64(&s_log.dropped);
+                sx_atomic_dec64(&s_log.writers);
+                va_end(args);
+                return;
+            }
+            else pos = sx_atomic_load64(&s_log.head);
+        }
+
+        entry->format = format;
+        entry->suppressed = (uint)suppressed;
+        entry->size = sx_log_encode(entry->data, format, args);
+        sx_atomic_store64(&entry->seq, pos + 1);
+        sx_atomic_dec64(&s_log.writers);
+    }
+    else
+    {
+        sx_atomic_dec64(&s_log.writers);
+        vprintf(format, args);
+        if (suppressed > 0)
+            printf("Warning: %llu similar messages were suppressed\n", suppressed);
+    }
+
+    va_end(args);
+}
+
+SEGAN_LIB_API ulong sx_log_dropped(void)
+{
+    return sx_atomic_load64(&s_log.dropped);
+}
@@ -0,0 +1,58 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	Log.h
+	Author:		agent
+	Desc:		This file contains an asynchronous logger. the callers copy
+                the format and the arguments into a lock free ring and a
+                background thread formats and writes them to the file
+*********************************************************************/
+#ifndef DEFINED_LOG
+#define DEFINED_LOG
+
+#include "def.h"
+#include <stdio.h>
+
+#define SX_LOG_ENTRIES      4096    //  must be a power of two
+#define SX_LOG_ENTRY_SIZE   256     //  arguments which do not fit in an entry are printed as their format
+
+//! state of a rate limited log site
+typedef struct sx_log_site
+{
+    ulong           interval;       //  milliseconds between two messages of the site
+    volatile ulong  time;           //  time of the last message
+    volatile ulong  suppressed;     //  messages dropped since the last one
+}
+sx_log_site;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*!
+start the thread which writes the messages to the file.
+NOTE: messages are printed synchronously to the stdout until the logger is initialized
+*/
+SEGAN_LIB_API bool sx_log_initialize(FILE* file);
+
+//! write the remaining messages and stop the thread
+SEGAN_LIB_API void sx_log_finalize(void);
+
+/*!
+copy the message into the ring without formatting it. strings are copied so they may be released after the call.
+NOTE: the message is dropped if the ring is full and the site drops the messages in its interval
+*/
+SEGAN_LIB_API void sx_log_write(sx_log_site* site, const char* format, ...);
+
+//! return the number of messages dropped because the ring was full
+SEGAN_LIB_API ulong sx_log_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#define sx_log(fmt, ...)                    sx_log_write(null, fmt"\n", ##__VA_ARGS__)
+
+//! log at most one message in each interval of milliseconds and count the others
+#define sx_log_every(interval, fmt, ...)    { static sx_log_site sx_log_site_ = { interval, 0, 0 }; sx_log_write(&sx_log_site_, fmt"\n", ##__VA_ARGS__); }
+
+#endif // DEFINED_LOG
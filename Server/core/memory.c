@@ -63,6 +63,11 @@ SEGAN_LIB_INLINE void mem_copy(void* dest, const void* src, const uint size)
     memcpy(dest, src, size);
 }
 
+SEGAN_LIB_INLINE void mem_move(void* dest, const void* src, const uint size)
+{
+    memmove(dest, src, size);
+}
+
 SEGAN_LIB_INLINE sint mem_cmp(const void* src1, const void* src2, const uint size)
 {
     return memcmp(src1, src2, size);
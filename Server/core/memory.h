@@ -20,6 +20,7 @@
 #define sx_mem_get_manager()            mem_get_manager()
 
 #define sx_mem_copy(dest, src, size)    mem_copy( dest, src, size )
+#define sx_mem_move(dest, src, size)    mem_move( dest, src, size )
 #define sx_mem_cmp(src1, src2, size)    mem_cmp( src1, src2, size )
 #define sx_mem_set(dest, val, size)     mem_set( dest, val, size )
 
@@ -58,6 +59,7 @@ SEGAN_LIB_API void* mem_alloc(const uint size_in_byte);
 SEGAN_LIB_API void* mem_realloc(void* p, const uint new_size_in_byte);
 SEGAN_LIB_API void* mem_free(const void* p);
 SEGAN_LIB_API void  mem_copy(void* dest, const void* src, const uint size);
+SEGAN_LIB_API void  mem_move(void* dest, const void* src, const uint size);
 SEGAN_LIB_API sint  mem_cmp(const void* src1, const void* src2, const uint size);
 SEGAN_LIB_API void  mem_set(void* dest, const sint val, const uint size);
 
@@ -7,8 +7,17 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <sys/select.h>
+#include <time.h>
+#include <errno.h>
 #endif
+
+#if defined(_WIN32)
 #include <conio.h>
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 //! mutex object
 typedef struct sx_mutex
@@ -165,7 +174,7 @@ SEGAN_LIB_API int sx_mutex_destroy(struct sx_mutex * mutex)
     return res;
 }
 
-SEGAN_LIB_API int sx_mutex_lock(struct sx_mutex * mutex)
+SEGAN_LIB_API int (sx_mutex_lock)(struct sx_mutex * mutex)
 {
 #if defined(_WIN32)
     return WaitForSingleObject(mutex->obj, INFINITE) == WAIT_OBJECT_0 ? 0 : -1;
@@ -174,7 +183,7 @@ SEGAN_LIB_API int sx_mutex_lock(struct sx_mutex * mutex)
 #endif
 }
 
-SEGAN_LIB_API int sx_mutex_unlock(struct sx_mutex * mutex)
+SEGAN_LIB_API int (sx_mutex_unlock)(struct sx_mutex * mutex)
 {
 #if defined(_WIN32)
     return ReleaseMutex(mutex->obj) == 0 ? -1 : 0;
@@ -645,29 +654,99 @@ SEGAN_LIB_API uint sx_threadpool_num_busy_threads(struct sx_threadpool * threadp
 }
 
 
+SEGAN_LIB_API unsigned long long sx_atomic_inc64(volatile unsigned long long* value)
+{
+#if defined(_WIN32)
+    return (unsigned long long)InterlockedIncrement64((volatile LONG64*)value);
+#else
+    return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+SEGAN_LIB_API unsigned long long sx_atomic_dec64(volatile unsigned long long* value)
+{
+#if defined(_WIN32)
+    return (unsigned long long)InterlockedDecrement64((volatile LONG64*)value);
+#else
+    return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+SEGAN_LIB_API unsigned long long sx_atomic_load64(volatile unsigned long long* value)
+{
+#if defined(_WIN32)
+    return (unsigned long long)InterlockedCompareExchange64((volatile LONG64*)value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+SEGAN_LIB_API void sx_atomic_store64(volatile unsigned long long* dest, const unsigned long long value)
+{
+#if defined(_WIN32)
+    InterlockedExchange64((volatile LONG64*)dest, (LONG64)value);
+#else
+    __atomic_store_n(dest, value, __ATOMIC_RELEASE);
+#endif
+}
+
+SEGAN_LIB_API int sx_atomic_cas64(volatile unsigned long long* value, const unsigned long long expected, const unsigned long long desired)
+{
+#if defined(_WIN32)
+    return InterlockedCompareExchange64((volatile LONG64*)value, (LONG64)desired, (LONG64)expected) == (LONG64)expected;
+#else
+    unsigned long long current = expected;
+    return __atomic_compare_exchange_n(value, &current, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
 SEGAN_LIB_API unsigned long long sx_get_tick()
 {
 #if defined(_WIN32)
     return GetTickCount64();
 #else
-    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 #endif    
 }
 
+SEGAN_LIB_API unsigned long long sx_get_cycles()
+{
+#if defined(_WIN32) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 SEGAN_LIB_API void sx_sleep(const uint miliseconds)
 {
 #if defined(_WIN32)
     Sleep(miliseconds);
 #else
-    usleep(miliseconds * 1000);
+    // signals like SIGPROF of the sampler interrupt the sleep so it continues with the remaining time
+    struct timespec ts = { miliseconds / 1000, (miliseconds % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
 #endif	
 }
 
 SEGAN_LIB_API char sx_getch()
 {
     char r = 0;
+#if defined(_WIN32)
     if (_kbhit())
         r = _getch();
+#else
+    struct timeval tv = { 0, 0 };
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(0, &fds);
+    if (select(1, &fds, null, null, &tv) > 0 && read(0, &r, 1) != 1)
+        r = 0;
+#endif
     return r;
 }
 
@@ -24,7 +24,11 @@ Desc:		This file contains some basic wrapper functions that are
 //	basic types
 //////////////////////////////////////////////////////////////////////////
 #ifndef uint
+#if defined(_WIN32)
 typedef unsigned long	uint;
+#else
+typedef unsigned int	uint;
+#endif
 #endif
 
 struct sx_mutex;
@@ -88,8 +92,9 @@ SEGAN_LIB_API int print(const char* filename, const int line, const char* format
 
 SEGAN_LIB_API struct sx_mutex * sx_mutex_create();
 SEGAN_LIB_API int sx_mutex_destroy(struct sx_mutex * mutex);
-SEGAN_LIB_API int sx_mutex_lock(struct sx_mutex * mutex);
-SEGAN_LIB_API int sx_mutex_unlock(struct sx_mutex * mutex);
+//! names are in parentheses so the lock profiler of trace.h can replace the calls but not the declarations
+SEGAN_LIB_API int (sx_mutex_lock)(struct sx_mutex * mutex);
+SEGAN_LIB_API int (sx_mutex_unlock)(struct sx_mutex * mutex);
 
 SEGAN_LIB_API struct sx_cond * sx_cond_create();
 SEGAN_LIB_API int sx_cond_destroy(struct sx_cond * cond);
@@ -113,7 +118,18 @@ SEGAN_LIB_API int sx_threadpool_add_job(struct sx_threadpool * threadpool, sx_th
 SEGAN_LIB_API uint sx_threadpool_num_jobs(struct sx_threadpool * threadpool);
 SEGAN_LIB_API uint sx_threadpool_num_busy_threads(struct sx_threadpool * threadpool);
 
+SEGAN_LIB_API unsigned long long sx_atomic_inc64(volatile unsigned long long* value);
+SEGAN_LIB_API unsigned long long sx_atomic_dec64(volatile unsigned long long* value);
+SEGAN_LIB_API unsigned long long sx_atomic_load64(volatile unsigned long long* value);
+SEGAN_LIB_API void sx_atomic_store64(volatile unsigned long long* dest, const unsigned long long value);
+
+//! replace the value by the desired one if it is equal to the expected one and return true on success
+SEGAN_LIB_API int sx_atomic_cas64(volatile unsigned long long* value, const unsigned long long expected, const unsigned long long desired);
+
 SEGAN_LIB_API unsigned long long sx_get_tick();
+
+//! return the time stamp counter of the cpu or nanoseconds where the counter is not available
+SEGAN_LIB_API unsigned long long sx_get_cycles();
 SEGAN_LIB_API void sx_sleep(const uint miliseconds);
 SEGAN_LIB_API char sx_getch();
 
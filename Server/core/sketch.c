@@ -0,0 +1,51 @@
+#include "sketch.h"
+#include "crypto.h"
+#include "platform.h"
+
+typedef struct sx_sketch
+{
+    byte key[SX_SIPHASH_KEY_LEN];
+    volatile ulong counters[SX_SKETCH_DEPTH][SX_SKETCH_WIDTH];
+}
+sx_sketch;
+
+SEGAN_LIB_API struct sx_sketch* sx_sketch_create(void)
+{
+    struct sx_sketch* res = (struct sx_sketch*)calloc(1, sizeof(struct sx_sketch));
+    if (res == null)
+    {
+        sx_print("Error: Can't allocate memory for sketch!");
+        return null;
+    }
+
+    if (sx_random(res->key, SX_SIPHASH_KEY_LEN) == false)
+        sx_print("Warning: Can't generate random key for sketch!");
+
+    return res;
+}
+
+SEGAN_LIB_API void sx_sketch_destroy(struct sx_sketch* sketch)
+{
+    if (!sketch) return;
+    free(sketch);
+}
+
+SEGAN_LIB_API ulong sx_sketch_add(struct sx_sketch* sketch, const void* key, const uint size)
+{
+    ulong hash = sx_siphash(sketch->key, key, size);
+    ulong res = (ulong)-1;
+    for (int d = 0; d < SX_SKETCH_DEPTH; d++)
+    {
+        uint index = (uint)(hash >> (d * 16)) & (SX_SKETCH_WIDTH - 1);
+        ulong count = sx_atomic_inc64(&sketch->counters[d][index]);
+        if (count < res) res = count;
+    }
+    return res;
+}
+
+SEGAN_LIB_API void sx_sketch_decay(struct sx_sketch* sketch)
+{
+    for (int d = 0; d < SX_SKETCH_DEPTH; d++)
+        for (int i = 0; i < SX_SKETCH_WIDTH; i++)
+            sketch->counters[d][i] >>= 1;
+}
@@ -0,0 +1,40 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	Sketch.h
+	Author:		agent
+	Desc:		This file contains a lock free count-min sketch to estimate
+                the frequency of keys in a fixed memory
+*********************************************************************/
+#ifndef DEFINED_SKETCH
+#define DEFINED_SKETCH
+
+#include "def.h"
+
+#define SX_SKETCH_DEPTH     4       //  each row uses 16 bits of a single 64 bit hash
+#define SX_SKETCH_WIDTH     4096    //  must be a power of two and not exceed 65536
+
+struct sx_sketch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! create a sketch with a random hash key so the collisions can not be predicted
+SEGAN_LIB_API struct sx_sketch* sx_sketch_create(void);
+
+SEGAN_LIB_API void sx_sketch_destroy(struct sx_sketch* sketch);
+
+//! count the key and return the estimated count of the key which is never less than the real one
+SEGAN_LIB_API ulong sx_sketch_add(struct sx_sketch* sketch, const void* key, const uint size);
+
+/*!
+halve all counters to forget the old keys.
+NOTE: keys which are counted at the same time may lose a few counts
+*/
+SEGAN_LIB_API void sx_sketch_decay(struct sx_sketch* sketch);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // DEFINED_SKETCH
@@ -1,21 +1,76 @@
 #include "timer.h"
 #include "platform.h"
 #include <time.h>
-#include <sys/timeb.h>
 
-SEGAN_LIB_API ulong sx_time_now()
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+static ulong s_time_start = 0;              //  monotonic clock at the first call
+static volatile ulong s_time_base = 0;      //  wall clock at the first call
+static volatile ulong s_time_cached = 0;
+
+static ulong sx_time_monotonic_ns()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (ulong)(counter.QuadPart / frequency.QuadPart * 1000000000 + counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ulong)ts.tv_sec * 1000000000 + (ulong)ts.tv_nsec;
+#endif
+}
+
+static ulong sx_time_wall_us()
 {
 #if defined(_WIN32) || defined(_WIN64)
-    struct _timeb timebuffer;
-    _ftime64_s(&timebuffer);
-    return (ulong)(((timebuffer.time * 1000) + timebuffer.millitm));
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ulong t = ((ulong)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (t - 116444736000000000ull) / 10;
 #else
-    struct timeb timebuffer;
-    ftime(&timebuffer);
-    return (ulong)(((timebuffer.time * 1000) + timebuffer.millitm));
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (ulong)ts.tv_sec * 1000000 + (ulong)ts.tv_nsec / 1000;
 #endif
 }
 
+SEGAN_LIB_API ulong sx_time_now_ns()
+{
+    if (s_time_base == 0)
+    {
+        s_time_start = sx_time_monotonic_ns();
+        s_time_base = sx_time_wall_us() * 1000;
+    }
+    return s_time_base + (sx_time_monotonic_ns() - s_time_start);
+}
+
+SEGAN_LIB_API ulong sx_time_now_us()
+{
+    return sx_time_now_ns() / 1000;
+}
+
+SEGAN_LIB_API ulong sx_time_now()
+{
+    return sx_time_now_us() / 1000;
+}
+
+SEGAN_LIB_API ulong sx_time_update()
+{
+    ulong now = sx_time_now();
+    s_time_cached = now;
+    return now;
+}
+
+SEGAN_LIB_API ulong sx_time_cached()
+{
+    return s_time_cached > 0 ? s_time_cached : sx_time_now();
+}
+
 SEGAN_LIB_API ulong sx_time_diff(const ulong endtime, const ulong starttime)
 {
     return endtime - starttime;// difftime(endtime, starttime);
@@ -28,3 +83,173 @@ SEGAN_LIB_API void sx_time_print(char* dest, const uint destsize, const ulong ti
     localtime_s(&timeInfo, &t);
     strftime(dest, destsize, "%Y-%m-%d %H:%M:%S", &timeInfo);
 }
+
+
+//////////////////////////////////////////////////////////////////////////
+//	hierarchical timer wheel
+//  each level contains SX_TIMER_WHEEL_SLOTS slots and covers the range of
+//  SX_TIMER_WHEEL_SLOTS times of the previous level. timers in upper levels
+//  will be cascaded down to the lower levels when the lower level wraps.
+//////////////////////////////////////////////////////////////////////////
+#define TIMER_WHEEL_MASK        (SX_TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_MAX_TICKS   ((1ull << (SX_TIMER_WHEEL_BITS * SX_TIMER_WHEEL_LEVELS)) - 1)
+
+typedef struct sx_timer_wheel
+{
+    ulong       tick;           //  next tick which will be processed
+    uint        resolution;     //  length of each tick in milliseconds
+    sx_timer    slots[SX_TIMER_WHEEL_LEVELS][SX_TIMER_WHEEL_SLOTS];
+}
+sx_timer_wheel;
+
+static void timer_list_init(sx_timer* head)
+{
+    head->next = head->prev = head;
+}
+
+static void timer_list_push(sx_timer* head, sx_timer* timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void timer_list_pop(sx_timer* timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = null;
+}
+
+static void timer_wheel_insert(sx_timer_wheel* wheel, sx_timer* timer)
+{
+    ulong expire = timer->expire / wheel->resolution;
+    if (expire < wheel->tick)
+        expire = wheel->tick;
+
+    ulong ticks = expire - wheel->tick;
+    if (ticks > TIMER_WHEEL_MAX_TICKS)
+    {
+        ticks = TIMER_WHEEL_MAX_TICKS;
+        expire = wheel->tick + ticks;
+    }
+
+    uint level = 0;
+    while (level < SX_TIMER_WHEEL_LEVELS - 1 && ticks >= (1ull << (SX_TIMER_WHEEL_BITS * (level + 1))))
+        level++;
+
+    uint slot = (uint)((expire >> (SX_TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    timer_list_push(&wheel->slots[level][slot], timer);
+}
+
+static void timer_wheel_cascade(sx_timer_wheel* wheel, const uint level)
+{
+    uint slot = (uint)((wheel->tick >> (SX_TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    sx_timer* head = &wheel->slots[level][slot];
+
+    // continue cascading when this level wraps too
+    if (slot == 0 && level + 1 < SX_TIMER_WHEEL_LEVELS)
+        timer_wheel_cascade(wheel, level + 1);
+
+    while (head->next != head)
+    {
+        sx_timer* timer = head->next;
+        timer_list_pop(timer);
+        timer_wheel_insert(wheel, timer);
+    }
+}
+
+SEGAN_LIB_API struct sx_timer_wheel* sx_timer_wheel_create(const ulong now, const uint resolution)
+{
+    struct sx_timer_wheel* res = (struct sx_timer_wheel*)malloc(sizeof(struct sx_timer_wheel));
+    if (res == null)
+    {
+        sx_print("Error: Can't allocate memory for timer wheel!");
+        return null;
+    }
+
+    res->resolution = resolution > 0 ? resolution : 1;
+    res->tick = now / res->resolution;
+    for (uint l = 0; l < SX_TIMER_WHEEL_LEVELS; l++)
+        for (uint s = 0; s < SX_TIMER_WHEEL_SLOTS; s++)
+            timer_list_init(&res->slots[l][s]);
+
+    return res;
+}
+
+SEGAN_LIB_API void sx_timer_wheel_destroy(struct sx_timer_wheel* wheel)
+{
+    if (!wheel) return;
+
+    for (uint l = 0; l < SX_TIMER_WHEEL_LEVELS; l++)
+    {
+        for (uint s = 0; s < SX_TIMER_WHEEL_SLOTS; s++)
+        {
+            sx_timer* head = &wheel->slots[l][s];
+            while (head->next != head)
+                timer_list_pop(head->next);
+        }
+    }
+
+    free(wheel);
+}
+
+SEGAN_LIB_API void sx_timer_wheel_add(struct sx_timer_wheel* wheel, struct sx_timer* timer, const ulong expire)
+{
+    if (sx_timer_is_pending(timer))
+        timer_list_pop(timer);
+
+    timer->expire = expire;
+    timer_wheel_insert(wheel, timer);
+}
+
+SEGAN_LIB_API void sx_timer_wheel_remove(struct sx_timer* timer)
+{
+    if (sx_timer_is_pending(timer))
+        timer_list_pop(timer);
+}
+
+SEGAN_LIB_API uint sx_timer_wheel_update(struct sx_timer_wheel* wheel, const ulong now)
+{
+    uint result = 0;
+    ulong target = now / wheel->resolution;
+
+    while (wheel->tick <= target)
+    {
+        uint slot = (uint)(wheel->tick & TIMER_WHEEL_MASK);
+        if (slot == 0)
+            timer_wheel_cascade(wheel, 1);
+
+        // detach expired timers to let callbacks reschedule them safely
+        sx_timer expired;
+        timer_list_init(&expired);
+        sx_timer* head = &wheel->slots[0][slot];
+        if (head->next != head)
+        {
+            expired.next = head->next;
+            expired.prev = head->prev;
+            expired.next->prev = &expired;
+            expired.prev->next = &expired;
+            timer_list_init(head);
+        }
+
+        wheel->tick++;
+
+        while (expired.next != &expired)
+        {
+            sx_timer* timer = expired.next;
+            timer_list_pop(timer);
+            if (timer->func)
+                timer->func(timer, timer->param);
+            result++;
+        }
+    }
+
+    return result;
+}
+
+SEGAN_LIB_API bool sx_timer_is_pending(const struct sx_timer* timer)
+{
+    return timer->next != null;
+}
@@ -5,20 +5,79 @@
 	eMail:		sajad.b@gmail.com
 	Site:		www.SeganX.com
 	Desc:		This file contain a simple class and functions to handle times
+                and a hierarchical timer wheel to schedule timeouts
+
+                NOTE: the timer wheel is not thread safe. callers must
+                serialize access to the wheel and its timers
 *********************************************************************/
 #ifndef DEFINED_TIME
 #define DEFINED_TIME
 
 #include "def.h"
 
+#define SX_TIMER_WHEEL_BITS     6
+#define SX_TIMER_WHEEL_SLOTS    (1 << SX_TIMER_WHEEL_BITS)
+#define SX_TIMER_WHEEL_LEVELS   4
+
+struct sx_timer;
+struct sx_timer_wheel;
+
+typedef void (*sx_timer_func)(struct sx_timer* timer, void* param);
+
+//! a timer node which can be embedded in any object to be scheduled in the wheel
+typedef struct sx_timer
+{
+    ulong               expire;     //! expiration time in milliseconds
+    sx_timer_func       func;       //! called once the timer expired
+    void*               param;      //! user parameter passed to callback
+    struct sx_timer*    next;
+    struct sx_timer*    prev;
+}
+sx_timer;
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
 
+/*!
+return the time in milliseconds since epoch.
+NOTE: times are taken from a monotonic clock anchored to the wall clock at the first call so
+they never go back but drift from the wall clock if it is adjusted later
+*/
 SEGAN_LIB_API ulong sx_time_now();
+
+//! return the time in microseconds since epoch from the same clock of sx_time_now
+SEGAN_LIB_API ulong sx_time_now_us();
+
+//! return the time in nanoseconds since epoch from the same clock of sx_time_now
+SEGAN_LIB_API ulong sx_time_now_ns();
+
+//! refresh the cached time and return it
+SEGAN_LIB_API ulong sx_time_update();
+
+//! return the time in milliseconds cached by the last call of sx_time_update. cheap to call in hot paths
+SEGAN_LIB_API ulong sx_time_cached();
 SEGAN_LIB_API ulong sx_time_diff(const ulong t1, const ulong t2);
 SEGAN_LIB_API void sx_time_print(char* dest, const uint destsize, const ulong timeval);
 
+//! create a timer wheel which ticks every resolution milliseconds starting from now
+SEGAN_LIB_API struct sx_timer_wheel* sx_timer_wheel_create(const ulong now, const uint resolution);
+
+//! destroy the timer wheel. scheduled timers will be detached but not called
+SEGAN_LIB_API void sx_timer_wheel_destroy(struct sx_timer_wheel* wheel);
+
+//! schedule the timer to expire at specified time. a pending timer will be rescheduled
+SEGAN_LIB_API void sx_timer_wheel_add(struct sx_timer_wheel* wheel, struct sx_timer* timer, const ulong expire);
+
+//! remove the timer from the wheel. nothing happens if the timer is not pending
+SEGAN_LIB_API void sx_timer_wheel_remove(struct sx_timer* timer);
+
+//! advance the wheel to now and call expired timers. return number of called timers
+SEGAN_LIB_API uint sx_timer_wheel_update(struct sx_timer_wheel* wheel, const ulong now);
+
+//! return true if the timer is scheduled in a wheel
+SEGAN_LIB_API bool sx_timer_is_pending(const struct sx_timer* timer);
+
 
 #ifdef __cplusplus
 }
@@ -6,7 +6,14 @@
 #include <time.h>
 #include <signal.h>
 
+#if defined(__linux__)
+#include <errno.h>
+#include <execinfo.h>
+#include <sys/time.h>
+#endif
+
 #include "memory.h"
+#include "platform.h"
 #include "trace.h"
 
 
@@ -19,7 +26,9 @@ typedef struct trace_info
     const char*	file;           //  file name
     int	        line;           //  line number
 #if SEGANX_TRACE_PROFILER
-    long        time;           // time consumed will be computed on return
+    ulong       time;           //  start time of the call in nanoseconds
+    ulong       child_time;     //  time consumed by the profiled callees
+    uint        node;           //  node of the call in the profile or zero if it is not profiled
 #endif
 #if SEGANX_TRACE_CALLSTACK
     char	    param[128];	    //	function parameters
@@ -29,13 +38,73 @@ trace_info;
 #endif // (SEGANX_TRACE_CALLSTACK || SEGANX_TRACE_PROFILER)
 
 #if SEGANX_TRACE_PROFILER
-typedef struct trace_func_profile 
+
+#define TRACE_PROFILE_NODES     1024
+#define TRACE_PROFILE_THREADS   64
+
+typedef struct trace_node
 {
+    const char* func;
+    uint        parent;
+    uint        child;          //  first callee
+    uint        sibling;        //  next callee of the parent
+    ulong       calls;
+    ulong       inclusive;      //  nanoseconds
+    ulong       exclusive;      //  nanoseconds without the profiled callees
+}
+trace_node;
 
+//  call tree of a thread which is written only by the owner and read by the reports
+typedef struct trace_profile
+{
+    const char*         filename;
+    ulong               generation;
+    volatile uint       count;
+    struct trace_node   nodes[TRACE_PROFILE_NODES];    //  the first node is the root of the calls
 }
-trace_func_profile;
+trace_profile;
+
+//  profiles outlive their threads so the reports include the finished threads
+static struct trace_profile* s_profiles[TRACE_PROFILE_THREADS] = { null };
+static volatile ulong s_profiles_count = 0;
+static volatile ulong s_profile_generation = 0;
+static volatile bool s_profile_enabled = false;
+
 #endif // SEGANX_TRACE_PROFILER
 
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+
+#define TRACE_RECORDER_RECORDS  256     //  must be a power of two
+#define TRACE_RECORDER_DATA     16      //  bytes of the header of the packets
+#define TRACE_RECORDER_THREADS  64
+
+typedef struct trace_record
+{
+    ulong       cycles;
+    const char* event;          //  null for the packets
+    uint        a;              //  size of the packets
+    uint        b;
+    byte        data[TRACE_RECORDER_DATA];
+}
+trace_record;
+
+//  ring of the last records of a thread which is written only by the owner with plain stores
+typedef struct trace_recorder
+{
+    const char*         filename;
+    ulong               start_cycles;
+    ulong               start_tick;
+    ulong               count;
+    struct trace_record records[TRACE_RECORDER_RECORDS];
+}
+trace_recorder;
+
+//  recorders outlive their threads so the crash reports include the recent records of the finished threads
+static struct trace_recorder* s_recorders[TRACE_RECORDER_THREADS] = { null };
+static volatile ulong s_recorders_count = 0;
+
+#endif // SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT
+
 #if SEGANX_TRACE_MEMORY
 
 #define MEM_PROTECTION_SIZE     16
@@ -87,6 +156,12 @@ typedef struct trace_object
 #if SEGANX_TRACE_MEMORY
     struct memory_tracker* mem_tracker;
 #endif
+#if SEGANX_TRACE_PROFILER
+    struct trace_profile*  profile;
+#endif
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+    struct trace_recorder* recorder;
+#endif
 }
 trace_object;
 
@@ -420,19 +495,26 @@ static void trace_app_crashed(const char* reason, dword code);
 #endif // SEGANX_TRACE_CRASHRPT
 
 
-#if SEGANX_TRACE_PROFILER
-static SEGAN_INLINE long trace_get_current_tick() 
+#if (SEGANX_TRACE_PROFILER || SEGANX_TRACE_MUTEX || (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT))
+//  monotonic time in nanoseconds which does not wrap like the nanoseconds field of the clock
+static SEGAN_INLINE ulong trace_get_current_tick() 
 {
 #ifdef _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (ulong)(counter.QuadPart / frequency.QuadPart) * 1000000000ull + (ulong)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart;
 #else
     struct timespec res;
-    if (clock_gettime(CLOCK_REALTIME, &res) == 0)
-        return res.tv_nsec;
+    if (clock_gettime(CLOCK_MONOTONIC, &res) == 0)
+        return (ulong)res.tv_sec * 1000000000ull + (ulong)res.tv_nsec;
     else
         return 0;
 #endif
 }
-#endif // SEGANX_TRACE_PROFILER
+#endif // (SEGANX_TRACE_PROFILER || SEGANX_TRACE_MUTEX || SEGANX_TRACE_RECORDER)
 
 
 #if (SEGANX_TRACE_CALLSTACK || SEGANX_TRACE_PROFILER || SEGANX_TRACE_CRASHRPT || SEGANX_TRACE_MEMORY)
@@ -455,6 +537,29 @@ SEGAN_LIB_API void trace_attach(uint stack_size, const char* filename)
 #if SEGANX_TRACE_CRASHRPT
     trace_set_crash_handler();
 #endif
+
+#if SEGANX_TRACE_PROFILER
+    ulong slot = sx_atomic_inc64(&s_profiles_count) - 1;
+    if (slot < TRACE_PROFILE_THREADS)
+    {
+        s_current_object->profile = (struct trace_profile*)calloc(1, sizeof(struct trace_profile));
+        s_current_object->profile->filename = filename;
+        s_current_object->profile->count = 1;
+        s_profiles[slot] = s_current_object->profile;
+    }
+#endif
+
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+    ulong recorder_slot = sx_atomic_inc64(&s_recorders_count) - 1;
+    if (recorder_slot < TRACE_RECORDER_THREADS)
+    {
+        s_current_object->recorder = (struct trace_recorder*)calloc(1, sizeof(struct trace_recorder));
+        s_current_object->recorder->filename = filename;
+        s_current_object->recorder->start_cycles = sx_get_cycles();
+        s_current_object->recorder->start_tick = trace_get_current_tick();
+        s_recorders[recorder_slot] = s_current_object->recorder;
+    }
+#endif
 }
 
 SEGAN_LIB_API void trace_detach(void)
@@ -504,6 +609,82 @@ static SEGAN_LIB_INLINE struct trace_info* trace_object_pop()
 #endif
 }
 
+#if SEGANX_TRACE_PROFILER
+
+static uint trace_profile_child(struct trace_profile* profile, const uint parent, const char* func)
+{
+    for (uint i = profile->nodes[parent].child; i != 0; i = profile->nodes[i].sibling)
+        if (profile->nodes[i].func == func)
+            return i;
+
+    uint index = profile->count;
+    if (index >= TRACE_PROFILE_NODES) return 0;
+
+    //  the node is complete before the reports can see it
+    struct trace_node* node = &profile->nodes[index];
+    memset(node, 0, sizeof(struct trace_node));
+    node->func = func;
+    node->parent = parent;
+    node->sibling = profile->nodes[parent].child;
+    profile->count = index + 1;
+    profile->nodes[parent].child = index;
+    return index;
+}
+
+//  drop the calls of the last run and start the new tree with the calls on the stack
+static void trace_profile_restart(struct trace_profile* profile, const uint depth, const ulong now)
+{
+    profile->generation = s_profile_generation;
+    profile->count = 1;
+    memset(&profile->nodes[0], 0, sizeof(struct trace_node));
+
+    uint parent = 0;
+    for (uint i = 0; i < depth; ++i)
+    {
+        struct trace_info* tinfo = &s_current_object->callstack_array[i];
+        tinfo->node = (i == 0 || parent > 0) ? trace_profile_child(profile, parent, tinfo->func) : 0;
+        tinfo->time = now;
+        tinfo->child_time = 0;
+        parent = tinfo->node;
+    }
+}
+
+static SEGAN_LIB_INLINE void trace_profile_push(struct trace_info* tinfo, const char* func)
+{
+    tinfo->node = 0;
+    struct trace_profile* profile = s_current_object->profile;
+    if (s_profile_enabled == false || profile == null) return;
+
+    const uint depth = s_current_object->callstack_index - 1;
+    if (profile->generation != s_profile_generation)
+        trace_profile_restart(profile, depth, trace_get_current_tick());
+
+    //  callees of the calls which are not in the tree are left out too
+    uint parent = depth > 0 ? s_current_object->callstack_array[depth - 1].node : 0;
+    if (depth == 0 || parent > 0)
+        tinfo->node = trace_profile_child(profile, parent, func);
+    tinfo->child_time = 0;
+    tinfo->time = trace_get_current_tick();
+}
+
+static SEGAN_LIB_INLINE void trace_profile_pop(struct trace_info* tinfo)
+{
+    if (tinfo->node == 0 || s_profile_enabled == false) return;
+    struct trace_profile* profile = s_current_object->profile;
+    if (profile->generation != s_profile_generation) return;
+
+    ulong elapsed = trace_get_current_tick() - tinfo->time;
+    struct trace_node* node = &profile->nodes[tinfo->node];
+    node->calls++;
+    node->inclusive += elapsed;
+    node->exclusive += elapsed > tinfo->child_time ? elapsed - tinfo->child_time : 0;
+
+    if (s_current_object->callstack_index > 0)
+        s_current_object->callstack_array[s_current_object->callstack_index - 1].child_time += elapsed;
+}
+
+#endif // SEGANX_TRACE_PROFILER
+
 SEGAN_LIB_API void trace_push(const char * file, const int line, const char * function)
 {
     struct trace_info* tinfo = trace_object_pop(s_current_object);
@@ -514,7 +695,7 @@ SEGAN_LIB_API void trace_push(const char * file, const int line, const char * fu
     tinfo->param[0] = 0;
 #endif
 #if SEGANX_TRACE_PROFILER
-    tinfo->time = trace_get_current_tick();
+    trace_profile_push(tinfo, function);
 #endif
 }
 
@@ -551,15 +732,17 @@ SEGAN_LIB_API void trace_push_param(const char * file, const int line, const cha
 #endif // SEGANX_TRACE_CALLSTACK
 
 #if SEGANX_TRACE_PROFILER
-    tinfo->time = trace_get_current_tick();
+    trace_profile_push(tinfo, function);
 #endif // SEGANX_TRACE_PROFILER
 }
 
 SEGAN_LIB_API void trace_pop(void)
 {
 #if SEGANX_TRACE_PROFILER
-    struct trace_info* tinfo = &s_current_object->callstack_array[--s_current_object->callstack_index];
-    tinfo->time = trace_get_current_tick() - tinfo->time;
+#if _DEBUG
+    if (s_current_object->callstack_index < 1) return;
+#endif
+    trace_profile_pop(&s_current_object->callstack_array[--s_current_object->callstack_index]);
 #else
 #if _DEBUG
     if (s_current_object->callstack_index > 0)
@@ -571,6 +754,456 @@ SEGAN_LIB_API void trace_pop(void)
 #endif // (SEGANX_TRACE_CALLSTACK || SEGANX_TRACE_PROFILER)
 
 
+#if SEGANX_TRACE_PROFILER
+
+typedef struct trace_func_profile
+{
+    const char* func;
+    ulong       calls;
+    ulong       inclusive;
+    ulong       exclusive;
+}
+trace_func_profile;
+
+static int trace_func_profile_compare(const void* a, const void* b)
+{
+    const struct trace_func_profile* pa = (const struct trace_func_profile*)a;
+    const struct trace_func_profile* pb = (const struct trace_func_profile*)b;
+    return (pa->exclusive < pb->exclusive) - (pa->exclusive > pb->exclusive);
+}
+
+SEGAN_LIB_API void trace_profiler_enable(const bool enable)
+{
+    //  threads restart their trees on their next call when they see the new generation
+    if (enable && s_profile_enabled == false)
+        s_profile_generation++;
+    s_profile_enabled = enable;
+}
+
+SEGAN_LIB_API bool trace_profiler_enabled(void)
+{
+    return s_profile_enabled;
+}
+
+//  trees are read while their threads are writing them so the calls in flight may be missed
+SEGAN_LIB_API void trace_profiler_report(FILE* f)
+{
+    struct trace_func_profile* funcs = (struct trace_func_profile*)calloc(TRACE_PROFILE_NODES, sizeof(struct trace_func_profile));
+    for (uint t = 0; t < TRACE_PROFILE_THREADS; ++t)
+    {
+        const struct trace_profile* profile = s_profiles[t];
+        if (profile == null || profile->generation != s_profile_generation || profile->count < 2) continue;
+
+        //  the same function in different paths of the tree is summed up
+        uint count = 0;
+        const uint nodes = profile->count;
+        for (uint i = 1; i < nodes; ++i)
+        {
+            const struct trace_node* node = &profile->nodes[i];
+            uint k = 0;
+            while (k < count && funcs[k].func != node->func) ++k;
+            if (k == count)
+            {
+                funcs[k].func = node->func;
+                funcs[k].calls = funcs[k].inclusive = funcs[k].exclusive = 0;
+                count++;
+            }
+            funcs[k].calls += node->calls;
+            funcs[k].inclusive += node->inclusive;
+            funcs[k].exclusive += node->exclusive;
+        }
+        qsort(funcs, count, sizeof(struct trace_func_profile), trace_func_profile_compare);
+
+        fprintf(f, "\nProfile of thread %u (%s):\n", t, profile->filename);
+        fprintf(f, "%12s %16s %16s  %s\n", "calls", "inclusive(ms)", "exclusive(ms)", "function");
+        for (uint i = 0; i < count; ++i)
+            fprintf(f, "%12llu %16.3f %16.3f  %s\n", funcs[i].calls, funcs[i].inclusive / 1000000.0, funcs[i].exclusive / 1000000.0, funcs[i].func ? funcs[i].func : "?");
+    }
+    free(funcs);
+}
+
+//  write the exclusive microseconds of every path in the folded format of flame graphs
+SEGAN_LIB_API void trace_profiler_folded(FILE* f)
+{
+    for (uint t = 0; t < TRACE_PROFILE_THREADS; ++t)
+    {
+        const struct trace_profile* profile = s_profiles[t];
+        if (profile == null || profile->generation != s_profile_generation) continue;
+
+        const uint nodes = profile->count;
+        for (uint i = 1; i < nodes; ++i)
+        {
+            ulong us = profile->nodes[i].exclusive / 1000;
+            if (us < 1) continue;
+
+            const char* path[64];
+            uint depth = 0;
+            for (uint n = i; n > 0 && n < nodes && depth < 64; n = profile->nodes[n].parent)
+                path[depth++] = profile->nodes[n].func ? profile->nodes[n].func : "?";
+
+            while (depth > 1)
+                fprintf(f, "%s;", path[--depth]);
+            fprintf(f, "%s %llu\n", path[0], us);
+        }
+    }
+}
+
+#endif // SEGANX_TRACE_PROFILER
+
+
+#if SEGANX_TRACE_MUTEX
+
+#define TRACE_MUTEX_SITES       256     //  call sites of each thread, must be a power of two
+#define TRACE_MUTEX_THREADS     64
+#define TRACE_MUTEX_HELD        8       //  locks which a thread can hold at the same time
+
+typedef struct trace_mutex_site
+{
+    const char* file;
+    const char* func;
+    int         line;
+    ulong       count;
+    ulong       wait;                   //  nanoseconds
+    ulong       wait_max;
+    ulong       hold;                   //  nanoseconds
+    ulong       hold_max;
+}
+trace_mutex_site;
+
+typedef struct trace_mutex_held
+{
+    struct sx_mutex*            mutex;
+    struct trace_mutex_site*    site;
+    ulong                       time;
+}
+trace_mutex_held;
+
+//  sites of the locks of a thread which is written only by the owner and read by the report
+typedef struct trace_mutex_table
+{
+    ulong                       generation;
+    uint                        held_count;
+    struct trace_mutex_held     held[TRACE_MUTEX_HELD];
+    struct trace_mutex_site     sites[TRACE_MUTEX_SITES];
+}
+trace_mutex_table;
+
+static struct trace_mutex_table* s_mutex_tables[TRACE_MUTEX_THREADS] = { null };
+static volatile ulong s_mutex_tables_count = 0;
+static volatile ulong s_mutex_generation = 0;
+static volatile bool s_mutex_enabled = false;
+static struct trace_mutex_table s_mutex_overflow;   //  marks the threads which have no table
+
+#ifdef _WIN32
+__declspec(thread) struct trace_mutex_table * s_mutex_table = null;
+#else
+static __thread struct trace_mutex_table * s_mutex_table = null;
+#endif
+
+static struct trace_mutex_table* trace_mutex_table_get(void)
+{
+    if (s_mutex_table == null)
+    {
+        ulong slot = sx_atomic_inc64(&s_mutex_tables_count) - 1;
+        if (slot < TRACE_MUTEX_THREADS)
+        {
+            s_mutex_table = (struct trace_mutex_table*)calloc(1, sizeof(struct trace_mutex_table));
+            s_mutex_tables[slot] = s_mutex_table;
+        }
+        else s_mutex_table = &s_mutex_overflow;
+    }
+    if (s_mutex_table == &s_mutex_overflow) return null;
+
+    if (s_mutex_table->generation != s_mutex_generation)
+    {
+        memset(s_mutex_table->sites, 0, sizeof(s_mutex_table->sites));
+        s_mutex_table->held_count = 0;
+        s_mutex_table->generation = s_mutex_generation;
+    }
+    return s_mutex_table;
+}
+
+static struct trace_mutex_site* trace_mutex_site_get(struct trace_mutex_site* sites, const char* file, const int line, const char* func)
+{
+    uint index = (uint)(((size_t)file >> 3) ^ ((uint)line * 2654435761u));
+    for (uint i = 0; i < TRACE_MUTEX_SITES; ++i)
+    {
+        struct trace_mutex_site* site = &sites[(index + i) & (TRACE_MUTEX_SITES - 1)];
+        if (site->file == file && site->line == line)
+            return site;
+        if (site->file == null)
+        {
+            site->func = func;
+            site->line = line;
+            site->file = file;
+            return site;
+        }
+    }
+    return null;
+}
+
+SEGAN_LIB_API int trace_mutex_lock(struct sx_mutex* mutex, const char* file, const int line, const char* function)
+{
+    if (s_mutex_enabled == false) return (sx_mutex_lock)(mutex);
+    struct trace_mutex_table* table = trace_mutex_table_get();
+    if (table == null) return (sx_mutex_lock)(mutex);
+
+    ulong start = trace_get_current_tick();
+    int res = (sx_mutex_lock)(mutex);
+    ulong now = trace_get_current_tick();
+
+    struct trace_mutex_site* site = trace_mutex_site_get(table->sites, file, line, function);
+    if (site != null)
+    {
+        ulong wait = now - start;
+        site->count++;
+        site->wait += wait;
+        if (wait > site->wait_max) site->wait_max = wait;
+    }
+
+    if (table->held_count < TRACE_MUTEX_HELD)
+    {
+        struct trace_mutex_held* held = &table->held[table->held_count++];
+        held->mutex = mutex;
+        held->site = site;
+        held->time = now;
+    }
+    return res;
+}
+
+SEGAN_LIB_API int trace_mutex_unlock(struct sx_mutex* mutex)
+{
+    //  the locks which are taken before the profiler is enabled are not in the list
+    struct trace_mutex_table* table = s_mutex_table;
+    if (table != null && table->held_count > 0 && table->generation == s_mutex_generation)
+    {
+        for (uint i = table->held_count; i > 0; --i)
+        {
+            struct trace_mutex_held* held = &table->held[i - 1];
+            if (held->mutex != mutex) continue;
+
+            struct trace_mutex_site* site = held->site;
+            if (site != null && s_mutex_enabled)
+            {
+                ulong hold = trace_get_current_tick() - held->time;
+                site->hold += hold;
+                if (hold > site->hold_max) site->hold_max = hold;
+            }
+            *held = table->held[--table->held_count];
+            break;
+        }
+    }
+    return (sx_mutex_unlock)(mutex);
+}
+
+SEGAN_LIB_API void trace_mutex_enable(const bool enable)
+{
+    //  threads clear their tables on their next lock when they see the new generation
+    if (enable && s_mutex_enabled == false)
+        s_mutex_generation++;
+    s_mutex_enabled = enable;
+}
+
+SEGAN_LIB_API bool trace_mutex_enabled(void)
+{
+    return s_mutex_enabled;
+}
+
+static int trace_mutex_site_compare(const void* a, const void* b)
+{
+    const struct trace_mutex_site* sa = (const struct trace_mutex_site*)a;
+    const struct trace_mutex_site* sb = (const struct trace_mutex_site*)b;
+    if (sa->wait != sb->wait) return sa->wait < sb->wait ? 1 : -1;
+    return (sa->count < sb->count) - (sa->count > sb->count);
+}
+
+//  tables are read while their threads are writing them so the locks in flight may be missed
+SEGAN_LIB_API void trace_mutex_report(FILE* f)
+{
+    struct trace_mutex_site* sites = (struct trace_mutex_site*)calloc(TRACE_MUTEX_SITES, sizeof(struct trace_mutex_site));
+    for (uint t = 0; t < TRACE_MUTEX_THREADS; ++t)
+    {
+        const struct trace_mutex_table* table = s_mutex_tables[t];
+        if (table == null || table->generation != s_mutex_generation) continue;
+
+        for (uint i = 0; i < TRACE_MUTEX_SITES; ++i)
+        {
+            const struct trace_mutex_site* site = &table->sites[i];
+            if (site->file == null || site->count < 1) continue;
+
+            struct trace_mutex_site* total = trace_mutex_site_get(sites, site->file, site->line, site->func);
+            if (total == null) continue;
+            total->count += site->count;
+            total->wait += site->wait;
+            total->hold += site->hold;
+            if (site->wait_max > total->wait_max) total->wait_max = site->wait_max;
+            if (site->hold_max > total->hold_max) total->hold_max = site->hold_max;
+        }
+    }
+    qsort(sites, TRACE_MUTEX_SITES, sizeof(struct trace_mutex_site), trace_mutex_site_compare);
+
+    fprintf(f, "%12s %12s %10s %10s %12s %10s %10s  %s\n", "locks", "wait(ms)", "avg(us)", "max(us)", "hold(ms)", "avg(us)", "max(us)", "site");
+    for (uint i = 0; i < TRACE_MUTEX_SITES && sites[i].count > 0; ++i)
+    {
+        const struct trace_mutex_site* site = &sites[i];
+        fprintf(f, "%12llu %12.3f %10.2f %10.2f %12.3f %10.2f %10.2f  %s(%d): %s\n", site->count,
+            site->wait / 1000000.0, site->wait / 1000.0 / site->count, site->wait_max / 1000.0,
+            site->hold / 1000000.0, site->hold / 1000.0 / site->count, site->hold_max / 1000.0,
+            trace_get_filename(site->file), site->line, site->func);
+    }
+    free(sites);
+}
+
+#endif // SEGANX_TRACE_MUTEX
+
+
+#if SEGANX_TRACE_SAMPLER
+#if defined(__linux__)
+
+#define TRACE_SAMPLE_DEPTH      32
+#define TRACE_SAMPLE_COUNT      8192    //  ring of the last samples, must be a power of two
+#define TRACE_SAMPLE_SKIP       2       //  frames of the signal handler and the trampoline of the kernel
+
+typedef struct trace_sample
+{
+    volatile ulong  seq;                //  index of the sample plus one when it is complete
+    uint            depth;
+    void*           frames[TRACE_SAMPLE_DEPTH];
+}
+trace_sample;
+
+static struct trace_sample* s_samples = null;
+static volatile ulong s_samples_head = 0;
+
+//  runs on the thread which consumed the cpu time so it only claims a slot of the ring and fills it
+static void trace_sampler_handler(int sig)
+{
+    int err = errno;
+    ulong index = __atomic_fetch_add(&s_samples_head, 1, __ATOMIC_RELAXED);
+    struct trace_sample* sample = &s_samples[index & (TRACE_SAMPLE_COUNT - 1)];
+    __atomic_store_n(&sample->seq, 0, __ATOMIC_RELEASE);
+
+    void* frames[TRACE_SAMPLE_DEPTH + TRACE_SAMPLE_SKIP];
+    int depth = backtrace(frames, TRACE_SAMPLE_DEPTH + TRACE_SAMPLE_SKIP) - TRACE_SAMPLE_SKIP;
+    sample->depth = depth > 0 ? (uint)depth : 0;
+    for (uint i = 0; i < sample->depth; ++i)
+        sample->frames[i] = frames[i + TRACE_SAMPLE_SKIP];
+
+    __atomic_store_n(&sample->seq, index + 1, __ATOMIC_RELEASE);
+    errno = err;
+}
+
+static int trace_sample_compare(const void* a, const void* b)
+{
+    const struct trace_sample* sa = (const struct trace_sample*)a;
+    const struct trace_sample* sb = (const struct trace_sample*)b;
+    if (sa->depth != sb->depth) return sa->depth < sb->depth ? -1 : 1;
+    return memcmp(sa->frames, sb->frames, sa->depth * sizeof(void*));
+}
+
+//  print the function of a symbol of backtrace_symbols or the module and the offset if it has no name
+static void trace_sample_print_symbol(FILE* f, const char* symbol)
+{
+    const char* module = trace_get_filename(symbol);
+    const char* open = strchr(module, '(');
+    if (open == null)
+    {
+        fprintf(f, "%.*s", (int)strcspn(module, " "), module);
+        return;
+    }
+
+    const char* name = open + 1;
+    size_t len = strcspn(name, "+)");
+    if (len > 0)
+        fprintf(f, "%.*s", (int)len, name);
+    else
+        fprintf(f, "%.*s%.*s", (int)(open - module), module, (int)strcspn(name, ")"), name);
+}
+
+SEGAN_LIB_API bool trace_sampler_start(const uint frequency)
+{
+    trace_sampler_stop();
+
+    if (s_samples == null)
+        s_samples = (struct trace_sample*)calloc(TRACE_SAMPLE_COUNT, sizeof(struct trace_sample));
+    else
+        memset(s_samples, 0, TRACE_SAMPLE_COUNT * sizeof(struct trace_sample));
+    s_samples_head = 0;
+
+    //  the first call of backtrace loads the unwinder with malloc which is not safe in the handler
+    void* frames[TRACE_SAMPLE_SKIP];
+    backtrace(frames, TRACE_SAMPLE_SKIP);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = trace_sampler_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, null) != 0) return false;
+
+    //  the timer counts the cpu time of all threads and the kernel signals the thread which is running
+    uint interval = 1000000 / (frequency > 0 ? frequency : 1);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    return setitimer(ITIMER_PROF, &timer, null) == 0;
+}
+
+SEGAN_LIB_API void trace_sampler_stop(void)
+{
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, null);
+}
+
+SEGAN_LIB_API void trace_sampler_folded(FILE* f)
+{
+    if (s_samples == null) return;
+
+    //  copy the complete samples and leave out the ones which are rewritten while copying
+    uint count = 0;
+    struct trace_sample* samples = (struct trace_sample*)malloc(TRACE_SAMPLE_COUNT * sizeof(struct trace_sample));
+    for (uint i = 0; i < TRACE_SAMPLE_COUNT; ++i)
+    {
+        ulong seq = __atomic_load_n(&s_samples[i].seq, __ATOMIC_ACQUIRE);
+        if (seq == 0) continue;
+        memcpy(&samples[count], &s_samples[i], sizeof(struct trace_sample));
+        if (__atomic_load_n(&s_samples[i].seq, __ATOMIC_ACQUIRE) != seq || samples[count].depth < 1) continue;
+        count++;
+    }
+    qsort(samples, count, sizeof(struct trace_sample), trace_sample_compare);
+
+    for (uint i = 0; i < count; )
+    {
+        uint same = i + 1;
+        while (same < count && trace_sample_compare(&samples[i], &samples[same]) == 0) same++;
+
+        char** symbols = backtrace_symbols(samples[i].frames, (int)samples[i].depth);
+        if (symbols != null)
+        {
+            for (uint d = samples[i].depth; d > 0; --d)
+            {
+                trace_sample_print_symbol(f, symbols[d - 1]);
+                fprintf(f, d > 1 ? ";" : " %u\n", same - i);
+            }
+            free(symbols);
+        }
+        i = same;
+    }
+    free(samples);
+}
+
+#else
+
+SEGAN_LIB_API bool trace_sampler_start(const uint frequency) { return false; }
+SEGAN_LIB_API void trace_sampler_stop(void) {}
+SEGAN_LIB_API void trace_sampler_folded(FILE* f) {}
+
+#endif // __linux__
+#endif // SEGANX_TRACE_SAMPLER
+
+
 #if SEGANX_TRACE_CRASHRPT
 
 #if SEGANX_TRACE_CALLSTACK
@@ -589,6 +1222,86 @@ static void trace_callstack_report(FILE* f)
 }
 #endif // SEGANX_TRACE_CALLSTACK
 
+#if SEGANX_TRACE_RECORDER
+SEGAN_LIB_API void trace_record_packet(const void* data, const uint size)
+{
+    if (s_current_object == null || s_current_object->recorder == null) return;
+    struct trace_recorder* recorder = s_current_object->recorder;
+    struct trace_record* record = &recorder->records[recorder->count++ & (TRACE_RECORDER_RECORDS - 1)];
+    record->cycles = sx_get_cycles();
+    record->event = null;
+    record->a = size;
+    record->b = 0;
+    if (size >= TRACE_RECORDER_DATA)
+        memcpy(record->data, data, TRACE_RECORDER_DATA);
+    else
+    {
+        memset(record->data, 0, TRACE_RECORDER_DATA);
+        memcpy(record->data, data, size);
+    }
+}
+
+SEGAN_LIB_API void trace_record_event(const char* event, const uint a, const uint b)
+{
+    if (s_current_object == null || s_current_object->recorder == null) return;
+    struct trace_recorder* recorder = s_current_object->recorder;
+    struct trace_record* record = &recorder->records[recorder->count++ & (TRACE_RECORDER_RECORDS - 1)];
+    record->cycles = sx_get_cycles();
+    record->event = event;
+    record->a = a;
+    record->b = b;
+}
+
+static void trace_recorder_print(FILE* f, const struct trace_recorder* recorder, const ulong now, const double cycles_per_us)
+{
+    ulong count = recorder->count;
+    ulong first = count > TRACE_RECORDER_RECORDS ? count - TRACE_RECORDER_RECORDS : 0;
+    for (ulong i = first; i < count; i++)
+    {
+        const struct trace_record* record = &recorder->records[i & (TRACE_RECORDER_RECORDS - 1)];
+        fprintf(f, "  %12.1f us  ", (double)(long long)(record->cycles - now) / cycles_per_us);
+        if (record->event != null)
+        {
+            fprintf(f, "%-10s %u %u\n", record->event, record->a, record->b);
+            continue;
+        }
+        fprintf(f, "%-10s %-4u", "packet", record->a);
+        uint size = record->a < TRACE_RECORDER_DATA ? record->a : TRACE_RECORDER_DATA;
+        for (uint b = 0; b < size; b++)
+            fprintf(f, " %02x", record->data[b]);
+        fprintf(f, "\n");
+    }
+}
+
+//  the records of the current thread come first and the times are relative to the report
+static void trace_recorder_report(FILE* f)
+{
+    ulong now = sx_get_cycles();
+    double cycles_per_us = 1000.0;
+    if (s_recorders[0] != null)
+    {
+        ulong elapsed = trace_get_current_tick() - s_recorders[0]->start_tick;
+        if (elapsed > 0 && now > s_recorders[0]->start_cycles)
+            cycles_per_us = (double)(now - s_recorders[0]->start_cycles) * 1000.0 / elapsed;
+    }
+
+    struct trace_recorder* current = s_current_object->recorder;
+    if (current != null)
+    {
+        fprintf(f, "\nFlight recorder of the current thread (%s):\n", current->filename);
+        trace_recorder_print(f, current, now, cycles_per_us);
+    }
+
+    ulong recorders = s_recorders_count < TRACE_RECORDER_THREADS ? s_recorders_count : TRACE_RECORDER_THREADS;
+    for (ulong i = 0; i < recorders; i++)
+    {
+        if (s_recorders[i] == null || s_recorders[i] == current || s_recorders[i]->count == 0) continue;
+        fprintf(f, "\nFlight recorder of thread %llu (%s):\n", i, s_recorders[i]->filename);
+        trace_recorder_print(f, s_recorders[i], now, cycles_per_us);
+    }
+}
+#endif // SEGANX_TRACE_RECORDER
+
 #ifdef _WIN32
 #define  CRASHED_UNKNOWN                    "Application crashes unexpectedly!"
 #define  CRASHED_MEMORY_ALLOC               "Can't allocate sufficient memory!"
@@ -644,6 +1357,10 @@ static void trace_app_crashed(const char* reason, dword code)
     trace_callstack_report(fstr);
 #endif // SEGANX_TRACE_CALLSTACK
 
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+    trace_recorder_report(fstr);
+#endif // SEGANX_TRACE_RECORDER
+
 #if SEGANX_TRACE_MEMORY
     trace_mem_report(fstr, true);
 #endif // SEGANX_TRACE_MEMORY
@@ -803,6 +1520,10 @@ static void trace_signal_handler(int sig, siginfo_t* sinfo, void *ucontext)
     trace_callstack_report(fstr);
 #endif // SEGANX_TRACE_CALLSTACK
 
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+    trace_recorder_report(fstr);
+#endif // SEGANX_TRACE_RECORDER
+
 #if SEGANX_TRACE_MEMORY
     trace_mem_report(fstr, true);
 #endif // SEGANX_TRACE_MEMORY
@@ -870,6 +1591,10 @@ SEGAN_LIB_API void trace_assert(const char* expression, const char* file, const
     trace_callstack_report(fstr);
 #endif // SEGANX_TRACE_CALLSTACK
 
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+    trace_recorder_report(fstr);
+#endif // SEGANX_TRACE_RECORDER
+
 #if SEGANX_TRACE_MEMORY
     trace_mem_report(fstr, true);
 #endif // SEGANX_TRACE_MEMORY
@@ -57,12 +57,21 @@ SEGAN_LIB_API void trace_detach( void );
 
 
 
+//  trace levels of sx_trace_at. the level of a call is compared to the level of its subsystem in def.h
+#define SX_TRACE_CONTROL                    1       //  setup, configuration and sessions
+#define SX_TRACE_HOT                        2       //  paths which run for every packet
+
+
 #if (SEGANX_TRACE_CALLSTACK || SEGANX_TRACE_PROFILER)
 
 #define sx_trace()                          { trace_push( __FILE__, __LINE__, __FUNCTION__ ); }
 #define sx_trace_param(function,...)        { trace_push_param( __FILE__, __LINE__, #function, __VA_ARGS__ ); }
 #define sx_return(...)                      { trace_pop(); return __VA_ARGS__; }
 
+//  the conditions are constant so the calls above the level of the subsystem are removed by the compiler
+#define sx_trace_at(subsystem, level)       { if ((level) <= (subsystem)) trace_push( __FILE__, __LINE__, __FUNCTION__ ); }
+#define sx_return_at(subsystem, level, ...) { if ((level) <= (subsystem)) trace_pop(); return __VA_ARGS__; }
+
 #if __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -79,11 +88,147 @@ SEGAN_LIB_API void trace_pop(void);
 
 #define sx_trace()
 #define sx_trace_param(function,...)
-#define sx_return(expression)               return
+#define sx_return(...)                      return __VA_ARGS__
+#define sx_trace_at(subsystem, level)
+#define sx_return_at(subsystem, level, ...) return __VA_ARGS__
 
 #endif  //  SEGANX_TRACE_CALLSTACK || SEGANX_TRACE_PROFILER
 
 
+#if SEGANX_TRACE_PROFILER
+
+#define sx_profiler_enable(enable)          trace_profiler_enable(enable)
+#define sx_profiler_enabled()               trace_profiler_enabled()
+#define sx_profiler_report(file)            trace_profiler_report(file)
+#define sx_profiler_folded(file)            trace_profiler_folded(file)
+
+#if __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! start a new profile of all threads or stop the current one
+SEGAN_LIB_API void trace_profiler_enable(const bool enable);
+SEGAN_LIB_API bool trace_profiler_enabled(void);
+
+//! print calls, inclusive and exclusive time of the functions of each thread
+SEGAN_LIB_API void trace_profiler_report(FILE* file);
+
+//! print the exclusive time of the call paths in the folded stack format of flame graphs
+SEGAN_LIB_API void trace_profiler_folded(FILE* file);
+
+#if __cplusplus
+}
+#endif // __cplusplus
+
+#else
+
+#define sx_profiler_enable(enable)
+#define sx_profiler_enabled()               false
+#define sx_profiler_report(file)
+#define sx_profiler_folded(file)
+
+#endif  //  SEGANX_TRACE_PROFILER
+
+
+#if SEGANX_TRACE_MUTEX
+
+struct sx_mutex;
+
+#define sx_mutex_lock(mutex)                trace_mutex_lock(mutex, __FILE__, __LINE__, __FUNCTION__)
+#define sx_mutex_unlock(mutex)              trace_mutex_unlock(mutex)
+#define sx_lock_profiler_enable(enable)     trace_mutex_enable(enable)
+#define sx_lock_profiler_enabled()          trace_mutex_enabled()
+#define sx_lock_profiler_report(file)       trace_mutex_report(file)
+
+#if __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+SEGAN_LIB_API int trace_mutex_lock(struct sx_mutex* mutex, const char* file, const int line, const char* function);
+SEGAN_LIB_API int trace_mutex_unlock(struct sx_mutex* mutex);
+
+//! start a new record of the locks of all threads or stop the current one
+SEGAN_LIB_API void trace_mutex_enable(const bool enable);
+SEGAN_LIB_API bool trace_mutex_enabled(void);
+
+//! print the call sites of the locks sorted by their total wait
+SEGAN_LIB_API void trace_mutex_report(FILE* file);
+
+#if __cplusplus
+}
+#endif // __cplusplus
+
+#else
+
+#define sx_lock_profiler_enable(enable)
+#define sx_lock_profiler_enabled()          false
+#define sx_lock_profiler_report(file)
+
+#endif  //  SEGANX_TRACE_MUTEX
+
+
+#if SEGANX_TRACE_SAMPLER
+
+#define sx_sampler_start(frequency)         trace_sampler_start(frequency)
+#define sx_sampler_stop()                   trace_sampler_stop()
+#define sx_sampler_folded(file)             trace_sampler_folded(file)
+
+#if __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! sample the call stacks of the running threads in the frequency of their cpu time. return false if it is not supported
+SEGAN_LIB_API bool trace_sampler_start(const uint frequency);
+SEGAN_LIB_API void trace_sampler_stop(void);
+
+//! print the last samples in the folded stack format of flame graphs
+SEGAN_LIB_API void trace_sampler_folded(FILE* file);
+
+#if __cplusplus
+}
+#endif // __cplusplus
+
+#else
+
+#define sx_sampler_start(frequency)         false
+#define sx_sampler_stop()
+#define sx_sampler_folded(file)
+
+#endif  //  SEGANX_TRACE_SAMPLER
+
+
+//  the recorder is only read by the crash reports
+#if (SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT)
+
+#define sx_record_packet(data, size)        trace_record_packet(data, size)
+#define sx_record_event(event, a, b)        trace_record_event(event, a, b)
+
+//  the events of each packet are kept only if the level of the subsystem in def.h allows hot paths
+#define sx_record_event_at(subsystem, level, event, a, b)   { if ((level) <= (subsystem)) trace_record_event(event, a, b); }
+
+#if __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+//! keep the size and the header of the packet in the flight recorder of the thread
+SEGAN_LIB_API void trace_record_packet(const void* data, const uint size);
+
+//! keep the event in the flight recorder of the thread. the name of the event must be a static string
+SEGAN_LIB_API void trace_record_event(const char* event, const uint a, const uint b);
+
+#if __cplusplus
+}
+#endif // __cplusplus
+
+#else
+
+#define sx_record_packet(data, size)
+#define sx_record_event(event, a, b)
+#define sx_record_event_at(subsystem, level, event, a, b)
+
+#endif  //  SEGANX_TRACE_RECORDER && SEGANX_TRACE_CRASHRPT
+
+
 #if SEGANX_TRACE_MEMORY
 
 #define sx_mem_alloc( size_in_byte )            trace_mem_alloc( size_in_byte, __FILE__, __LINE__ )
@@ -3,21 +3,55 @@
 #include "core/timer.h"
 #include "core/trace.h"
 #include "core/platform.h"
+#include "core/crypto.h"
 #include "net/socket.h"
 #include "helper.h"
 
 
-uint checksum_compute(const byte* buffer, const uint len)
+// login packets are sent before the session key is known so they use the key shared with the client
+const byte mac_login_key[SESSION_KEY_LEN] = { 0x5e, 0x9a, 0x11, 0xc4, 0x73, 0x2d, 0xe8, 0x06, 0xb1, 0x4f, 0x97, 0x3a, 0xd2, 0x68, 0x0c, 0xf5 };
+
+uint mac_compute(const byte* key, const byte* buffer, const uint len)
+{
+    return (uint)sx_siphash(key, buffer, len);
+}
+
+bool mac_is_invalid(const byte* key, const byte* buffer, const uint len, const uint mac)
+{
+    return mac != mac_compute(key, buffer, len);
+}
+
+// the cookie proves that the client receives packets on its address without keeping any state on server
+static ulong cookie_mac(const byte* key, const byte* from, const byte* time)
 {
-    uint checksum = 0;
-    for (uint i = 0; i < len; i++)
-        checksum += 64548 + (uint)buffer[i] * 6597;
-    return checksum;
+    byte data[ADDRESS_LEN + 4];
+    sx_mem_copy(data, from, ADDRESS_LEN);
+    sx_mem_copy(data + ADDRESS_LEN, time, 4);
+    return sx_siphash(key, data, ADDRESS_LEN + 4);
 }
 
-bool checksum_is_invalid(const byte* buffer, const uint len, const uint checksum)
+void cookie_compute(const byte* key, const byte* from, const ulong now, byte* dest)
 {
-    return checksum != checksum_compute(buffer, len);
+    ulong seconds = now / 1000;
+    for (int i = 0; i < 4; i++)
+        dest[i] = (byte)(seconds >> (i * 8));
+
+    ulong mac = cookie_mac(key, from, dest);
+    sx_mem_copy(dest + 4, &mac, COOKIE_LEN - 4);
+}
+
+bool cookie_is_invalid(const byte* key, const byte* from, const ulong now, const byte* cookie)
+{
+    uint seconds = 0;
+    for (int i = 0; i < 4; i++)
+        seconds |= (uint)cookie[i] << (i * 8);
+
+    // the time is truncated to 32 bits in the cookie so the age is computed in 32 bits too
+    uint age = ((uint)(now / 1000) - seconds) & 0xffffffff;
+    if (age > COOKIE_LIFETIME) return true;
+
+    ulong mac = cookie_mac(key, from, cookie);
+    return sx_mem_cmp(cookie + 4, &mac, COOKIE_LEN - 4) != 0;
 }
 
 inline bool validate_player_id_range(const short id)
@@ -73,6 +107,23 @@ Player* lobby_get_player_validate_all(Server* server, const uint token, const sh
     return (player->token == token && player->room == room && player->index == index) ? player : null;
 }
 
+// compact packets are sent only by players in a room so the handle maps directly to the room slot.
+// the token of the session which owns the key is read before the key is checked
+Player* lobby_get_player_validate_key(Server* server, const ushort handle, const ushort key, uint* token)
+{
+    if (handle >= LOBBY_CAPACITY) return null;
+    Player* player = &server->lobby.players[handle];
+    *token = player->token;
+    return (*token > 0 && player->key == key && player->room >= 0 && player->index >= 0) ? player : null;
+}
+
+Player* lobby_get_player(Server* server, const short id)
+{
+    if (validate_player_id_range(id) == false) return null;
+    Player* player = &server->lobby.players[id];
+    return (player->token > 0) ? player : null;
+}
+
 Player* lobby_find_player_by_device(Server* server, const char* device)
 {
     for (short i = 0; i < LOBBY_CAPACITY; i++)
@@ -84,20 +135,30 @@ Player* lobby_find_player_by_device(Server* server, const char* device)
     return null;
 }
 
-Player* lobby_add_player(Server* server, const char* device, const byte* from, const uint token)
+Player* lobby_add_player(Server* server, const char* device, const byte* from, const uint token, const ushort key, const byte* secret)
 {
     for (short i = 0; i < LOBBY_CAPACITY; i++)
     {
         Player* player = &server->lobby.players[i];
         if (player->token > 0) continue;
 
-        sx_mem_copy(player->from, from, ADDRESS_LEN);
+        player_set_address(player, from);
         sx_mem_copy(player->device, device, DEVICE_LEN);
+        sx_mem_set(player->meta, 0, PLAYER_META_LEN);
         player->token = token;
+        player->key = key;
+        sx_mem_copy(player->secret, secret, SESSION_KEY_LEN);
+        player->secure = false;
         player->id = i;
         player->room = -1;
         player->index = -1;
         player->active_time = sx_time_now();
+        player->dropped = 0;
+        for (int r = 0; r < RATE_COUNT; r++)
+        {
+            player->buckets[r].tokens = server->config.rate_limits[r].burst * 1000;
+            player->buckets[r].time = player->active_time;
+        }
 
         server->lobby.count++;
         return player;
@@ -105,6 +166,17 @@ Player* lobby_add_player(Server* server, const char* device, const byte* from, c
     return null;
 }
 
+// a device which logs in again gets a new session so the token and the secret of the old one are useless
+void lobby_renew_player(Player* player, const byte* from, const uint token, const ushort key, const byte* secret)
+{
+    player_set_address(player, from);
+    player->secure = false;
+    player->token = token;
+    player->key = key;
+    sx_mem_copy(player->secret, secret, SESSION_KEY_LEN);
+    sx_atomic_store64(&player->active_time, sx_time_now());
+}
+
 void lobby_remove_player(Server* server, const short id)
 {
     if (validate_player_id_range(id) == false) return;
@@ -112,10 +184,96 @@ void lobby_remove_player(Server* server, const short id)
     Player* player = &server->lobby.players[id];
     if (is_player_not_loggedin(player)) return;
 
+    sx_timer_wheel_remove(&player->timer);
     player->token = 0;
     server->lobby.count--;
 }
 
+// listeners refresh the active time without lock so it may be a bit later than now
+bool player_is_active(Player* player, const ulong now, const ulong timeout)
+{
+    ulong active_time = sx_atomic_load64(&player->active_time);
+    return active_time >= now || sx_time_diff(now, active_time) < timeout;
+}
+
+// cheap check of the window before the tag is verified so replays never reach the cipher
+bool player_counter_is_stale(Player* player, const ulong counter)
+{
+    if (counter == 0 || counter + REPLAY_WINDOW <= sx_atomic_load64(&player->replay_top)) return true;
+    return sx_atomic_load64(&player->replay[counter % REPLAY_WINDOW]) >= counter;
+}
+
+// listeners open the packets of a player concurrently so every slot of the window is claimed by
+// a compare and swap. a counter is accepted once because the slots only grow
+bool player_accept_counter(Player* player, const ulong counter)
+{
+    ulong top = sx_atomic_load64(&player->replay_top);
+    if (counter == 0 || counter + REPLAY_WINDOW <= top) return false;
+
+    volatile ulong* slot = &player->replay[counter % REPLAY_WINDOW];
+    for (;;)
+    {
+        ulong seen = sx_atomic_load64(slot);
+        if (seen >= counter) return false;
+        if (sx_atomic_cas64(slot, seen, counter)) break;
+    }
+
+    while (top < counter && sx_atomic_cas64(&player->replay_top, top, counter) == false)
+        top = sx_atomic_load64(&player->replay_top);
+    return true;
+}
+
+// every write of the address holds the lock. listeners read it without lock so the first 8 bytes
+// which hold the family, port and IPv4 address are published last by a single store
+void player_set_address(Player* player, const byte* from)
+{
+    ulong address;
+    sx_mem_copy(&address, from, sizeof(ulong));
+    sx_mem_copy(player->from + sizeof(ulong), from + sizeof(ulong), ADDRESS_LEN - sizeof(ulong));
+    sx_atomic_store64((volatile ulong*)player->from, address);
+}
+
+// called without lock for validated packets. the active time only moves forward and the token of the
+// session is checked before each store so a slot which is reused by another session is left alone.
+// return true if the address has moved which is left to the caller to set under the lock
+bool player_refresh(Player* player, const uint token, const byte* from, const ulong now)
+{
+    ulong seen = sx_atomic_load64(&player->active_time);
+    while (seen < now && player->token == token)
+    {
+        if (sx_atomic_cas64(&player->active_time, seen, now)) break;
+        seen = sx_atomic_load64(&player->active_time);
+    }
+    return player->token == token && sx_mem_cmp(player->from, from, ADDRESS_LEN) != 0;
+}
+
+// take a packet from the token bucket of the player. the buckets are updated without lock so
+// concurrent packets of a player may pass a few more than the limit but never less
+bool player_rate_take(Server* server, Player* player, const byte kind, const ulong now)
+{
+    const RateLimit* limit = &server->config.rate_limits[kind];
+    if (limit->rate == 0) return true;
+
+    RateBucket* bucket = &player->buckets[kind];
+    if (now > bucket->time)
+    {
+        ulong tokens = bucket->tokens + sx_time_diff(now, bucket->time) * limit->rate;
+        ulong capacity = (ulong)limit->burst * 1000;
+        bucket->tokens = (uint)(tokens < capacity ? tokens : capacity);
+        bucket->time = now;
+    }
+
+    if (bucket->tokens >= 1000)
+    {
+        bucket->tokens -= 1000;
+        return true;
+    }
+
+    player->dropped++;
+    sx_atomic_inc64(&server->dropped[kind]);
+    return false;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //  ROOM
@@ -144,7 +302,7 @@ int room_find_free(Server* server)
 
 bool room_is_open(const Room* room, const ulong now)
 {
-    if (room->open_time == 0) return false;  // this means that the room is never openned!
+    if (room->open_time == 0) return false;  // this means that the room is never openned or closed by timer!
     if (room->open_timeout == 0) return true;
     return sx_time_diff(now, room->open_time) <= room->open_timeout;
 }
@@ -167,6 +325,11 @@ bool room_create(Server* server, Player* player, ulong timeout, byte* properties
     int roomid = room_find_empty(server);
     if (roomid < 0) return false;
     Room* room = &server->rooms[roomid];
+    room->master = -1;
+    room->state_version = 0;
+    room->state_size = 0;
+    room->log_seq = 0;
+    room->log_size = 0;
     room->open_time = sx_time_now();
     room->open_timeout = timeout;
     sx_mem_copy(room->properties, properties, ROOM_PROP_LEN);
@@ -218,52 +381,163 @@ void room_remove_player(Server* server, Player* player)
     {
         room->count--;
         room->players[player->index] = null;
+        if (room->master == player->index)
+            room->master = -1;
+
+        if (room->count < 1)
+        {
+            sx_timer_wheel_remove(&room->master_timer);
+            sx_timer_wheel_remove(&room->open_timer);
+        }
     }
     player->room = player->index = -1;
     player->flag = 0;
 }
 
-void room_check_master(Server* server, ulong now, const short roomid)
+bool room_check_master(Server* server, ulong now, const short roomid)
 {
     Room* room = &server->rooms[roomid];
-    if (room->count < 1) return;
+    if (room->count < 1) return false;
 
-    sx_trace();
+    sx_trace_at(SEGANX_TRACE_ROOM, SX_TRACE_HOT);
 
-    // find the current master
-    Player* current_master = null;
-    for (uint p = 0; p < ROOM_CAPACITY; p++)
+    // the master heartbeats faster than the other players so a short deadline detects its loss
+    uint master_timeout = server->config.master_heartbeat_timeout > 0 ? server->config.master_heartbeat_timeout : server->config.player_master_timeout;
+
+    // validate current master. a new master has a deadline from its election until its first heartbeat arrives
+    Player* current_master = validate_player_index_range(room->master) ? room->players[room->master] : null;
+    if (current_master != null && current_master->token > 0 &&
+        (player_is_active(current_master, now, master_timeout) || sx_time_diff(now, room->master_time) < master_timeout))
+        sx_return_at(SEGANX_TRACE_ROOM, SX_TRACE_HOT, false);
+
+    // validation failed so remove current master
+    sbyte last_master = room->master;
+    if (current_master != null)
+        sx_flag_rem(current_master->flag, FLAG_MASTER);
+    room->master = -1;
+
+    // find new master among the players which pinged in their normal cadence and prefer the most recently heard one
+    ulong master_active = 0;
+    for (sbyte p = 0; p < ROOM_CAPACITY; p++)
     {
         Player* player = room->players[p];
-        if (player == null || player->token < 1) continue;
-        if (sx_flag_has(player->flag, FLAG_MASTER))
+        if (player == null || player->token < 1 || p == last_master) continue;
+        ulong active_time = sx_atomic_load64(&player->active_time);
+        if (player_is_active(player, now, server->config.player_master_timeout) && (room->master < 0 || active_time > master_active))
         {
-            current_master = player;
-            break;
+            room->master = p;
+            master_active = active_time;
         }
     }
 
-    // validate current master
-    if (current_master != null && sx_time_diff(now, current_master->active_time) < server->config.player_master_timeout)
-        sx_return();
+    // the last master is only elected again if no one else is alive
+    if (room->master < 0 && current_master != null && current_master->token > 0 && player_is_active(current_master, now, server->config.player_master_timeout))
+        room->master = last_master;
 
-    // validation failed so remove current master
-    if (current_master != null)
-        sx_flag_rem(current_master->flag, FLAG_MASTER);
+    if (room->master >= 0)
+    {
+        sx_flag_add(room->players[room->master]->flag, FLAG_MASTER);
+        room->master_time = now;
+    }
 
-    // find new master 
-    for (uint p = 0; p < ROOM_CAPACITY; p++)
+    sx_return_at(SEGANX_TRACE_ROOM, SX_TRACE_HOT, room->master != last_master);
+}
+
+byte room_members(const Room* room)
+{
+    byte result = 0;
+    for (byte p = 0; p < ROOM_CAPACITY; p++)
+    {
+        Player* player = room->players[p];
+        if (player != null && player->token > 0)
+            sx_flag_add(result, 1 << p);
+    }
+    return result;
+}
+
+byte room_roster(const Room* room, RoomMember* dest)
+{
+    byte count = 0;
+    for (byte p = 0; p < ROOM_CAPACITY; p++)
     {
         Player* player = room->players[p];
         if (player == null || player->token < 1) continue;
-        if (sx_time_diff(now, player->active_time) < server->config.player_master_timeout)
-        {
-            sx_flag_add(player->flag, FLAG_MASTER);
-            break;
-        }
+        RoomMember* member = &dest[count++];
+        member->index = player->index;
+        member->flag = player->flag;
+        sx_mem_copy(member->meta, player->meta, PLAYER_META_LEN);
+    }
+    return count;
+}
+
+bool room_state_set(Room* room, const ushort key, const byte* data, const byte size)
+{
+    // find the current entry of the key. the entries are packed so the keys are copied instead of read in place
+    byte* entry = room->state;
+    byte* end = room->state + room->state_size;
+    while (entry < end)
+    {
+        ushort entry_key;
+        sx_mem_copy(&entry_key, entry, sizeof(ushort));
+        if (entry_key == key) break;
+        entry += sizeof(ushort) + 1 + entry[sizeof(ushort)];
+    }
+
+    uint old_size = (entry < end) ? sizeof(ushort) + 1 + entry[sizeof(ushort)] : 0;
+    uint new_size = (size > 0) ? sizeof(ushort) + 1 + size : 0;
+    if (room->state_size - old_size + new_size > ROOM_STATE_LEN) return false;
+
+    // remove the old entry and append the new one to keep the arena compact
+    if (old_size > 0)
+    {
+        sx_mem_move(entry, entry + old_size, (uint)(end - entry) - old_size);
+        room->state_size -= old_size;
     }
 
-    sx_return();
+    if (new_size > 0)
+    {
+        entry = room->state + room->state_size;
+        sx_mem_copy(entry, &key, sizeof(ushort));
+        entry[sizeof(ushort)] = size;
+        sx_mem_copy(entry + sizeof(ushort) + 1, data, size);
+        room->state_size += new_size;
+    }
+
+    room->state_version++;
+    return true;
+}
+
+// return true if the message is stored or it is a retry of a stored one
+bool room_log_add(Room* room, const Player* sender, const byte ack, const byte* data, const byte size)
+{
+    if (size > ROOM_LOG_DATA_LEN) return false;
+
+    // the sender retries until it receives the response so ignore duplicates of the same session
+    for (byte i = 0; i < room->log_size; i++)
+    {
+        const RoomLog* log = &room->logs[(ushort)(room->log_seq - 1 - i) % ROOM_LOG_COUNT];
+        if (log->ack == ack && log->id == sender->id && log->token == sender->token) return true;
+    }
+
+    RoomLog* log = &room->logs[room->log_seq % ROOM_LOG_COUNT];
+    log->sender = sender->index;
+    log->id = sender->id;
+    log->token = sender->token;
+    log->ack = ack;
+    log->datasize = size;
+    sx_mem_copy(log->data, data, size);
+
+    room->log_seq++;
+    if (room->log_size < ROOM_LOG_COUNT)
+        room->log_size++;
+    return true;
+}
+
+const RoomLog* room_log_get(const Room* room, const ushort seq)
+{
+    ushort distance = room->log_seq - seq;
+    if (distance < 1 || distance > room->log_size) return null;
+    return &room->logs[seq % ROOM_LOG_COUNT];
 }
 
 void room_report(Server* server, int roomid)
@@ -283,5 +557,5 @@ void room_report(Server* server, int roomid)
 
 void player_report(Player* player)
 {
-    sx_print("Player flag[%d] token[%u] time[%llu] device:%.32s", player->flag, player->token, player->active_time, player->device);
+    sx_print("Player flag[%d] token[%u] time[%llu] dropped[%u] device:%.32s", player->flag, player->token, player->active_time, player->dropped, player->device);
 }
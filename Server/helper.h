@@ -3,8 +3,13 @@
 #include "server.h"
 #include "core/timer.h"
 
-uint    checksum_compute(const byte* buffer, const uint len);
-bool    checksum_is_invalid(const byte* buffer, const uint len, const uint checksum);
+extern const byte mac_login_key[SESSION_KEY_LEN];
+
+uint    mac_compute(const byte* key, const byte* buffer, const uint len);
+bool    mac_is_invalid(const byte* key, const byte* buffer, const uint len, const uint mac);
+
+void    cookie_compute(const byte* key, const byte* from, const ulong now, byte* dest);
+bool    cookie_is_invalid(const byte* key, const byte* from, const ulong now, const byte* cookie);
 
 bool    validate_player_id_range(const short id);
 bool    validate_player_room_id_range(const short roomid);
@@ -18,16 +23,32 @@ bool    is_player_not_joined_room(const Player* player);
 
 Player* lobby_get_player_validate_token(Server* server, const uint token, const short id);
 Player* lobby_get_player_validate_all(Server* server, const uint token, const short id, const short room, const sbyte index);
+Player* lobby_get_player_validate_key(Server* server, const ushort handle, const ushort key, uint* token);
+Player* lobby_get_player(Server* server, const short id);
 Player* lobby_find_player_by_device(Server* server, const char* device);
-Player* lobby_add_player(Server* server, const char* device, const byte* from, const uint token);
+Player* lobby_add_player(Server* server, const char* device, const byte* from, const uint token, const ushort key, const byte* secret);
+void    lobby_renew_player(Player* player, const byte* from, const uint token, const ushort key, const byte* secret);
 void    lobby_remove_player(Server* server, const short id);
 
+bool    player_is_active(Player* player, const ulong now, const ulong timeout);
+void    player_set_address(Player* player, const byte* from);
+bool    player_refresh(Player* player, const uint token, const byte* from, const ulong now);
+bool    player_counter_is_stale(Player* player, const ulong counter);
+bool    player_accept_counter(Player* player, const ulong counter);
+bool    player_rate_take(Server* server, Player* player, const byte kind, const ulong now);
+
 bool    room_create(Server* server, Player* player, ulong timeout, byte* properties, sint* matchmaking);
+bool    room_is_match(Room* room, int* params);
 bool    room_join(Server* server, Player* player, int* params);
 
 bool    room_add_player(Server* server, Player* player, const short roomid);
 void    room_remove_player(Server* server, Player* player);
-void    room_check_master(Server* server, ulong now, const short roomid);
+bool    room_check_master(Server* server, ulong now, const short roomid);
+byte    room_members(const Room* room);
+byte    room_roster(const Room* room, RoomMember* dest);
+bool    room_state_set(Room* room, const ushort key, const byte* data, const byte size);
+bool    room_log_add(Room* room, const Player* sender, const byte ack, const byte* data, const byte size);
+const RoomLog* room_log_get(const Room* room, const ushort seq);
 void    room_report(Server* server, int roomid);
 
 void    player_report(Player* player);
@@ -0,0 +1,237 @@
+#include "metrics.h"
+#include "net/socket.h"
+#include "core/memory.h"
+#include "core/trace.h"
+#include "core/timer.h"
+#include "core/log.h"
+#include "core/string.h"
+#include "core/platform.h"
+
+extern Server server;
+
+static Metrics* metrics_slots = null;
+static Metrics metrics_discard = { 0 };
+static double metrics_cycles_per_second = 1000000000.0;
+
+#if defined(_WIN32)
+__declspec(thread) Metrics* metrics_thread = &metrics_discard;
+#else
+__thread Metrics* metrics_thread = &metrics_discard;
+#endif
+
+ulong metrics_edges[METRICS_BUCKETS - 1] = { 0 };
+static const char* metrics_bounds[METRICS_BUCKETS - 1] = {
+    "0.000001", "0.0000025", "0.000005", "0.00001", "0.000025", "0.00005",
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.01"
+};
+
+static const struct { byte type; const char* name; } metrics_types[] = {
+    { TYPE_PING, "ping" },
+    { TYPE_LOGIN, "login" },
+    { TYPE_LOGOUT, "logout" },
+    { TYPE_CREATE, "create" },
+    { TYPE_JOIN, "join" },
+    { TYPE_LEAVE, "leave" },
+    { TYPE_PACKET_UNRELY, "packet_unreliable" },
+    { TYPE_PACKET_RELY, "packet_reliable" },
+    { TYPE_PACKET_RELIED, "packet_relied" },
+    { TYPE_PACKET_PERSIST, "packet_persist" },
+    { TYPE_PACKET_LOG, "packet_log" },
+    { TYPE_COMPACT_UNRELY, "compact_unreliable" },
+    { TYPE_COMPACT_RELY, "compact_reliable" },
+    { TYPE_COMPACT_RELIED, "compact_relied" },
+    { TYPE_PACKET_FRAGMENT, "fragment" },
+    { TYPE_STATE_SET, "state_set" },
+    { TYPE_STATE_SNAPSHOT, "state_snapshot" },
+};
+
+static const char* metrics_errors[METRICS_ERRORS] = {
+    null, "invalid", "expired", "is_full", "matchmake", "cookie", null, null
+};
+
+typedef struct MetricsText
+{
+    char*   data;
+    uint    size;
+    uint    capacity;
+}
+MetricsText;
+
+void metrics_init(void)
+{
+    sx_trace();
+
+    metrics_slots = (Metrics*)sx_mem_calloc(THREAD_COUNTS * sizeof(Metrics));
+
+    // handling times are recorded in cycles of the cpu so find out how fast they count
+    ulong start_ns = sx_time_now_ns();
+    ulong start_cycles = sx_get_cycles();
+    sx_sleep(50);
+    ulong elapsed = sx_time_now_ns() - start_ns;
+    if (elapsed > 0)
+        metrics_cycles_per_second = (double)(sx_get_cycles() - start_cycles) * 1000000000.0 / elapsed;
+
+    static const double bounds[METRICS_BUCKETS - 1] = { 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 10000 };
+    for (int i = 0; i < METRICS_BUCKETS - 1; i++)
+        metrics_edges[i] = (ulong)(bounds[i] * metrics_cycles_per_second / 1000000.0);
+
+    sx_return();
+}
+
+void metrics_shutdown(void)
+{
+    sx_mem_free(metrics_slots);
+    metrics_slots = null;
+}
+
+void metrics_attach(const uint slot)
+{
+    if (metrics_slots != null && slot < THREAD_COUNTS)
+        metrics_thread = &metrics_slots[slot];
+}
+
+static void metrics_print(MetricsText* text, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    uint len = sx_vsprintf_len(format, args);
+    va_end(args);
+
+    if (text->size + len > text->capacity)
+    {
+        while (text->size + len > text->capacity) text->capacity *= 2;
+        text->data = (char*)sx_mem_realloc(text->data, text->capacity);
+    }
+
+    va_start(args, format);
+    sx_vsprintf(text->data + text->size, len, format, args);
+    va_end(args);
+    text->size += len - 1;
+}
+
+// counters of the listeners are summed without any lock so the packets in flight may be missed
+static void metrics_collect(Metrics* total)
+{
+    sx_mem_set(total, 0, sizeof(Metrics));
+    for (int i = 0; i < THREAD_COUNTS; i++)
+    {
+        const Metrics* metrics = &metrics_slots[i];
+        for (int t = 0; t < 256; t++)
+        {
+            total->received[t] += metrics->received[t];
+            total->time_sum[t] += metrics->time_sum[t];
+            for (int b = 0; b < METRICS_BUCKETS; b++)
+                total->times[t][b] += metrics->times[t][b];
+        }
+        total->bytes_in += metrics->bytes_in;
+        total->bytes_out += metrics->bytes_out;
+        total->packets_in += metrics->packets_in;
+        total->packets_out += metrics->packets_out;
+        for (int e = 0; e < METRICS_ERRORS; e++)
+            total->errors[e] += metrics->errors[e];
+        total->invalid += metrics->invalid;
+        total->locks += metrics->locks;
+        total->lock_wait += metrics->lock_wait;
+    }
+}
+
+static void metrics_write(MetricsText* text)
+{
+    Metrics* total = (Metrics*)sx_mem_alloc(sizeof(Metrics));
+    metrics_collect(total);
+
+    const uint types = sizeof(metrics_types) / sizeof(metrics_types[0]);
+
+    metrics_print(text, "# HELP radio_packets_received_total Packets handled by the listeners.\n# TYPE radio_packets_received_total counter\n");
+    for (uint i = 0; i < types; i++)
+        metrics_print(text, "radio_packets_received_total{type=\"%s\"} %llu\n", metrics_types[i].name, total->received[metrics_types[i].type]);
+
+    metrics_print(text, "# HELP radio_handle_seconds Time of handling a packet from the MAC check to the last send.\n# TYPE radio_handle_seconds histogram\n");
+    for (uint i = 0; i < types; i++)
+    {
+        const byte type = metrics_types[i].type;
+        if (total->received[type] == 0) continue;
+
+        ulong count = 0;
+        for (int b = 0; b < METRICS_BUCKETS - 1; b++)
+        {
+            count += total->times[type][b];
+            metrics_print(text, "radio_handle_seconds_bucket{type=\"%s\",le=\"%s\"} %llu\n", metrics_types[i].name, metrics_bounds[b], count);
+        }
+        count += total->times[type][METRICS_BUCKETS - 1];
+        metrics_print(text, "radio_handle_seconds_bucket{type=\"%s\",le=\"+Inf\"} %llu\n", metrics_types[i].name, count);
+        metrics_print(text, "radio_handle_seconds_sum{type=\"%s\"} %.9f\n", metrics_types[i].name, total->time_sum[type] / metrics_cycles_per_second);
+        metrics_print(text, "radio_handle_seconds_count{type=\"%s\"} %llu\n", metrics_types[i].name, count);
+    }
+
+    metrics_print(text, "# HELP radio_thread_packets_received_total Packets received by each listener.\n# TYPE radio_thread_packets_received_total counter\n");
+    for (int i = 1; i < THREAD_COUNTS; i++)
+        metrics_print(text, "radio_thread_packets_received_total{thread=\"%d\"} %llu\n", i, metrics_slots[i].packets_in);
+
+    metrics_print(text, "# TYPE radio_packets_total counter\n");
+    metrics_print(text, "radio_packets_total{direction=\"in\"} %llu\n", total->packets_in);
+    metrics_print(text, "radio_packets_total{direction=\"out\"} %llu\n", total->packets_out);
+    metrics_print(text, "# TYPE radio_bytes_total counter\n");
+    metrics_print(text, "radio_bytes_total{direction=\"in\"} %llu\n", total->bytes_in);
+    metrics_print(text, "radio_bytes_total{direction=\"out\"} %llu\n", total->bytes_out);
+
+    metrics_print(text, "# HELP radio_errors_total Error responses sent to clients.\n# TYPE radio_errors_total counter\n");
+    for (int e = 1; e < METRICS_ERRORS; e++)
+        if (metrics_errors[e] != null)
+            metrics_print(text, "radio_errors_total{error=\"%s\"} %llu\n", metrics_errors[e], total->errors[e]);
+
+    metrics_print(text, "# HELP radio_dropped_total Packets dropped before they are handled.\n# TYPE radio_dropped_total counter\n");
+    metrics_print(text, "radio_dropped_total{reason=\"rate_unreliable\"} %llu\n", sx_atomic_load64(&server.dropped[RATE_UNRELIABLE]));
+    metrics_print(text, "radio_dropped_total{reason=\"rate_reliable\"} %llu\n", sx_atomic_load64(&server.dropped[RATE_RELIABLE]));
+    metrics_print(text, "radio_dropped_total{reason=\"rate_fragment\"} %llu\n", sx_atomic_load64(&server.dropped[RATE_FRAGMENT]));
+    metrics_print(text, "radio_dropped_total{reason=\"shield\"} %llu\n", sx_atomic_load64(&server.shielded));
+    metrics_print(text, "radio_dropped_total{reason=\"invalid\"} %llu\n", total->invalid);
+    metrics_print(text, "# HELP radio_log_dropped_total Log messages dropped because the ring of the logger was full.\n# TYPE radio_log_dropped_total counter\n");
+    metrics_print(text, "radio_log_dropped_total %llu\n", sx_log_dropped());
+
+#if METRICS_LOCK_WAIT
+    metrics_print(text, "# HELP radio_lock_wait_seconds_total Time spent waiting for the lock of the server.\n# TYPE radio_lock_wait_seconds_total counter\n");
+    metrics_print(text, "radio_lock_wait_seconds_total %.9f\n", total->lock_wait / metrics_cycles_per_second);
+    metrics_print(text, "# TYPE radio_lock_acquisitions_total counter\n");
+    metrics_print(text, "radio_lock_acquisitions_total %llu\n", total->locks);
+#endif
+
+    uint rooms = 0;
+    for (uint r = 0; r < ROOM_COUNT; r++)
+        if (server.rooms[r].count > 0) rooms++;
+    metrics_print(text, "# TYPE radio_players gauge\nradio_players %u\n", server.lobby.count);
+    metrics_print(text, "# TYPE radio_rooms gauge\nradio_rooms %u\n", rooms);
+
+    sx_mem_free(total);
+}
+
+void thread_metrics(void* param)
+{
+    sx_trace_attach(64, "trace_metrics.txt");
+    sx_trace();
+
+    uint listener = sx_socket_listen(server.config.metrics_port);
+    while (listener > 0)
+    {
+        uint client = sx_socket_accept(listener, METRICS_TIMEOUT);
+        if (client == 0) continue;
+
+        // every path serves the metrics so the request is read only to let the client finish sending it
+        char request[1024];
+        sx_socket_read(client, request, sizeof(request));
+
+        MetricsText text = { null, 0, 64 * 1024 };
+        text.data = (char*)sx_mem_alloc(text.capacity);
+        metrics_write(&text);
+
+        char header[128] = { 0 };
+        sx_sprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\n\r\n", text.size);
+        if (sx_socket_write(client, header, (int)sx_str_len(header)))
+            sx_socket_write(client, text.data, text.size);
+
+        sx_mem_free(text.data);
+        sx_socket_close(client);
+    }
+
+    sx_trace_detach();
+}
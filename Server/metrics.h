@@ -0,0 +1,91 @@
+#pragma once
+
+#include "server.h"
+#include "core/platform.h"
+
+#define METRICS_BUCKETS     13      //  handling times from 1us to 10ms and the rest
+#define METRICS_ERRORS      8       //  errors are indexed by the negative of the error code
+#define METRICS_TIMEOUT     2000    //  milliseconds a scraper may stall reading or writing before it is dropped
+
+// the wait for the lock of the server reads the clock twice on every lock so it is built only for
+// diagnostics, like cmake -DCMAKE_C_FLAGS="-DMETRICS_LOCK_WAIT=1"
+#ifndef METRICS_LOCK_WAIT
+#define METRICS_LOCK_WAIT   0
+#endif
+
+// counters are written only by the owner thread and summed on read, so the hot path
+// has no atomic operations and no shared cache lines
+typedef struct Metrics
+{
+    ulong   received[256];                  //  handled packets of each type
+    ulong   times[256][METRICS_BUCKETS];    //  handling times of each type
+    ulong   time_sum[256];                  //  cycles
+    ulong   bytes_in;
+    ulong   bytes_out;
+    ulong   packets_in;
+    ulong   packets_out;
+    ulong   errors[METRICS_ERRORS];
+    ulong   invalid;                        //  packets dropped by the MAC or the seal checks
+    ulong   locks;
+    ulong   lock_wait;                      //  cycles
+    byte    pad[64];                        //  keep the counters of neighbour threads in separate cache lines
+}
+Metrics;
+
+// metrics of the current thread which points to a discarded slot until the thread is attached
+#if defined(_WIN32)
+extern __declspec(thread) Metrics* metrics_thread;
+#else
+extern __thread Metrics* metrics_thread;
+#endif
+
+extern ulong metrics_edges[METRICS_BUCKETS - 1];    //  upper bounds of the buckets in cycles
+
+void    metrics_init(void);
+void    metrics_shutdown(void);
+
+// bind the metrics of the slot to the current thread
+void    metrics_attach(const uint slot);
+
+// serve the metrics in the text format of Prometheus on the port of the loopback address
+void    thread_metrics(void* param);
+
+static inline void metrics_received(const sint size)
+{
+    metrics_thread->packets_in++;
+    metrics_thread->bytes_in += size;
+}
+
+static inline void metrics_sent(const sint size)
+{
+    metrics_thread->packets_out++;
+    metrics_thread->bytes_out += size;
+}
+
+static inline void metrics_error(const sbyte error)
+{
+    if (error < 0 && error > -METRICS_ERRORS)
+        metrics_thread->errors[-error]++;
+}
+
+static inline void metrics_invalid(void)
+{
+    metrics_thread->invalid++;
+}
+
+static inline void metrics_lock(const ulong cycles)
+{
+    metrics_thread->locks++;
+    metrics_thread->lock_wait += cycles;
+}
+
+static inline void metrics_handled(const byte type, const ulong cycles)
+{
+    Metrics* metrics = metrics_thread;
+    metrics->received[type]++;
+    metrics->time_sum[type] += cycles;
+
+    uint bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && cycles > metrics_edges[bucket]) bucket++;
+    metrics->times[type][bucket]++;
+}
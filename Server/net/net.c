@@ -182,4 +182,34 @@ SEGAN_LIB_API char* sx_net_error_string(const sint code)
 	}
 }
 
+#else
+
+#include "net.h"
+#include "../core/trace.h"
+#include "../core/platform.h"
+
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////////
+//	network functions
+//////////////////////////////////////////////////////////////////////////
+SEGAN_LIB_API bool sx_net_initialize()
+{
+	sx_trace();
+	sx_print("Network system initialized successfully.");
+	sx_return( true );
+}
+
+SEGAN_LIB_API void sx_net_finalize( void )
+{
+	sx_trace();
+	sx_print("Network system Finalized.");
+	sx_return();
+}
+
+SEGAN_LIB_API char* sx_net_error_string(const sint code)
+{
+	return strerror((int)code);
+}
+
 #endif
@@ -4,6 +4,7 @@
 #include "socket.h"
 #include "../core/platform.h"
 #include "../core/trace.h"
+#include "../core/log.h"
 #include "../core/memory.h"
 #include <winsock2.h>
 #pragma comment( lib, "ws2_32.lib" )
@@ -21,7 +22,7 @@ SEGAN_LIB_API uint sx_socket_open(const ushort port, const bool bindtoport, cons
 
     if (result == INVALID_SOCKET)
     {
-        sx_print("Error: Can't initialize socket. error code : %s !", sx_net_error_string(WSAGetLastError()));
+        sx_log("Error: Can't initialize socket. error code : %s !", sx_net_error_string(WSAGetLastError()));
         sx_return(0);
     }
 
@@ -30,7 +31,7 @@ SEGAN_LIB_API uint sx_socket_open(const ushort port, const bool bindtoport, cons
         // make it broadcast capable
         int i = 1;
         if (setsockopt(result, SOL_SOCKET, SO_BROADCAST, (char*)&i, sizeof(i)) == SOCKET_ERROR)
-            sx_print("Error: Unable to make socket broadcast! error code : %s !", sx_net_error_string(WSAGetLastError()));
+            sx_log("Error: Unable to make socket broadcast! error code : %s !", sx_net_error_string(WSAGetLastError()));
     }
 
     if (bindtoport)
@@ -41,22 +42,34 @@ SEGAN_LIB_API uint sx_socket_open(const ushort port, const bool bindtoport, cons
         address.sin_addr.s_addr = INADDR_ANY;
         address.sin_port = htons(port);
         if (bind(result, (const struct sockaddr*)&address, sizeof(struct sockaddr_in)) == SOCKET_ERROR)
-            sx_print("Error: Unable to bind socket! error code : %s !", sx_net_error_string(WSAGetLastError()));
+            sx_log("Error: Unable to bind socket! error code : %s !", sx_net_error_string(WSAGetLastError()));
     }
 
     // make non-blocking socket
     //DWORD nonBlocking = 1;
     //if ( ioctlsocket( result, FIONBIO, &nonBlocking ) == SOCKET_ERROR )
     //{
-    //	sx_print( "Error: Unable to make non-blocking socket! error code : %s !", sx_net_error_string( WSAGetLastError() ) );
+    //	sx_log( "Error: Unable to make non-blocking socket! error code : %s !", sx_net_error_string( WSAGetLastError() ) );
     //	sx_socket_close( result );
     //	sx_return(0);
     //}
 
-    sx_print("Info: Socket has been opened on port : %d", port);
+    if (bindtoport && port)
+        sx_log("Info: Socket has been opened on port : %d", port);
     sx_return(result);
 }
 
+SEGAN_LIB_API bool sx_socket_set_nonblocking(uint socket)
+{
+    u_long nonBlocking = 1;
+    if (ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR)
+    {
+        sx_log("Error: Unable to make non-blocking socket! error code : %s !", sx_net_error_string(WSAGetLastError()));
+        return false;
+    }
+    return true;
+}
+
 SEGAN_LIB_API void sx_socket_close(uint socket)
 {
     if (!socket) return;
@@ -66,7 +79,7 @@ SEGAN_LIB_API void sx_socket_close(uint socket)
 SEGAN_LIB_API bool sx_socket_send(uint socket, const uint ip, const ushort port, const void* buffer, const int size)
 {
     sx_assert(socket || buffer || size > 0);
-    sx_trace();
+    sx_trace_at(SEGANX_TRACE_NET, SX_TRACE_HOT);
 
     struct sockaddr_in address = { 0 };
     address.sin_family = AF_INET;
@@ -74,28 +87,255 @@ SEGAN_LIB_API bool sx_socket_send(uint socket, const uint ip, const ushort port,
     address.sin_addr.s_addr = ip;
 
     int sentBytes = sendto(socket, (char*)buffer, size, 0, (struct sockaddr*)&address, sizeof(address));
-    sx_return(sentBytes == size);
+    sx_return_at(SEGANX_TRACE_NET, SX_TRACE_HOT, sentBytes == size);
 }
 
 SEGAN_LIB_API bool sx_socket_send_in(uint socket, const struct sockaddr* address, const void* buffer, const int size)
 {
     sx_assert(socket || buffer || size > 0);
-    sx_trace();
+    sx_trace_at(SEGANX_TRACE_NET, SX_TRACE_HOT);
     int sentBytes = sendto(socket, (char*)buffer, size, 0, address, sizeof(struct sockaddr_in));
-    sx_return(sentBytes == size);
+    sx_return_at(SEGANX_TRACE_NET, SX_TRACE_HOT, sentBytes == size);
 }
 
 SEGAN_LIB_API sint sx_socket_receive(uint socket, void* buffer, const int size, struct sockaddr* from)
 {
     sx_assert(socket || buffer || size > 0);
-    sx_trace();
+    sx_trace_at(SEGANX_TRACE_NET, SX_TRACE_HOT);
 
     int fromlen = sizeof(struct sockaddr_in);
     uint receivedBytes = 0;
     receivedBytes = recvfrom(socket, (char*)buffer, size, 0, from, &fromlen);
 
-    sx_return(receivedBytes <= 0 ? 0 : receivedBytes);
+    sx_return_at(SEGANX_TRACE_NET, SX_TRACE_HOT, receivedBytes <= 0 ? 0 : receivedBytes);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//	stream socket implementation
+//////////////////////////////////////////////////////////////////////////
+
+SEGAN_LIB_API uint sx_socket_listen(const ushort port)
+{
+    uint result = (uint)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (result == INVALID_SOCKET)
+    {
+        sx_log("Error: Can't initialize socket. error code : %s !", sx_net_error_string(WSAGetLastError()));
+        return 0;
+    }
+
+    int i = 1;
+    setsockopt(result, SOL_SOCKET, SO_REUSEADDR, (char*)&i, sizeof(i));
+
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(result, (const struct sockaddr*)&address, sizeof(struct sockaddr_in)) == SOCKET_ERROR || listen(result, 8) == SOCKET_ERROR)
+    {
+        sx_log("Error: Unable to listen on port %d! error code : %s !", port, sx_net_error_string(WSAGetLastError()));
+        closesocket(result);
+        return 0;
+    }
+
+    sx_log("Info: Socket is listening on port : %d", port);
+    return result;
+}
+
+SEGAN_LIB_API uint sx_socket_accept(uint socket, const uint timeout)
+{
+    SOCKET result = accept(socket, null, null);
+    if (result == INVALID_SOCKET) return 0;
+
+    DWORD ms = timeout;
+    setsockopt(result, SOL_SOCKET, SO_RCVTIMEO, (char*)&ms, sizeof(ms));
+    setsockopt(result, SOL_SOCKET, SO_SNDTIMEO, (char*)&ms, sizeof(ms));
+    return (uint)result;
+}
+
+SEGAN_LIB_API sint sx_socket_read(uint socket, void* buffer, const int size)
+{
+    int res = recv(socket, (char*)buffer, size, 0);
+    return res <= 0 ? 0 : res;
+}
+
+SEGAN_LIB_API bool sx_socket_write(uint socket, const void* buffer, const int size)
+{
+    const char* data = (const char*)buffer;
+    int remain = size;
+    while (remain > 0)
+    {
+        int res = send(socket, data, remain, 0);
+        if (res <= 0) return false;
+        data += res;
+        remain -= res;
+    }
+    return true;
 }
 
 
+#else
+
+#include "net.h"
+#include "socket.h"
+#include "../core/platform.h"
+#include "../core/trace.h"
+#include "../core/log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+//////////////////////////////////////////////////////////////////////////
+//	socket implementation
+//////////////////////////////////////////////////////////////////////////
+
+SEGAN_LIB_API uint sx_socket_open(const ushort port, const bool bindtoport, const bool broadcast)
+{
+    sx_trace();
+
+    int result = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (result < 0)
+    {
+        sx_log("Error: Can't initialize socket. error code : %s !", sx_net_error_string(errno));
+        sx_return(0);
+    }
+
+    if (broadcast)
+    {
+        int i = 1;
+        if (setsockopt(result, SOL_SOCKET, SO_BROADCAST, &i, sizeof(i)) < 0)
+            sx_log("Error: Unable to make socket broadcast! error code : %s !", sx_net_error_string(errno));
+    }
+
+    if (bindtoport)
+    {
+        struct sockaddr_in address = { 0 };
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port);
+        if (bind(result, (const struct sockaddr*)&address, sizeof(struct sockaddr_in)) < 0)
+            sx_log("Error: Unable to bind socket! error code : %s !", sx_net_error_string(errno));
+    }
+
+    if (bindtoport && port)
+        sx_log("Info: Socket has been opened on port : %d", port);
+    sx_return((uint)result);
+}
+
+SEGAN_LIB_API bool sx_socket_set_nonblocking(uint socket)
+{
+    int flags = fcntl((int)socket, F_GETFL, 0);
+    if (flags < 0 || fcntl((int)socket, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        sx_log("Error: Unable to make non-blocking socket! error code : %s !", sx_net_error_string(errno));
+        return false;
+    }
+    return true;
+}
+
+SEGAN_LIB_API void sx_socket_close(uint socket)
+{
+    if (!socket) return;
+    close((int)socket);
+}
+
+SEGAN_LIB_API bool sx_socket_send(uint socket, const uint ip, const ushort port, const void* buffer, const int size)
+{
+    sx_assert(socket || buffer || size > 0);
+    sx_trace_at(SEGANX_TRACE_NET, SX_TRACE_HOT);
+
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = (in_addr_t)ip;
+
+    ssize_t sentBytes = sendto((int)socket, buffer, size, 0, (struct sockaddr*)&address, sizeof(address));
+    sx_return_at(SEGANX_TRACE_NET, SX_TRACE_HOT, sentBytes == size);
+}
+
+SEGAN_LIB_API bool sx_socket_send_in(uint socket, const struct sockaddr* address, const void* buffer, const int size)
+{
+    sx_assert(socket || buffer || size > 0);
+    sx_trace_at(SEGANX_TRACE_NET, SX_TRACE_HOT);
+    ssize_t sentBytes = sendto((int)socket, buffer, size, 0, address, sizeof(struct sockaddr_in));
+    sx_return_at(SEGANX_TRACE_NET, SX_TRACE_HOT, sentBytes == size);
+}
+
+SEGAN_LIB_API sint sx_socket_receive(uint socket, void* buffer, const int size, struct sockaddr* from)
+{
+    sx_assert(socket || buffer || size > 0);
+    sx_trace_at(SEGANX_TRACE_NET, SX_TRACE_HOT);
+
+    socklen_t fromlen = sizeof(struct sockaddr_in);
+    ssize_t receivedBytes = recvfrom((int)socket, buffer, size, 0, from, &fromlen);
+
+    sx_return_at(SEGANX_TRACE_NET, SX_TRACE_HOT, receivedBytes <= 0 ? 0 : (sint)receivedBytes);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//	stream socket implementation
+//////////////////////////////////////////////////////////////////////////
+
+SEGAN_LIB_API uint sx_socket_listen(const ushort port)
+{
+    int result = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (result < 0)
+    {
+        sx_log("Error: Can't initialize socket. error code : %s !", sx_net_error_string(errno));
+        return 0;
+    }
+
+    int i = 1;
+    setsockopt(result, SOL_SOCKET, SO_REUSEADDR, &i, sizeof(i));
+
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(result, (const struct sockaddr*)&address, sizeof(struct sockaddr_in)) < 0 || listen(result, 8) < 0)
+    {
+        sx_log("Error: Unable to listen on port %d! error code : %s !", port, sx_net_error_string(errno));
+        close(result);
+        return 0;
+    }
+
+    sx_log("Info: Socket is listening on port : %d", port);
+    return (uint)result;
+}
+
+SEGAN_LIB_API uint sx_socket_accept(uint socket, const uint timeout)
+{
+    int result = accept((int)socket, null, null);
+    if (result < 0) return 0;
+
+    struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+    setsockopt(result, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(result, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return (uint)result;
+}
+
+SEGAN_LIB_API sint sx_socket_read(uint socket, void* buffer, const int size)
+{
+    ssize_t res = recv((int)socket, buffer, size, 0);
+    return res <= 0 ? 0 : (sint)res;
+}
+
+SEGAN_LIB_API bool sx_socket_write(uint socket, const void* buffer, const int size)
+{
+    const char* data = (const char*)buffer;
+    int remain = size;
+    while (remain > 0)
+    {
+        ssize_t res = send((int)socket, data, remain, MSG_NOSIGNAL);
+        if (res <= 0) return false;
+        data += res;
+        remain -= (int)res;
+    }
+    return true;
+}
+
 #endif
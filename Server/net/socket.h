@@ -15,6 +15,8 @@
 
 #include "net.h"
 
+struct sockaddr;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,6 +25,9 @@ extern "C" {
 //! open a UPD socket and bind it to the specified port
 SEGAN_LIB_API uint sx_socket_open(const ushort port, const bool bind, const bool broadcast);
 
+//! make the socket non-blocking so receive returns zero when no packet is pending
+SEGAN_LIB_API bool sx_socket_set_nonblocking(uint socket);
+
 //! close opened socket
 SEGAN_LIB_API void sx_socket_close(uint socket);
 
@@ -34,6 +39,19 @@ SEGAN_LIB_API bool sx_socket_send_in(uint socket, const struct sockaddr* address
 //! pick up data on the port and fill out address of sender
 SEGAN_LIB_API sint sx_socket_receive( uint socket, void* buffer, const int size, struct sockaddr* from );
 
+//! open a TCP socket listening on the port of the loopback address
+SEGAN_LIB_API uint sx_socket_listen(const ushort port);
+
+//! wait for a connection on the listening socket and return the connected socket or zero on failure.
+//! reads and writes of the connection fail after the timeout in milliseconds
+SEGAN_LIB_API uint sx_socket_accept(uint socket, const uint timeout);
+
+//! read the received data of a connected socket and return its size or zero if the connection is closed
+SEGAN_LIB_API sint sx_socket_read(uint socket, void* buffer, const int size);
+
+//! write all data to a connected socket
+SEGAN_LIB_API bool sx_socket_write(uint socket, const void* buffer, const int size);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -11,10 +11,35 @@
 #include "core/timer.h"
 #include "core/platform.h"
 #include "core/Json.h"
+#include "core/crypto.h"
+#include "core/sketch.h"
+#include "core/histogram.h"
+#include "core/log.h"
+#include "metrics.h"
+
+#if defined(_WIN32)
 #include <windows.h>
+#endif
 
 Server server = { 0 };
 
+// the player who sealed the packet which is being processed by the current thread
+#if defined(_WIN32)
+__declspec(thread) const Player* s_sealer = null;
+__declspec(thread) const byte* s_sealer_from = null;
+#else
+static __thread const Player* s_sealer = null;
+static __thread const byte* s_sealer_from = null;
+#endif
+
+// take the lock of the server and count the wait in the metrics of the thread if METRICS_LOCK_WAIT is built.
+// it is a macro so the lock profiler sees the handler which takes the lock
+#if METRICS_LOCK_WAIT
+#define server_lock()       { ulong lock_start = sx_get_cycles(); sx_mutex_lock(server.mutex); metrics_lock(sx_get_cycles() - lock_start); }
+#else
+#define server_lock()       sx_mutex_lock(server.mutex)
+#endif
+
 uint server_get_token()
 {
     uint result;
@@ -24,12 +49,43 @@ uint server_get_token()
     return result;
 }
 
+// the key validates compact packets so it must not be predictable like the token
+ushort server_get_key()
+{
+    uint x = server.token ^ (uint)sx_get_tick() ^ 0x9E3779B9;
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return (ushort)x > 0 ? (ushort)x : 1;
+}
+
+void server_get_secret(byte* dest)
+{
+    if (sx_random(dest, SESSION_KEY_LEN)) return;
+
+    // the system has no random source so derive the key from the clock
+    for (uint i = 0; i < SESSION_KEY_LEN; i += sizeof(ushort))
+    {
+        ushort key = server_get_key();
+        sx_mem_copy(dest + i, &key, sizeof(ushort));
+    }
+}
+
 void server_init()
 {
     sx_trace();
     sx_mem_set(&server, 0, sizeof(Server));
     server.token = 654987;
     server.mutex = sx_mutex_create();
+    server.timers = sx_timer_wheel_create(sx_time_update(), TICKER_INTERVAL);
+    server.shield = sx_sketch_create();
+    metrics_init();
+    server.probes = (sx_histogram*)sx_mem_calloc(THREAD_COUNTS * sizeof(sx_histogram));
+    for (int i = 0; i < THREAD_COUNTS; i++)
+        sx_histogram_reset(&server.probes[i]);
+    server_get_secret(server.cookie_key);
     sx_return();
 }
 
@@ -37,6 +93,10 @@ void server_shutdown(void)
 {
     sx_trace();
     sx_socket_close(server.socket);
+    sx_timer_wheel_destroy(server.timers);
+    sx_sketch_destroy(server.shield);
+    sx_mem_free(server.probes);
+    metrics_shutdown();
     sx_mutex_destroy(server.mutex);
     sx_return();
 }
@@ -46,6 +106,7 @@ void server_reset(Config config)
     sx_trace();
 
     server.config = config;
+    server.probe = config.probe;
 
     if (server.socket > 0) sx_socket_close(server.socket);
     server.socket = sx_socket_open(config.port, true, false);
@@ -53,97 +114,400 @@ void server_reset(Config config)
     sx_return();
 }
 
-void server_cleanup(void)
+static void server_seal_header(Player* player, byte* packet, byte* nonce)
 {
-    sx_trace();
+    ulong counter = sx_atomic_inc64(&player->counter);
+    packet[0] = TYPE_SECURE;
+    sx_mem_copy(packet + 1, &counter, sizeof(ulong));
+
+    // the first word of the nonce separates the directions of the session
+    sx_mem_set(nonce, 0, SX_CHACHA_NONCE_LEN);
+    nonce[0] = 1;
+    sx_mem_copy(nonce + 4, &counter, sizeof(ulong));
+}
 
-    ulong now = sx_time_now();
-    sx_mutex_lock(server.mutex);
+// seal the buffer for the player into the packet and return the size of the sealed packet
+static int server_seal(Player* player, byte* packet, const void* buffer, const int size)
+{
+    byte nonce[SX_CHACHA_NONCE_LEN];
+    server_seal_header(player, packet, nonce);
+
+    byte* cipher = packet + SECURE_DOWN_HEADER;
+    sx_chacha20poly1305_seal(cipher, cipher + size, player->cipher, nonce, packet, SECURE_DOWN_HEADER, (const byte*)buffer, size);
+    return SECURE_DOWN_HEADER + size + SECURE_TAG_LEN;
+}
+
+void server_seal_send(Player* player, const byte* address, const void* buffer, const int size)
+{
+    if (size > PACKET_MAX_LEN) return;
+
+    byte packet[SECURE_DOWN_HEADER + PACKET_MAX_LEN + SECURE_TAG_LEN];
+    int packetsize = server_seal(player, packet, buffer, size);
+    sx_socket_send_in(server.socket, (const struct sockaddr*)address, packet, packetsize);
+    metrics_sent(packetsize);
+}
+
+void server_send(const byte* address, const void* buffer, const int size)
+{
+    // responses to a sealed request are sealed with the session of the requester
+    if (s_sealer != null && address == s_sealer_from)
+        server_seal_send((Player*)s_sealer, address, buffer, size);
+    else
+    {
+        sx_socket_send_in(server.socket, (const struct sockaddr*)address, buffer, size);
+        metrics_sent(size);
+    }
+}
+
+void server_send_player(Player* player, const void* buffer, const int size)
+{
+    if (player->secure)
+        server_seal_send(player, player->from, buffer, size);
+    else
+    {
+        sx_socket_send_in(server.socket, (const struct sockaddr*)player->from, buffer, size);
+        metrics_sent(size);
+    }
+}
 
-    for (short i = 0; i < LOBBY_CAPACITY; i++)
+void server_send_error(const byte* from, const byte type, const sbyte error)
+{
+    ErrorResponse response = { type, error };
+    metrics_error(error);
+    server_send(from, &response, sizeof(ErrorResponse));
+}
+
+void server_room_send(Room* room, const sbyte except, const void* buffer, const int size)
+{
+    // the copies of secure players are sealed together so their key streams are computed side by side
+    byte packets[ROOM_CAPACITY][SECURE_DOWN_HEADER + PACKET_MAX_LEN + SECURE_TAG_LEN];
+    byte nonces[ROOM_CAPACITY][SX_CHACHA_NONCE_LEN];
+    sx_chacha20poly1305_item items[ROOM_CAPACITY];
+    const byte* addresses[ROOM_CAPACITY];
+    uint count = 0;
+
+    for (sbyte i = 0; i < ROOM_CAPACITY; i++)
     {
-        Player* player = &server.lobby.players[i];
-        if (is_player_loggedin(player) && sx_time_diff(now, player->active_time) > server.config.player_timeout)
+        if (i == except) continue;
+        Player* other = room->players[i];
+        if (other == null || other->token == 0) continue;
+
+        if (other->secure == false || size > PACKET_MAX_LEN)
         {
-            room_remove_player(&server, player);
-            lobby_remove_player(&server, i);
+            server_send_player(other, buffer, size);
+            continue;
         }
+
+        server_seal_header(other, packets[count], nonces[count]);
+        items[count] = (sx_chacha20poly1305_item){ packets[count] + SECURE_DOWN_HEADER, other->cipher, nonces[count], packets[count], SECURE_DOWN_HEADER };
+        addresses[count] = other->from;
+        count++;
     }
+    if (count < 1) return;
 
-    sx_mutex_unlock(server.mutex);
-    sx_return();
+    sx_chacha20poly1305_seal_many(items, count, (const byte*)buffer, size);
+    for (uint i = 0; i < count; i++)
+    {
+        sx_socket_send_in(server.socket, (const struct sockaddr*)addresses[i], packets[i], SECURE_DOWN_HEADER + size + SECURE_TAG_LEN);
+        metrics_sent(SECURE_DOWN_HEADER + size + SECURE_TAG_LEN);
+    }
 }
 
-void server_rooms_update()
+// copy the message for the members of the room under the lock. the copies of secure players are sealed
+// here because their sessions may be gone when the outbox is sent
+void server_room_post(RoomOutbox* outbox, Room* room, const sbyte except, const void* buffer, const int size)
 {
-    sx_trace();
+    outbox->count = 0;
+    if (size > PACKET_MAX_LEN) return;
+
+    for (sbyte i = 0; i < ROOM_CAPACITY; i++)
+    {
+        if (i == except) continue;
+        Player* other = room->players[i];
+        if (other == null || other->token == 0) continue;
+
+        byte* packet = outbox->packets[outbox->count];
+        sx_mem_copy(outbox->addresses[outbox->count], other->from, ADDRESS_LEN);
+        if (other->secure)
+            outbox->sizes[outbox->count] = (ushort)server_seal(other, packet, buffer, size);
+        else
+        {
+            sx_mem_copy(packet, buffer, size);
+            outbox->sizes[outbox->count] = (ushort)size;
+        }
+        outbox->count++;
+    }
+}
+
+void server_outbox_send(const RoomOutbox* outbox)
+{
+    for (byte i = 0; i < outbox->count; i++)
+    {
+        sx_socket_send_in(server.socket, (const struct sockaddr*)outbox->addresses[i], outbox->packets[i], outbox->sizes[i]);
+        metrics_sent(outbox->sizes[i]);
+    }
+}
+
+void server_send_log(const byte* address, const RoomLog* log, const ushort seq)
+{
+    PacketLogged packet = { TYPE_PACKET_LOGGED, log->sender, seq, log->datasize };
+    sx_mem_copy(packet.data, log->data, log->datasize);
+    server_send(address, &packet, sizeof(PacketLogged) - ROOM_LOG_DATA_LEN + log->datasize);
+}
+
+void server_room_check_master(Room* room, const ulong now)
+{
+    if (room_check_master(&server, now, (short)(room - server.rooms)) == false) return;
+    sx_record_event("master", (uint)(room - server.rooms), (uint)room->master);
+
+    // push the new master to all players in the room immediately
+    MasterResponse response = { TYPE_MASTER, room->master };
+    server_room_send(room, -1, &response, sizeof(MasterResponse));
+}
+
+void server_room_post_member(RoomOutbox* outbox, Room* room, const sbyte index, const byte event)
+{
+    // the members mask lets players converge even if they missed some events
+    MemberResponse response = { TYPE_MEMBER, index, event, room_members(room) };
+    if (event == MEMBER_JOIN)
+    {
+        sx_mem_copy(response.meta, room->players[index]->meta, PLAYER_META_LEN);
+        server_room_post(outbox, room, index, &response, sizeof(MemberResponse));
+    }
+    else server_room_post(outbox, room, index, &response, sizeof(MemberResponse) - PLAYER_META_LEN);
+}
+
+void server_room_send_member(Room* room, const sbyte index, const byte event)
+{
+    RoomOutbox outbox;
+    server_room_post_member(&outbox, room, index, event);
+    server_outbox_send(&outbox);
+}
+
+void server_room_remove_player(Player* player, const byte reason)
+{
+    if (is_player_not_joined_room(player)) return;
+
+    Room* room = &server.rooms[player->room];
+    sbyte index = player->index;
+    bool was_master = sx_flag_has(player->flag, FLAG_MASTER);
+    sx_record_event("leave", player->id, player->room);
+    room_remove_player(&server, player);
+    if (room->count < 1) return;
+
+    server_room_send_member(room, index, reason);
+
+    // elect the new master without waiting for the master timer
+    if (was_master)
+        server_room_check_master(room, sx_time_now());
+}
+
+void server_player_expired(sx_timer* timer, void* param)
+{
+    Player* player = (Player*)param;
+    if (is_player_not_loggedin(player)) return;
 
     ulong now = sx_time_now();
-    sx_mutex_lock(server.mutex);
-    for (short i = 0; i < ROOM_COUNT; i++)
-        room_check_master(&server, now, i);
-    sx_mutex_unlock(server.mutex);
+    if (player_is_active(player, now, server.config.player_timeout) == false)
+    {
+        sx_record_event("expired", player->id, player->room);
+        server_room_remove_player(player, MEMBER_TIMEOUT);
+        lobby_remove_player(&server, player->id);
+    }
+    else sx_timer_wheel_add(server.timers, timer, sx_atomic_load64(&player->active_time) + server.config.player_timeout);
+}
 
-    sx_return();
+void server_room_master_expired(sx_timer* timer, void* param)
+{
+    Room* room = (Room*)param;
+    if (room->count < 1) return;
+
+    ulong now = sx_time_now();
+    server_room_check_master(room, now);
+
+    // schedule the next check at the time that the current master would be expired
+    uint master_timeout = server.config.master_heartbeat_timeout > 0 ? server.config.master_heartbeat_timeout : server.config.player_master_timeout;
+    Player* master = validate_player_index_range(room->master) ? room->players[room->master] : null;
+    if (master != null)
+    {
+        ulong heartbeat = sx_atomic_load64(&master->active_time);
+        if (heartbeat < room->master_time) heartbeat = room->master_time;
+        sx_timer_wheel_add(server.timers, timer, heartbeat + master_timeout);
+    }
+    else
+        sx_timer_wheel_add(server.timers, timer, now + master_timeout);
 }
 
-void server_send(const byte* address, const void* buffer, const int size)
+void server_room_open_expired(sx_timer* timer, void* param)
 {
-    sx_socket_send_in(server.socket, (const struct sockaddr*)address, buffer, size);
+    Room* room = (Room*)param;
+    room->open_time = 0;
 }
 
-void server_send_error(const byte* from, const byte type, const sbyte error)
+void server_schedule_player(Player* player)
 {
-    ErrorResponse response = { type, error };
-    server_send(from, &response, sizeof(ErrorResponse));
+    player->timer.func = server_player_expired;
+    player->timer.param = player;
+    sx_timer_wheel_add(server.timers, &player->timer, player->active_time + server.config.player_timeout);
+}
+
+void server_schedule_room(Room* room)
+{
+    if (sx_timer_is_pending(&room->master_timer) == false)
+    {
+        room->master_timer.func = server_room_master_expired;
+        room->master_timer.param = room;
+        server_room_master_expired(&room->master_timer, room);
+    }
+
+    if (room->open_timeout > 0 && room->open_time > 0 && sx_timer_is_pending(&room->open_timer) == false)
+    {
+        room->open_timer.func = server_room_open_expired;
+        room->open_timer.param = room;
+        sx_timer_wheel_add(server.timers, &room->open_timer, room->open_time + room->open_timeout);
+    }
+}
+
+void server_update(void)
+{
+    sx_trace();
+
+    ulong now = sx_time_update();
+    server_lock();
+    sx_timer_wheel_update(server.timers, now);
+    sx_mutex_unlock(server.mutex);
+
+    if (sx_time_diff(now, server.shield_time) >= SHIELD_DECAY_INTERVAL)
+    {
+        server.shield_time = now;
+        sx_sketch_decay(server.shield);
+    }
+
+    sx_return();
 }
 
 void server_ping(byte* buffer, const byte* from)
 {
-    sx_mutex_lock(server.mutex);
+    // NTP style timestamps let the client take the processing time of the server out of the round trip
+    ulong receive_time = sx_time_now_us();
+    ulong now = receive_time / 1000;
 
+    // pings are the heartbeats of the masters so they are validated and refreshed without the lock like
+    // the relay packets. only a moved address or a room without master takes the lock
     Ping* ping = (Ping*)buffer;
     Player* player = lobby_get_player_validate_all(&server, ping->token, ping->id, ping->room, ping->index);
-
-    PingResponse response;
-    if (player != null)
+    if (player == null)
     {
-        ulong now = sx_time_now();
-        sx_mem_copy(player->from, from, ADDRESS_LEN);
-        player->active_time = now;
-        PingResponse temp = { TYPE_PING, 0, ping->time, now, player->flag };
-        response = temp;
+        server_send_error(from, TYPE_PING, ERR_EXPIRED);
+        return;
     }
 
-    sx_mutex_unlock(server.mutex);
+    bool moved = player_refresh(player, ping->token, from, now);
+    short room = player->room;
+    if (moved || (room >= 0 && server.rooms[room].master < 0))
+    {
+        server_lock();
+        if (player->token == ping->token)
+        {
+            if (moved) player_set_address(player, from);
 
-    if (player != null)
-        server_send(from, &response, sizeof(PingResponse));
-    else
+            // an active player in a room without master can take the authority right now
+            if (is_player_joined_room(player) && server.rooms[player->room].master < 0)
+                server_room_check_master(&server.rooms[player->room], now);
+        }
+        sx_mutex_unlock(server.mutex);
+    }
+
+    // the flag and the members are read without the lock like the fan-out reads the room
+    room = player->room;
+    byte members = room >= 0 ? room_members(&server.rooms[room]) : 0;
+    PingResponse response = { TYPE_PING, 0, ping->time, receive_time, 0, player->flag, members };
+    if (player->token != ping->token)
+    {
         server_send_error(from, TYPE_PING, ERR_EXPIRED);
+        return;
+    }
+
+    response.transmit = sx_time_now_us();
+    server_send(from, &response, sizeof(PingResponse));
+}
+
+// exchange ephemeral X25519 keys with the client and derive the cipher key of the session
+// runs before the lock because of the two scalar multiplications
+bool server_negotiate_cipher(byte* cipher, const byte* client_public, byte* server_public)
+{
+    byte scalar[SX_X25519_KEY_LEN], shared[SX_X25519_KEY_LEN];
+    if (sx_random(scalar, SX_X25519_KEY_LEN) == false) return false;
+    sx_x25519_public(server_public, scalar);
+    sx_x25519(shared, scalar, client_public);
+
+    // reject the low order points of the client which lead to a known shared key
+    byte check = 0;
+    for (int i = 0; i < SX_X25519_KEY_LEN; i++)
+        check |= shared[i];
+    if (check == 0) return false;
+
+    static const byte nonce[16] = { 0 };
+    sx_hchacha20(cipher, shared, nonce);
+    return true;
+}
+
+void server_install_cipher(Player* player, const byte* cipher)
+{
+    sx_mem_copy(player->cipher, cipher, CIPHER_KEY_LEN);
+    player->counter = 0;
+    sx_atomic_store64(&player->replay_top, 0);
+    for (int i = 0; i < REPLAY_WINDOW; i++)
+        sx_atomic_store64(&player->replay[i], 0);
+    player->secure = true;
 }
 
 void server_process_login(byte* buffer, const byte* from)
 {
-    sx_mutex_lock(server.mutex);
+    // no lobby slot is committed until the client proves it owns the address by echoing the cookie
+    Login* login = (Login*)buffer;
+    ulong now = sx_time_now();
+    if (cookie_is_invalid(server.cookie_key, from, now, login->cookie))
+    {
+        LoginCookie response = { TYPE_LOGIN, ERR_COOKIE };
+        cookie_compute(server.cookie_key, from, now, response.cookie);
+        metrics_error(ERR_COOKIE);
+        server_send(from, &response, sizeof(LoginCookie));
+        return;
+    }
 
-    if (server.lobby.count >= LOBBY_CAPACITY)
+    // the secret and the cipher key are computed before the lock and only installed under it
+    byte secret[SESSION_KEY_LEN], cipher[CIPHER_KEY_LEN];
+    LoginResponse response = { TYPE_LOGIN, 0 };
+    server_get_secret(secret);
+
+    // every login negotiates a new cipher key so the session can not be resumed with an old one
+    const bool secure = login->mode == LOGIN_MODE_SECURE;
+    if (secure && server_negotiate_cipher(cipher, login->public_key, response.public_key) == false)
     {
-        sx_mutex_unlock(server.mutex);
-        server_send_error(from, TYPE_LOGIN, ERR_IS_FULL);
+        server_send_error(from, TYPE_LOGIN, ERR_INVALID);
         return;
     }
 
-    Login* login = (Login*)buffer;
-    if (checksum_is_invalid(buffer, sizeof(Login) - sizeof(uint), login->checksum))
+    server_lock();
+
+    if (server.lobby.count >= LOBBY_CAPACITY)
     {
         sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_LOGIN, ERR_IS_FULL);
         return;
     }
 
+    // the player keeps its room on login again but never the token and the secret of its old session
     Player* player = lobby_find_player_by_device(&server, login->device);
-    if (player == null)
-        player = lobby_add_player(&server, login->device, from, server_get_token());
+    if (player != null)
+        lobby_renew_player(player, from, server_get_token(), server_get_key(), secret);
+    else
+    {
+        player = lobby_add_player(&server, login->device, from, server_get_token(), server_get_key(), secret);
+        if (player != null)
+            server_schedule_player(player);
+    }
 
     if (player == null)
     {
@@ -152,17 +516,25 @@ void server_process_login(byte* buffer, const byte* from)
         return;
     }
 
-    LoginResponse response = { TYPE_LOGIN, 0, player->token, player->id, player->room, player->index };
+    sx_record_event("login", player->id, player->room);
+    response.token = player->token;
+    response.id = player->id;
+    response.room = player->room;
+    response.index = player->index;
+    response.key = player->key;
+    sx_mem_copy(response.secret, player->secret, SESSION_KEY_LEN);
+    if (secure)
+        server_install_cipher(player, cipher);
 
     sx_mutex_unlock(server.mutex);
 
-    response.checksum = checksum_compute((const byte*)&response, sizeof(LoginResponse) - sizeof(uint));
+    response.mac = mac_compute(mac_login_key, (const byte*)&response, sizeof(LoginResponse) - PACKET_MAC_LEN);
     server_send(from, &response, sizeof(LoginResponse));
 }
 
 void server_process_logout(byte* buffer, const byte* from)
 {
-    sx_mutex_lock(server.mutex);
+    server_lock();
 
     Logout* logout = (Logout*)buffer;
 
@@ -172,16 +544,11 @@ void server_process_logout(byte* buffer, const byte* from)
         return;
     }
 
-    if (checksum_is_invalid(buffer, sizeof(Logout) - sizeof(uint), logout->checksum))
-    {
-        sx_mutex_unlock(server.mutex);
-        return;
-    }
-
     Player* player = lobby_get_player_validate_all(&server, logout->token, logout->id, logout->room, logout->index);
     if (player != null)
     {
-        room_remove_player(&server, player);
+        sx_record_event("logout", player->id, player->room);
+        server_room_remove_player(player, MEMBER_LEAVE);
         lobby_remove_player(&server, logout->id);
     }
 
@@ -192,7 +559,7 @@ void server_process_logout(byte* buffer, const byte* from)
 
 void server_process_create(byte* buffer, const byte* from)
 {
-    sx_mutex_lock(server.mutex);
+    server_lock();
 
     Create* request = (Create*)buffer;
 
@@ -205,7 +572,10 @@ void server_process_create(byte* buffer, const byte* from)
     }
 
     if (is_player_not_joined_room(player))
+    {
+        sx_mem_copy(player->meta, request->meta, PLAYER_META_LEN);
         room_create(&server, player, request->open_timeout * 1000, request->properties, request->matchmaking);
+    }
 
     if (is_player_not_joined_room(player))
     {
@@ -214,7 +584,8 @@ void server_process_create(byte* buffer, const byte* from)
         return;
     }
 
-    room_check_master(&server, sx_time_now(), player->room);
+    sx_record_event("create", player->id, player->room);
+    server_schedule_room(&server.rooms[player->room]);
 
     CreateResponse response = { TYPE_CREATE, 0, player->room, player->index, player->flag };
 
@@ -225,7 +596,7 @@ void server_process_create(byte* buffer, const byte* from)
 
 void server_process_join(byte* buffer, const byte* from)
 {
-    sx_mutex_lock(server.mutex);
+    server_lock();
 
     Join* request = (Join*)buffer;
 
@@ -237,8 +608,15 @@ void server_process_join(byte* buffer, const byte* from)
         return;
     }
 
+    // the other members are told after the lock is released
+    RoomOutbox joined;
+    joined.count = 0;
     if (is_player_not_joined_room(player))
-        room_join(&server, player, request->matchmaking);
+    {
+        sx_mem_copy(player->meta, request->meta, PLAYER_META_LEN);
+        if (room_join(&server, player, request->matchmaking))
+            server_room_post_member(&joined, &server.rooms[player->room], player->index, MEMBER_JOIN);
+    }
 
     if (is_player_not_joined_room(player))
     {
@@ -247,25 +625,50 @@ void server_process_join(byte* buffer, const byte* from)
         return;
     }
 
-    room_check_master(&server, sx_time_now(), player->room);
+    sx_record_event("join", player->id, player->room);
+    server_room_check_master(&server.rooms[player->room], sx_time_now());
+    server_schedule_room(&server.rooms[player->room]);
 
+    Room* room = &server.rooms[player->room];
     JoinResponse response = { TYPE_JOIN, 0, player->room, player->index, player->flag };
-    sx_mem_copy(response.properties, server.rooms[player->room].properties, ROOM_PROP_LEN);
+    sx_mem_copy(response.properties, room->properties, ROOM_PROP_LEN);
+    response.log_first = room->log_seq - room->log_size;
+    response.log_last = room->log_seq;
+    response.count = room_roster(room, response.members);
+
+    // copy the persistent messages to send them after the lock is released
+    RoomLog logs[ROOM_LOG_COUNT];
+    byte log_count = 0;
+    for (ushort seq = response.log_first; seq != response.log_last; seq++)
+    {
+        const RoomLog* log = room_log_get(room, seq);
+        logs[log_count].sender = log->sender;
+        logs[log_count].datasize = log->datasize;
+        sx_mem_copy(logs[log_count].data, log->data, log->datasize);
+        log_count++;
+    }
 
     sx_mutex_unlock(server.mutex);
-    
-    server_send(from, &response, sizeof(JoinResponse));
+
+    server_outbox_send(&joined);
+
+    // send the roster of the room in the same response to avoid players introduce themselves
+    server_send(from, &response, sizeof(JoinResponse) - (ROOM_CAPACITY - response.count) * sizeof(RoomMember));
+
+    // stream the persistent messages so the other players have not to send their state again
+    for (byte i = 0; i < log_count; i++)
+        server_send_log(from, &logs[i], response.log_first + i);
 }
 
 void server_process_leave(byte* buffer, const byte* from)
 {
-    sx_mutex_lock(server.mutex);
+    server_lock();
 
     Leave* leave = (Leave*)buffer;
     Player* player = lobby_get_player_validate_all(&server, leave->token, leave->id, leave->room, leave->index);
     if (player != null)
-        room_remove_player(&server, player);
-    
+        server_room_remove_player(player, MEMBER_LEAVE);
+
     sx_mutex_unlock(server.mutex);
 
     LeaveResponse response = { TYPE_LEAVE, 0 };
@@ -273,6 +676,114 @@ void server_process_leave(byte* buffer, const byte* from)
 }
 
 
+// any validated packet keeps the player alive and follows its address after NAT rebinding. the token
+// is the session which the packet is validated for. the address rarely moves so it is set under the lock
+void server_player_refresh(Player* player, const uint token, const byte* from)
+{
+    if (player_refresh(player, token, from, sx_time_now()) == false) return;
+
+    server_lock();
+    if (player->token == token)
+        player_set_address(player, from);
+    sx_mutex_unlock(server.mutex);
+}
+
+// data points to the payload of the packet. the response header is written in place just before it
+void server_relay_unreliable(Player* player, const uint token, const byte* from, const sbyte target, byte* data, const byte datasize)
+{
+    // excess packets are dropped before the fan-out
+    ulong now = sx_time_cached();
+    if (player_rate_take(&server, player, RATE_UNRELIABLE, now) == false) return;
+    server_player_refresh(player, token, from);
+
+    Room* room = &server.rooms[player->room];
+    int packetsize = datasize + 3;
+    byte* buffer = data - 3;
+    buffer[0] = TYPE_PACKET_UNRELY;
+    buffer[1] = player->index;
+    buffer[2] = datasize;
+
+    if (target == -1)
+        server_room_send(room, player->index, buffer, packetsize);
+    else if (target == -2)
+        server_room_send(room, -1, buffer, packetsize);
+    else if (validate_player_index_range(target))
+    {
+        Player* other = room->players[target];
+        if (other != null && other->token > 0)
+            server_send_player(other, buffer, packetsize);
+    }
+}
+
+void server_relay_reliable(Player* player, const uint token, const byte* from, const sbyte target, const byte ack, byte* data, const byte datasize)
+{
+    // the sender retries the dropped packets so the limit acts as back pressure
+    ulong now = sx_time_cached();
+    if (player_rate_take(&server, player, RATE_RELIABLE, now) == false) return;
+    server_player_refresh(player, token, from);
+
+    Room* room = &server.rooms[player->room];
+    Player* other = room->players[target];
+    if (other == null || other->token == 0)
+    {
+        // fake response to sender to stop trying
+        byte response[3] = { TYPE_PACKET_RELIED, target, ack };
+        server_send_player(player, response, 3);
+    }
+    else
+    {
+        byte* buffer = data - 4;
+        buffer[0] = TYPE_PACKET_RELY;
+        buffer[1] = player->index;
+        buffer[2] = ack;
+        buffer[3] = datasize;
+        server_send_player(other, buffer, datasize + 4);
+    }
+}
+
+void server_relay_relied(Player* player, const uint token, const byte* from, const sbyte target, const byte ack)
+{
+    ulong now = sx_time_cached();
+    if (player_rate_take(&server, player, RATE_RELIABLE, now) == false) return;
+    server_player_refresh(player, token, from);
+
+    Room* room = &server.rooms[player->room];
+    Player* other = room->players[target];
+    if (other != null && other->token > 0)
+    {
+        byte response[3] = { TYPE_PACKET_RELIED, player->index, ack };
+        server_send_player(other, response, 3);
+    }
+}
+
+// fragments are relayed one by one like reliable packets. the receiver reassembles the message
+void server_relay_fragment(Player* player, const uint token, const byte* from, const CompactFragment* packet, byte* data)
+{
+    ulong now = sx_time_cached();
+    if (player_rate_take(&server, player, RATE_FRAGMENT, now) == false) return;
+    server_player_refresh(player, token, from);
+
+    Room* room = &server.rooms[player->room];
+    Player* other = room->players[packet->target];
+    if (other == null || other->token == 0)
+    {
+        byte response[3] = { TYPE_PACKET_RELIED, packet->target, packet->ack };
+        server_send_player(player, response, 3);
+    }
+    else
+    {
+        ushort datasize = packet->datasize;
+        byte* buffer = data - 7;
+        buffer[0] = TYPE_PACKET_FRAGMENT;
+        buffer[1] = player->index;
+        buffer[2] = packet->ack;
+        buffer[3] = packet->fragment;
+        buffer[4] = packet->count;
+        sx_mem_copy(buffer + 5, &datasize, sizeof(ushort));
+        server_send_player(other, buffer, datasize + 7);
+    }
+}
+
 void server_process_packet_unreliable(byte* buffer, const byte* from)
 {
     PacketUnreliable* packet = (PacketUnreliable*)buffer;
@@ -286,119 +797,243 @@ void server_process_packet_unreliable(byte* buffer, const byte* from)
         return;
     }
 
-    Room* room = &server.rooms[packet->room];
-    if (packet->target == -1)
+    server_relay_unreliable(player, packet->token, from, packet->target, buffer + sizeof(PacketUnreliable), packet->datasize);
+}
+
+void server_process_packet_reliable(byte* buffer, const byte* from)
+{
+    PacketReliable* packet = (PacketReliable*)buffer;
+    if (validate_player_index_range(packet->index) == false) return;
+    if (validate_player_room_id_range(packet->room) == false) return;
+    if (validate_player_index_range(packet->target) == false) return;
+
+    Player* player = lobby_get_player_validate_all(&server, packet->token, packet->id, packet->room, packet->index);
+    if (player == null)
     {
-        int sender = packet->index;
-        int packetsize = packet->datasize + 3;
-        buffer += sizeof(PacketUnreliable) - 3;
-        buffer[0] = TYPE_PACKET_UNRELY;
-        buffer[1] = sender;
-        //buffer[2] = packet->datasize;  no need to rewrite data size
-        for (uint i = 0; i < ROOM_CAPACITY; i++)
-        {
-            if (i == sender) continue;
-            Player* other = room->players[i];
-            if (other != null && other->token > 0)
-                server_send(other->from, buffer, packetsize);
-        }
+        server_send_error(from, TYPE_PACKET_RELY, ERR_EXPIRED);
+        return;
     }
-    else if (packet->target == -2)
+
+    server_relay_reliable(player, packet->token, from, packet->target, packet->ack, buffer + sizeof(PacketReliable), packet->datasize);
+}
+
+void server_process_packet_relied(byte* buffer, const byte* from)
+{
+    PacketRelied* packet = (PacketRelied*)buffer;
+    if (validate_player_index_range(packet->index) == false) return;
+    if (validate_player_room_id_range(packet->room) == false) return;
+    if (validate_player_index_range(packet->target) == false) return;
+
+    Player* player = lobby_get_player_validate_all(&server, packet->token, packet->id, packet->room, packet->index);
+    if (player == null)
     {
-        int sender = packet->index;
-        int packetsize = packet->datasize + 3;
-        buffer += sizeof(PacketUnreliable) - 3;
-        buffer[0] = TYPE_PACKET_UNRELY;
-        buffer[1] = sender;
-        //buffer[2] = packet->datasize;  no need to rewrite data size
-        for (uint i = 0; i < ROOM_CAPACITY; i++)
-        {
-            Player* other = room->players[i];
-            if (other != null && other->token > 0)
-                server_send(other->from, buffer, packetsize);
-        }
+        server_send_error(from, TYPE_PACKET_RELIED, ERR_EXPIRED);
+        return;
     }
-    else if (validate_player_index_range(packet->target))
+
+    server_relay_relied(player, packet->token, from, packet->target, packet->ack);
+}
+
+void server_process_compact_unreliable(byte* buffer, const byte* from)
+{
+    CompactUnreliable* packet = (CompactUnreliable*)buffer;
+    uint token;
+    Player* player = lobby_get_player_validate_key(&server, packet->handle, packet->key, &token);
+    if (player == null)
     {
-        Player* other = room->players[packet->target];
-        if (other != null && other->token > 0)
-        {
-            int sender = packet->index;
-            int packetsize = packet->datasize + 3;
-            buffer += sizeof(PacketUnreliable) - 3;
-            buffer[0] = TYPE_PACKET_UNRELY;
-            buffer[1] = sender;
-            //buffer[2] = packet->datasize;  no need to rewrite data size
-            server_send(other->from, buffer, packetsize);
-        }
+        server_send_error(from, TYPE_PACKET_UNRELY, ERR_EXPIRED);
+        return;
     }
+
+    server_relay_unreliable(player, token, from, packet->target, buffer + sizeof(CompactUnreliable), packet->datasize);
 }
 
-void server_process_packet_reliable(byte* buffer, const byte* from)
+void server_process_compact_reliable(byte* buffer, const byte* from)
 {
-    PacketReliable* packet = (PacketReliable*)buffer;
-    if (validate_player_index_range(packet->index) == false) return;
-    if (validate_player_room_id_range(packet->room) == false) return;
+    CompactReliable* packet = (CompactReliable*)buffer;
     if (validate_player_index_range(packet->target) == false) return;
 
-    Player* player = lobby_get_player_validate_all(&server, packet->token, packet->id, packet->room, packet->index);
+    uint token;
+    Player* player = lobby_get_player_validate_key(&server, packet->handle, packet->key, &token);
     if (player == null)
     {
         server_send_error(from, TYPE_PACKET_RELY, ERR_EXPIRED);
         return;
     }
 
-    Room* room = &server.rooms[packet->room];
-    Player* other = room->players[packet->target];
-    if (other == null || other->token == 0)
+    server_relay_reliable(player, token, from, packet->target, packet->ack, buffer + sizeof(CompactReliable), packet->datasize);
+}
+
+void server_process_compact_relied(byte* buffer, const byte* from)
+{
+    CompactRelied* packet = (CompactRelied*)buffer;
+    if (validate_player_index_range(packet->target) == false) return;
+
+    uint token;
+    Player* player = lobby_get_player_validate_key(&server, packet->handle, packet->key, &token);
+    if (player == null)
     {
-        sbyte target = packet->target;
-        byte ack = packet->ack;
-        // fake response to sender to stop trying
-        buffer[0] = TYPE_PACKET_RELIED;
-        buffer[1] = target;
-        buffer[2] = ack;
-        server_send(player->from, buffer, 3);
+        server_send_error(from, TYPE_PACKET_RELIED, ERR_EXPIRED);
+        return;
     }
-    else
+
+    server_relay_relied(player, token, from, packet->target, packet->ack);
+}
+
+void server_process_compact_fragment(byte* buffer, const byte* from)
+{
+    CompactFragment* packet = (CompactFragment*)buffer;
+    if (validate_player_index_range(packet->target) == false) return;
+    if (packet->datasize > FRAGMENT_DATA_LEN || packet->fragment >= packet->count) return;
+
+    uint token;
+    Player* player = lobby_get_player_validate_key(&server, packet->handle, packet->key, &token);
+    if (player == null)
     {
-        sbyte index = packet->index;
-        byte ack = packet->ack;
-        int packetsize = packet->datasize + 4;
-        buffer += sizeof(PacketReliable) - 4;
-        buffer[0] = TYPE_PACKET_RELY;
-        buffer[1] = index;
-        buffer[2] = ack;
-        //buffer[3] = packet->datasize;  no need to rewrite data size
-        server_send(other->from, buffer, packetsize);
+        server_send_error(from, TYPE_PACKET_FRAGMENT, ERR_EXPIRED);
+        return;
     }
+
+    server_relay_fragment(player, token, from, packet, buffer + sizeof(CompactFragment));
 }
 
-void server_process_packet_relied(byte* buffer, const byte* from)
+void server_process_packet_persist(byte* buffer, const byte* from)
 {
-    PacketRelied* packet = (PacketRelied*)buffer;
+    PacketPersist* packet = (PacketPersist*)buffer;
     if (validate_player_index_range(packet->index) == false) return;
     if (validate_player_room_id_range(packet->room) == false) return;
-    if (validate_player_index_range(packet->target) == false) return;
+    if (packet->datasize > ROOM_LOG_DATA_LEN)
+    {
+        server_send_error(from, TYPE_PACKET_PERSIST, ERR_INVALID);
+        return;
+    }
+
+    server_lock();
 
     Player* player = lobby_get_player_validate_all(&server, packet->token, packet->id, packet->room, packet->index);
     if (player == null)
     {
-        server_send_error(from, TYPE_PACKET_RELIED, ERR_EXPIRED);
+        sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_PACKET_PERSIST, ERR_EXPIRED);
         return;
     }
 
-    Room* room = &server.rooms[packet->room];
-    Player* other = room->players[packet->target];
-    if (other != null && other->token > 0)
+    // the lock is held already so a moved address is set right away
+    if (player_refresh(player, packet->token, from, sx_time_now()))
+        player_set_address(player, from);
+    bool stored = room_log_add(&server.rooms[packet->room], player, packet->ack, buffer + sizeof(PacketPersist), packet->datasize);
+
+    sx_mutex_unlock(server.mutex);
+
+    server_send_error(from, TYPE_PACKET_PERSIST, stored ? 0 : ERR_INVALID);
+}
+
+void server_process_packet_log(byte* buffer, const byte* from)
+{
+    PacketLog* request = (PacketLog*)buffer;
+    if (validate_player_room_id_range(request->room) == false) return;
+
+    server_lock();
+
+    Player* player = lobby_get_player_validate_all(&server, request->token, request->id, request->room, request->index);
+    if (player == null)
     {
-        sbyte index = packet->index;
-        byte ack = packet->ack;
-        buffer[0] = TYPE_PACKET_RELIED;
-        buffer[1] = index;
-        buffer[2] = ack;
-        server_send(other->from, buffer, 3);
+        sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_PACKET_LOG, ERR_EXPIRED);
+        return;
     }
+
+    // the message may have been overwritten in the ring
+    const RoomLog* log = room_log_get(&server.rooms[request->room], request->seq);
+    if (log == null)
+    {
+        sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_PACKET_LOG, ERR_INVALID);
+        return;
+    }
+
+    PacketLogged response = { TYPE_PACKET_LOG, log->sender, request->seq, log->datasize };
+    sx_mem_copy(response.data, log->data, log->datasize);
+
+    sx_mutex_unlock(server.mutex);
+
+    server_send(from, &response, sizeof(PacketLogged) - ROOM_LOG_DATA_LEN + response.datasize);
+}
+
+void server_process_state_set(byte* buffer, const sint size, const byte* from)
+{
+    StateSet* request = (StateSet*)buffer;
+    if (validate_player_room_id_range(request->room) == false) return;
+
+    // the data must be in the datagram before the MAC
+    if (sizeof(StateSet) + request->datasize + PACKET_MAC_LEN > (uint)size)
+    {
+        server_send_error(from, TYPE_STATE_SET, ERR_INVALID);
+        return;
+    }
+
+    server_lock();
+
+    Player* player = lobby_get_player_validate_all(&server, request->token, request->id, request->room, request->index);
+    if (player == null)
+    {
+        sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_STATE_SET, ERR_EXPIRED);
+        return;
+    }
+
+    Room* room = &server.rooms[request->room];
+    const byte* data = buffer + sizeof(StateSet);
+    if (room_state_set(room, request->key, data, request->datasize) == false)
+    {
+        sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_STATE_SET, ERR_IS_FULL);
+        return;
+    }
+
+    // broadcast the delta to all players. they will ask for snapshot if they miss a version
+    byte delta[sizeof(StateResponse) + 255];
+    StateResponse* response = (StateResponse*)delta;
+    response->type = TYPE_STATE;
+    response->index = request->index;
+    response->version = room->state_version;
+    response->key = request->key;
+    response->datasize = request->datasize;
+    sx_mem_copy(delta + sizeof(StateResponse), data, request->datasize);
+    server_room_send(room, -1, delta, sizeof(StateResponse) + request->datasize);
+
+    sx_mutex_unlock(server.mutex);
+
+    server_send_error(from, TYPE_STATE_SET, 0);
+}
+
+void server_process_state_snapshot(byte* buffer, const byte* from)
+{
+    StateSnapshot* request = (StateSnapshot*)buffer;
+    if (validate_player_room_id_range(request->room) == false) return;
+
+    server_lock();
+
+    Player* player = lobby_get_player_validate_all(&server, request->token, request->id, request->room, request->index);
+    if (player == null)
+    {
+        sx_mutex_unlock(server.mutex);
+        server_send_error(from, TYPE_STATE_SNAPSHOT, ERR_EXPIRED);
+        return;
+    }
+
+    Room* room = &server.rooms[request->room];
+    StateSnapshotResponse response = { TYPE_STATE_SNAPSHOT, 0, room->state_version, room->state_size, request->offset, 0 };
+    if (request->offset < room->state_size)
+    {
+        uint remained = room->state_size - request->offset;
+        response.datasize = (byte)(remained < STATE_CHUNK_LEN ? remained : STATE_CHUNK_LEN);
+        sx_mem_copy(response.data, room->state + request->offset, response.datasize);
+    }
+
+    sx_mutex_unlock(server.mutex);
+
+    server_send(from, &response, sizeof(StateSnapshotResponse) - STATE_CHUNK_LEN + response.datasize);
 }
 
 void server_report(void)
@@ -415,15 +1050,44 @@ void server_report(void)
         total_players += room->count;
     }
     sx_print("Total active rooms: %d\nTotal players in room: %d", total_rooms, total_players);
+    sx_print("Dropped by rate limits: unreliable %llu reliable %llu fragment %llu", server.dropped[RATE_UNRELIABLE], server.dropped[RATE_RELIABLE], server.dropped[RATE_FRAGMENT]);
+    sx_print("Dropped by flood shield: %llu", server.shielded);
+}
+
+// histograms are merged while the listeners record so the packets in flight may be missed.
+// a listener which has not recorded since the probe was enabled again still holds the old times
+void server_report_probe(void)
+{
+    sx_histogram* total = (sx_histogram*)sx_mem_alloc(sizeof(sx_histogram));
+    sx_histogram_reset(total);
+    ulong generation = sx_atomic_load64(&server.probe_generation);
+    for (int i = 0; i < THREAD_COUNTS; i++)
+        if (sx_atomic_load64(&server.probe_generations[i]) == generation)
+            sx_histogram_merge(total, &server.probes[i]);
+
+    sx_print("Relay time of unreliable packets: count %llu p50 %.1f p99 %.1f p99.9 %.1f max %.1f (us)", total->count,
+        sx_histogram_percentile(total, 50) / 1000.0, sx_histogram_percentile(total, 99) / 1000.0,
+        sx_histogram_percentile(total, 99.9) / 1000.0, sx_histogram_percentile(total, 100) / 1000.0);
+    sx_mem_free(total);
+}
+
+void server_probe_enable(const bool enable)
+{
+    // the listeners own their histograms so they are asked to reset them instead of racing with them
+    server.probe = false;
+    if (enable == false) return;
+
+    sx_atomic_inc64(&server.probe_generation);
+    server.probe = true;
 }
 
 void server_report_log(FILE* file)
 {
-    fprintf(file, "token;id;room;index\n");
+    fprintf(file, "token;id;room;index;dropped\n");
     for (uint r = 0; r < LOBBY_CAPACITY; r++)
     {
         Player* player = &server.lobby.players[r];
-        fprintf(file, "%d;%d;%d;%d;\n", player->token, player->id, player->room, player->index);
+        fprintf(file, "%d;%d;%d;%d;%u;\n", player->token, player->id, player->room, player->index, player->dropped);
     }
 
     fprintf(file, "index;count;m0;m1;m2;m3;p0;p1;p2;p3;\n");
@@ -451,40 +1115,208 @@ void thread_ticker(void* param)
 {
     sx_trace_attach(64, "trace_ticker.txt");
     sx_trace();
+    metrics_attach(0);
 
     while (true)
     {
-        server_cleanup();
-        server_rooms_update();
-        sx_sleep(1000);
+        server_update();
+        sx_sleep(TICKER_INTERVAL);
     }
 
     sx_trace_detach();
 }
 
+// verify the MAC of the packet before it touches any player state. the key of the session
+// is found by the lobby id which is at the same offset of all messages of the same header
+bool server_packet_is_invalid(const byte* buffer, const sint size, const Player* sealer)
+{
+    const Player* player = null;
+    switch (buffer[0])
+    {
+    case TYPE_LOGIN:
+        // login negotiates the cipher so it can not be sealed itself
+        if (sealer != null) return true;
+        break;
+
+    case TYPE_COMPACT_UNRELY:
+    case TYPE_COMPACT_RELY:
+    case TYPE_COMPACT_RELIED:
+    case TYPE_PACKET_FRAGMENT:
+        if (size < 3 + PACKET_MAC_LEN) return true;
+        player = lobby_get_player(&server, *(const short*)(buffer + 1));
+        if (player == null) return true;
+        break;
+
+    default:
+        if (size < 7 + PACKET_MAC_LEN) return true;
+        player = lobby_get_player(&server, *(const short*)(buffer + 5));
+        if (player == null) return true;
+        break;
+    }
+
+    // players of secure sessions must seal all of their packets
+    if (player != null && player->secure && player != sealer) return true;
+
+    const byte* key = (player != null) ? player->secret : mac_login_key;
+    if (size < 1 + PACKET_MAC_LEN) return true;
+
+    uint mac = 0;
+    sx_mem_copy(&mac, buffer + size - PACKET_MAC_LEN, PACKET_MAC_LEN);
+    return mac_is_invalid(key, buffer, size - PACKET_MAC_LEN, mac);
+}
+
+// count the request of the source address and return true if it exceeds the limit of the request type
+bool server_is_flooding(const byte type, const byte* from)
+{
+    uint limit = 0;
+    switch (type)
+    {
+    case TYPE_LOGIN: limit = server.config.shield_login; break;
+    case TYPE_CREATE: limit = server.config.shield_create; break;
+    case TYPE_JOIN: limit = server.config.shield_join; break;
+    case SHIELD_EXPIRED: limit = server.config.shield_expired; break;
+    case TYPE_SECURE: limit = server.config.shield_sealed; break;
+    default: return false;
+    }
+    if (limit == 0) return false;
+
+    // the count is kept per address and port so clients behind a shared NAT do not shield each other.
+    // the unused tail of the address separates the types
+    byte key[ADDRESS_LEN];
+    sx_mem_copy(key, from, ADDRESS_LEN);
+    key[ADDRESS_LEN - 1] = type;
+
+    if (sx_sketch_add(server.shield, key, ADDRESS_LEN) <= limit) return false;
+    sx_atomic_inc64(&server.shielded);
+    return true;
+}
+
+bool server_shield(const byte type, const byte* from)
+{
+    if (server_is_flooding(type, from) == false) return false;
+    sx_log_every(1000, "Warning: Flood of type %d from %d.%d.%d.%d is shielded", type, from[4], from[5], from[6], from[7]);
+    return true;
+}
+
+// open the sealed packet in place and return the size of the inner packet or zero if it is invalid
+sint server_open(byte* buffer, const sint size, Player** sealer)
+{
+    if (size < SECURE_UP_HEADER + SECURE_TAG_LEN + 1) return 0;
+
+    Player* player = lobby_get_player(&server, *(const short*)(buffer + 1));
+    if (player == null || player->secure == false) return 0;
+
+    ulong counter;
+    sx_mem_copy(&counter, buffer + 3, sizeof(ulong));
+    if (player_counter_is_stale(player, counter)) return 0;
+
+    byte nonce[SX_CHACHA_NONCE_LEN] = { 0 };
+    sx_mem_copy(nonce + 4, &counter, sizeof(ulong));
+
+    sint innersize = size - SECURE_UP_HEADER - SECURE_TAG_LEN;
+    byte* cipher = buffer + SECURE_UP_HEADER;
+    if (sx_chacha20poly1305_open(cipher, player->cipher, nonce, buffer, SECURE_UP_HEADER, cipher, innersize, cipher + innersize) == false)
+        return 0;
+
+    // the counter is trusted only after the tag is verified
+    if (player_accept_counter(player, counter) == false)
+        return 0;
+
+    sx_mem_move(buffer, cipher, innersize);
+    *sealer = player;
+    return innersize;
+}
+
 void thread_listener(void* param)
 {
     sx_trace_attach(64, "trace_worker.txt");
     sx_trace();
 
+    sx_histogram* probe = &server.probes[(size_t)param];
+    volatile ulong* probe_generation = &server.probe_generations[(size_t)param];
+    metrics_attach((uint)(size_t)param);
+
     while (true)
     {
         byte from[ADDRESS_LEN] = { 0 };
-        byte buffer[1024] = { 0 };
-        sx_socket_receive(server.socket, buffer, 512, (struct sockaddr*)from);
+        byte buffer[SECURE_UP_HEADER + PACKET_MAX_LEN + SECURE_TAG_LEN] = { 0 };
+        sint size = sx_socket_receive(server.socket, buffer, sizeof(buffer), (struct sockaddr*)from);
+        if (size < 1) continue;
+        ulong received = server.probe ? sx_time_now_ns() : 0;
+        metrics_received(size);
+
+        // floods are rejected before opening the sealed packets, computing the MAC or touching any shared state.
+        // sealed packets are counted by their outer type and then their inner requests by their own types
+        if (server_shield(buffer[0], from)) continue;
+
+        Player* sealer = null;
+        if (buffer[0] == TYPE_SECURE)
+        {
+            size = server_open(buffer, size, &sealer);
+            if (size < 1)
+            {
+                metrics_invalid();
+                sx_log_every(1000, "Warning: Can't open the sealed packet from %d.%d.%d.%d:%d", from[4], from[5], from[6], from[7], (from[2] << 8) | from[3]);
+                continue;
+            }
+            if (server_shield(buffer[0], from)) continue;
+        }
+        s_sealer = sealer;
+        s_sealer_from = from;
 
-        switch (buffer[0])
+        if (server_packet_is_invalid(buffer, size, sealer))
+        {
+            metrics_invalid();
+            sx_log_every(1000, "Warning: Invalid packet of type %d and size %d from %d.%d.%d.%d:%d", buffer[0], size, from[4], from[5], from[6], from[7], (from[2] << 8) | from[3]);
+            // let stale clients login again. the response is smaller than the request so it can not amplify floods
+            // and the shield limits the replies to the unverified address which may be spoofed
+            if (buffer[0] != TYPE_LOGIN && server_is_flooding(SHIELD_EXPIRED, from) == false)
+                server_send_error(from, buffer[0], ERR_EXPIRED);
+            continue;
+        }
+
+        // the crash reports keep only the type and the size because packets carry tokens and keys of the sessions.
+        // the events of each packet are recorded only when SEGANX_TRACE_NET allows the hot paths
+        byte type = buffer[0];
+        sx_record_event_at(SEGANX_TRACE_NET, SX_TRACE_HOT, sealer != null ? "sealed" : "packet", type, (uint)size);
+        ulong start = sx_get_cycles();
+        switch (type)
         {
         case TYPE_PING: server_ping(buffer, from); break;
         case TYPE_PACKET_UNRELY: server_process_packet_unreliable(buffer, from); break;
         case TYPE_PACKET_RELY: server_process_packet_reliable(buffer, from); break;
         case TYPE_PACKET_RELIED: server_process_packet_relied(buffer, from); break;
+        case TYPE_COMPACT_UNRELY: server_process_compact_unreliable(buffer, from); break;
+        case TYPE_COMPACT_RELY: server_process_compact_reliable(buffer, from); break;
+        case TYPE_COMPACT_RELIED: server_process_compact_relied(buffer, from); break;
+        case TYPE_PACKET_FRAGMENT: server_process_compact_fragment(buffer, from); break;
+        case TYPE_PACKET_PERSIST: server_process_packet_persist(buffer, from); break;
+        case TYPE_PACKET_LOG: server_process_packet_log(buffer, from); break;
         case TYPE_LOGIN: server_process_login(buffer, from); break;
         case TYPE_LOGOUT: server_process_logout(buffer, from); break;
         case TYPE_CREATE: server_process_create(buffer, from); break;
         case TYPE_JOIN: server_process_join(buffer, from); break;
         case TYPE_LEAVE: server_process_leave(buffer, from); break;
+        case TYPE_STATE_SET: server_process_state_set(buffer, size, from); break;
+        case TYPE_STATE_SNAPSHOT: server_process_state_snapshot(buffer, from); break;
         }
+        ulong cycles = sx_get_cycles() - start;
+        metrics_handled(type, cycles);
+        sx_record_event_at(SEGANX_TRACE_NET, SX_TRACE_HOT, "handled", type, (uint)cycles);
+
+        // the relay time covers the lookup, the lock free checks and the fan-out to all members
+        if (received > 0 && (type == TYPE_PACKET_UNRELY || type == TYPE_COMPACT_UNRELY))
+        {
+            ulong generation = sx_atomic_load64(&server.probe_generation);
+            if (generation != *probe_generation)
+            {
+                sx_histogram_reset(probe);
+                sx_atomic_store64(probe_generation, generation);
+            }
+            sx_histogram_record(probe, sx_time_now_ns() - received);
+        }
+
+        s_sealer = null;
     }
 
     sx_trace_detach();
@@ -499,6 +1331,14 @@ Config LoadConfig()
     config.room_capacity = ROOM_CAPACITY;
     config.player_timeout = 300000;
     config.player_master_timeout = 5000;
+    config.master_heartbeat_timeout = 1000;
+    // the rate limits are off by default. recommended values for a game sending at 60Hz are
+    // rate/burst of 120/60 for unreliable and reliable packets and 300/120 for fragments
+    config.shield_login = 16;
+    config.shield_create = 16;
+    config.shield_join = 16;
+    config.shield_expired = 16;
+    config.shield_sealed = 2048;
 
     FILE* file = null;
     if (fopen_s(&file, "config.json", "r") == 0)
@@ -517,6 +1357,20 @@ Config LoadConfig()
         config.room_capacity = sx_json_read_int(root, "room_capacity", config.room_capacity);
         config.player_timeout = sx_json_read_int(root, "player_timeout", config.player_timeout);
         config.player_master_timeout = sx_json_read_int(root, "player_master_timeout", config.player_master_timeout);
+        config.master_heartbeat_timeout = sx_json_read_int(root, "master_heartbeat_timeout", config.master_heartbeat_timeout);
+        config.rate_limits[RATE_UNRELIABLE].rate = sx_json_read_int(root, "rate_unreliable", config.rate_limits[RATE_UNRELIABLE].rate);
+        config.rate_limits[RATE_UNRELIABLE].burst = sx_json_read_int(root, "burst_unreliable", config.rate_limits[RATE_UNRELIABLE].burst);
+        config.rate_limits[RATE_RELIABLE].rate = sx_json_read_int(root, "rate_reliable", config.rate_limits[RATE_RELIABLE].rate);
+        config.rate_limits[RATE_RELIABLE].burst = sx_json_read_int(root, "burst_reliable", config.rate_limits[RATE_RELIABLE].burst);
+        config.rate_limits[RATE_FRAGMENT].rate = sx_json_read_int(root, "rate_fragment", config.rate_limits[RATE_FRAGMENT].rate);
+        config.rate_limits[RATE_FRAGMENT].burst = sx_json_read_int(root, "burst_fragment", config.rate_limits[RATE_FRAGMENT].burst);
+        config.shield_login = sx_json_read_int(root, "shield_login", config.shield_login);
+        config.shield_create = sx_json_read_int(root, "shield_create", config.shield_create);
+        config.shield_join = sx_json_read_int(root, "shield_join", config.shield_join);
+        config.shield_expired = sx_json_read_int(root, "shield_expired", config.shield_expired);
+        config.shield_sealed = sx_json_read_int(root, "shield_sealed", config.shield_sealed);
+        config.probe = sx_json_read_int(root, "probe", config.probe) != 0;
+        config.metrics_port = sx_json_read_int(root, "metrics_port", config.metrics_port);
 
         fclose(file);
     }
@@ -528,6 +1382,7 @@ int main()
 {
     sx_trace_attach(64, "trace.txt");
     sx_trace();
+    sx_log_initialize(stdout);
     sx_net_initialize();
 
     // initialize server with default config
@@ -543,12 +1398,24 @@ int main()
         sx_print("room capacity: %d", config.room_capacity);
         sx_print("player timeout: %d", config.player_timeout);
         sx_print("player master timeout: %d", config.player_master_timeout);
+        sx_print("master heartbeat timeout: %d", config.master_heartbeat_timeout);
+        sx_print("rate limits: unreliable %u/%u reliable %u/%u fragment %u/%u",
+            config.rate_limits[RATE_UNRELIABLE].rate, config.rate_limits[RATE_UNRELIABLE].burst,
+            config.rate_limits[RATE_RELIABLE].rate, config.rate_limits[RATE_RELIABLE].burst,
+            config.rate_limits[RATE_FRAGMENT].rate, config.rate_limits[RATE_FRAGMENT].burst);
+        sx_print("flood shield: login %u create %u join %u expired %u sealed %u", config.shield_login, config.shield_create, config.shield_join, config.shield_expired, config.shield_sealed);
+        sx_print("probe: %s", config.probe ? "on" : "off");
+        sx_print("metrics port: %d", config.metrics_port);
     }
 
     struct sx_thread* threads[THREAD_COUNTS] = { null };
     threads[0] = sx_thread_create(1, thread_ticker, null);
     for (int i = 1; i < THREAD_COUNTS; i++)
-        threads[i] = sx_thread_create(i + 1, thread_listener, null);
+        threads[i] = sx_thread_create(i + 1, thread_listener, (void*)(size_t)i);
+
+    struct sx_thread* metrics = null;
+    if (server.config.metrics_port > 0)
+        metrics = sx_thread_create(THREAD_COUNTS + 1, thread_metrics, null);
 
     char cmd[128] = { 0 };
     while (sx_str_cmp(cmd, "exit\n") != 0)
@@ -559,7 +1426,11 @@ int main()
         char cmd1[32] = { 0 };
         char cmd2[32] = { 0 };
         int value = 0;
+#if defined(_WIN32)
         sscanf_s(cmd, "%s %s %d", cmd1, 32, cmd2, 32, &value);
+#else
+        sscanf(cmd, "%31s %31s %d", cmd1, cmd2, &value);
+#endif
 
         if (sx_str_cmp(cmd1, "report") == 0)
         {
@@ -569,6 +1440,55 @@ int main()
                 room_report(&server, value);
             else if (sx_str_cmp(cmd2, "time") == 0)
                 sx_print("%llu", sx_time_now());
+            else if (sx_str_cmp(cmd2, "probe") == 0)
+                server_report_probe();
+            else if (sx_str_cmp(cmd2, "profile") == 0)
+                sx_profiler_report(stdout);
+            else if (sx_str_cmp(cmd2, "mutex") == 0)
+                sx_lock_profiler_report(stdout);
+        }
+        else if (sx_str_cmp(cmd1, "probe") == 0)
+        {
+            server_probe_enable(sx_str_cmp(cmd2, "on") == 0);
+            sx_print("probe: %s", server.probe ? "on" : "off");
+        }
+        else if (sx_str_cmp(cmd1, "profile") == 0)
+        {
+            sx_profiler_enable(sx_str_cmp(cmd2, "on") == 0);
+            sx_print("profile: %s", sx_profiler_enabled() ? "on" : "off");
+        }
+        else if (sx_str_cmp(cmd1, "folded") == 0)
+        {
+            FILE* file = null;
+            if (fopen_s(&file, cmd2, "w") == 0)
+            {
+                sx_profiler_folded(file);
+                fclose(file);
+            }
+        }
+        else if (sx_str_cmp(cmd1, "mutex") == 0)
+        {
+            sx_lock_profiler_enable(sx_str_cmp(cmd2, "on") == 0);
+            sx_print("mutex: %s", sx_lock_profiler_enabled() ? "on" : "off");
+        }
+        else if (sx_str_cmp(cmd1, "sample") == 0)
+        {
+            if (sx_str_cmp(cmd2, "on") == 0)
+                sx_print("sample: %s", sx_sampler_start(value > 0 ? value : 99) ? "on" : "not supported");
+            else
+            {
+                sx_sampler_stop();
+                sx_print("sample: off");
+            }
+        }
+        else if (sx_str_cmp(cmd1, "samples") == 0)
+        {
+            FILE* file = null;
+            if (fopen_s(&file, cmd2, "w") == 0)
+            {
+                sx_sampler_folded(file);
+                fclose(file);
+            }
         }
         else if (sx_str_cmp(cmd1, "log") == 0)
         {
@@ -585,8 +1505,10 @@ int main()
 
     for (size_t i = 0; i < THREAD_COUNTS; i++)
         sx_thread_destroy(threads[i]);
+    sx_thread_destroy(metrics);
 
     server_shutdown();
+    sx_log_finalize();
 
     sx_trace_detach();
     return 0;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/def.h"
+#include "core/timer.h"
 
 #define TYPE_PING           1
 #define TYPE_LOGIN          10
@@ -11,35 +12,106 @@
 #define TYPE_PACKET_UNRELY  40
 #define TYPE_PACKET_RELY    41
 #define TYPE_PACKET_RELIED  42
+#define TYPE_PACKET_PERSIST 43
+#define TYPE_PACKET_LOG     44
+#define TYPE_PACKET_LOGGED  45
+#define TYPE_COMPACT_UNRELY 46
+#define TYPE_COMPACT_RELY   47
+#define TYPE_COMPACT_RELIED 48
+#define TYPE_PACKET_FRAGMENT 49
+#define TYPE_MASTER         50
+#define TYPE_MEMBER         51
+#define TYPE_STATE_SET      60
+#define TYPE_STATE          61
+#define TYPE_STATE_SNAPSHOT 62
+#define TYPE_SECURE         70
+
+#define LOGIN_MODE_PLAIN    0
+#define LOGIN_MODE_SECURE   1   //  all packets of the session are sealed with ChaCha20-Poly1305
 
 #define FLAG_MASTER         1
 
+#define RATE_UNRELIABLE     0
+#define RATE_RELIABLE       1   //  reliable packets and their acknowledges
+#define RATE_FRAGMENT       2
+#define RATE_COUNT          3
+
+#define MEMBER_JOIN         1
+#define MEMBER_LEAVE        2
+#define MEMBER_TIMEOUT      3
+
 #define ERR_INVALID         -1
 #define ERR_EXPIRED         -2
 #define ERR_IS_FULL         -3
 #define ERR_MATCHMAKE       -4
+#define ERR_COOKIE          -5  //  login must be sent again with the cookie of the response
 
 #define DEVICE_LEN          32
 #define THREAD_COUNTS       32
 #define ADDRESS_LEN         32
+#define PLAYER_META_LEN     32
+#define SESSION_KEY_LEN     16
+#define PACKET_MAC_LEN      4   //  every packet from clients ends with a truncated SipHash of the packet
+#define PUBLIC_KEY_LEN      32
+#define CIPHER_KEY_LEN      32
+#define SECURE_TAG_LEN      16
+#define SECURE_UP_HEADER    11  //  type, handle and counter of sealed packets from clients
+#define SECURE_DOWN_HEADER  9   //  type and counter of sealed packets to clients
+#define REPLAY_WINDOW       64  //  sealed packets older than the window behind the highest counter are dropped
+#define COOKIE_LEN          12  //  issue time in seconds and MAC of the address and the time
+#define COOKIE_LIFETIME     10  //  seconds
 #define ROOM_PROP_LEN       32
 #define ROOM_COUNT          1024
-#define ROOM_CAPACITY       4
+#define ROOM_CAPACITY       4   //  must not exceed 8 to fit room members in a byte
 #define ROOM_PARAMS         4
+#define ROOM_STATE_LEN      1024
+#define STATE_CHUNK_LEN     240
+#define ROOM_LOG_COUNT      16  //  must be a power of two to keep the ring valid when the sequence wraps
+#define ROOM_LOG_DATA_LEN   235
+#define PACKET_MAX_LEN      1200    //  fits in the minimum MTU of IPv6 with the IP and UDP headers
+#define FRAGMENT_DATA_LEN   1180
 #define LOBBY_CAPACITY      (ROOM_COUNT * ROOM_CAPACITY)
+#define TICKER_INTERVAL     100
+#define SHIELD_DECAY_INTERVAL 1000  //  counts of the flood shield are halved in each interval
+#define SHIELD_EXPIRED      0xFF    //  type of the expired replies to packets with invalid MAC in the flood shield
 
 #define LOG                 1
 
+typedef struct RateLimit
+{
+    uint    rate;                       //  packets per second, zero means no limit
+    uint    burst;                      //  capacity of the bucket in packets
+}
+RateLimit;
+
+typedef struct RateBucket
+{
+    uint    tokens;                     //  thousandths of a packet
+    ulong   time;
+}
+RateBucket;
+
 typedef struct Player
 {
     char    device[DEVICE_LEN];
-    byte    from[ADDRESS_LEN];
+    byte    from[ADDRESS_LEN];          //  written under the lock. the first 8 bytes hold family, port and IPv4 address and are published atomically
+    byte    meta[PLAYER_META_LEN];
     uint    token;
+    ushort  key;                        //  validates compact packets which use id as session handle
+    byte    secret[SESSION_KEY_LEN];    //  key of the packet MACs
+    byte    secure;                     //  packets of the session are sealed
+    byte    cipher[CIPHER_KEY_LEN];     //  key of the sealed packets
+    volatile ulong counter;             //  nonce of the sealed packets to the player
+    volatile ulong replay_top;          //  highest counter of the sealed packets from the player
+    volatile ulong replay[REPLAY_WINDOW];   //  last counter accepted in each slot of the replay window
     short   id;
     short   room;
     sbyte   index;
     byte    flag;
-    ulong   active_time;
+    volatile ulong active_time;
+    uint    dropped;                    //  packets dropped by the rate limits
+    RateBucket buckets[RATE_COUNT];
+    sx_timer timer;
 }
 Player;
 
@@ -50,23 +122,63 @@ typedef struct Lobby
 }
 Lobby;
 
+typedef struct RoomLog
+{
+    sbyte   sender;
+    short   id;                         //  id and token of the sender tell its retries apart from a later player of the same index
+    uint    token;
+    byte    ack;
+    byte    datasize;
+    byte    data[ROOM_LOG_DATA_LEN];
+}
+RoomLog;
+
 typedef struct Room
 {
     sbyte   count;
+    sbyte   master;
+    ulong   master_time;                //  election time of the master which counts as its first heartbeat
     ulong   open_time;
     ulong   open_timeout;
     byte    properties[ROOM_PROP_LEN];
     sint    matchmaking[ROOM_PARAMS];
     Player* players[ROOM_CAPACITY];
+    ushort  state_version;
+    ushort  state_size;
+    byte    state[ROOM_STATE_LEN];      //  list of [key:ushort][size:byte][data] entries
+    ushort  log_seq;                    //  sequence number of the next persistent message
+    byte    log_size;
+    RoomLog logs[ROOM_LOG_COUNT];       //  ring of the last persistent messages
+    sx_timer master_timer;
+    sx_timer open_timer;
 }
 Room;
 
+// copies of a message to the members of a room which are made under the lock and sent after it is released
+typedef struct RoomOutbox
+{
+    byte    addresses[ROOM_CAPACITY][ADDRESS_LEN];
+    byte    packets[ROOM_CAPACITY][SECURE_DOWN_HEADER + PACKET_MAX_LEN + SECURE_TAG_LEN];
+    ushort  sizes[ROOM_CAPACITY];
+    byte    count;
+}
+RoomOutbox;
+
 typedef struct Config
 {
     ushort  port;
     sbyte   room_capacity;
     uint    player_timeout;
     uint    player_master_timeout;
+    uint    master_heartbeat_timeout;   //  the master is replaced if it sends nothing for this long. zero uses player_master_timeout
+    RateLimit rate_limits[RATE_COUNT];
+    uint    shield_login;       //  max login requests of an address and port before its count decays
+    uint    shield_create;
+    uint    shield_join;
+    uint    shield_expired;     //  max expired replies to an address before its count decays
+    uint    shield_sealed;      //  max sealed packets of an address before its count decays. they are counted before opening
+    byte    probe;              //  record the time of unreliable relays from receive to the last send
+    ushort  metrics_port;       //  TCP port of the loopback address serving the metrics, zero disables it
 } 
 Config;
 
@@ -77,8 +189,20 @@ typedef struct Server
     uint    token;
     Lobby   lobby;
     Room    rooms[ROOM_COUNT];
+    volatile ulong dropped[RATE_COUNT];     //  packets dropped by the rate limits of players
+    volatile ulong shielded;                //  requests dropped by the flood shield
+    ulong   shield_time;
+    byte    cookie_key[SESSION_KEY_LEN];    //  key of the login cookies which is never sent
+
+    struct sx_sketch* shield;               //  request counts of source addresses
+
+    volatile byte probe;                    //  instrumentation mode of the latency probe
+    struct sx_histogram* probes;            //  relay times of each listener in nanoseconds
+    volatile ulong probe_generation;        //  listeners reset their own histogram when it changes
+    volatile ulong probe_generations[THREAD_COUNTS];    //  generation of the histogram of each listener
 
     struct sx_mutex* mutex;
+    struct sx_timer_wheel* timers;
 }
 Server;
 
@@ -98,9 +222,11 @@ typedef struct PingResponse
 {
     byte    type;
     sbyte   error;
-    ulong   time;
-    ulong   now;
+    ulong   time;       //  transmit time of the client
+    ulong   receive;    //  receive time of the server in microseconds
+    ulong   transmit;   //  transmit time of the server in microseconds
     byte    flag;
+    byte    members;    //  bit mask of the room members so the clients converge even if they missed membership events
 }
 PingResponse;
 
@@ -108,10 +234,21 @@ typedef struct Login
 {
     byte    type;
     char    device[DEVICE_LEN];
-    uint    checksum;
+    byte    mode;
+    byte    public_key[PUBLIC_KEY_LEN];    //  X25519 public key of the client in secure mode
+    byte    cookie[COOKIE_LEN];            //  zero in the first try
+    uint    mac;
 }
 Login;
 
+typedef struct LoginCookie
+{
+    byte    type;
+    sbyte   error;
+    byte    cookie[COOKIE_LEN];
+}
+LoginCookie;
+
 typedef struct LoginResponse
 {
     byte    type;
@@ -120,7 +257,10 @@ typedef struct LoginResponse
     short   id;
     short   room;
     sbyte   index;
-    uint    checksum;
+    ushort  key;
+    byte    secret[SESSION_KEY_LEN];
+    byte    public_key[PUBLIC_KEY_LEN];    //  X25519 public key of the server in secure mode
+    uint    mac;
 }
 LoginResponse;
 
@@ -131,7 +271,7 @@ typedef struct Logout
     short   id;
     short   room;
     sbyte   index;
-    uint    checksum;
+    uint    mac;
 }
 Logout;
 
@@ -143,6 +283,7 @@ typedef struct Create
     ushort  open_timeout;
     byte    properties[ROOM_PROP_LEN];
     sint    matchmaking[ROOM_PARAMS];
+    byte    meta[PLAYER_META_LEN];
 }
 Create;
 
@@ -162,17 +303,30 @@ typedef struct Join
     uint    token;
     short   id;
     sint    matchmaking[ROOM_PARAMS * 2];
+    byte    meta[PLAYER_META_LEN];
 }
 Join;
 
-typedef struct JoinResponse
+typedef struct RoomMember
 {
-    byte    type;
-    sbyte   error;
-    short   room;
     sbyte   index;
     byte    flag;
-    byte    properties[ROOM_PROP_LEN];
+    byte    meta[PLAYER_META_LEN];
+}
+RoomMember;
+
+typedef struct JoinResponse
+{
+    byte        type;
+    sbyte       error;
+    short       room;
+    sbyte       index;
+    byte        flag;
+    byte        properties[ROOM_PROP_LEN];
+    ushort      log_first;
+    ushort      log_last;
+    byte        count;
+    RoomMember  members[ROOM_CAPACITY];     //  only count items will be sent
 }
 JoinResponse;
 
@@ -230,6 +384,145 @@ typedef struct PacketRelied
 }
 PacketRelied;
 
+typedef struct CompactUnreliable
+{
+    byte    type;
+    ushort  handle;                     //  id of the player in the lobby
+    ushort  key;
+    sbyte   target;
+    byte    datasize;
+}
+CompactUnreliable;
+
+typedef struct CompactReliable
+{
+    byte    type;
+    ushort  handle;
+    ushort  key;
+    sbyte   target;
+    byte    ack;
+    byte    datasize;
+}
+CompactReliable;
+
+typedef struct CompactRelied
+{
+    byte    type;
+    ushort  handle;
+    ushort  key;
+    sbyte   target;
+    byte    ack;
+}
+CompactRelied;
+
+typedef struct CompactFragment
+{
+    byte    type;
+    ushort  handle;
+    ushort  key;
+    sbyte   target;
+    byte    ack;
+    byte    fragment;                   //  index of the fragment in the message
+    byte    count;                      //  number of fragments of the message
+    ushort  datasize;
+}
+CompactFragment;
+
+typedef struct PacketPersist
+{
+    byte    type;
+    uint    token;
+    short   id;
+    short   room;
+    sbyte   index;
+    byte    ack;
+    byte    datasize;
+}
+PacketPersist;
+
+typedef struct PacketLog
+{
+    byte    type;
+    uint    token;
+    short   id;
+    short   room;
+    sbyte   index;
+    ushort  seq;
+}
+PacketLog;
+
+typedef struct PacketLogged
+{
+    byte    type;
+    sbyte   sender;
+    ushort  seq;
+    byte    datasize;
+    byte    data[ROOM_LOG_DATA_LEN];
+}
+PacketLogged;
+
+typedef struct MasterResponse
+{
+    byte    type;
+    sbyte   index;
+}
+MasterResponse;
+
+typedef struct MemberResponse
+{
+    byte    type;
+    sbyte   index;
+    byte    event;
+    byte    members;
+    byte    meta[PLAYER_META_LEN];          //  will be sent only on join
+}
+MemberResponse;
+
+typedef struct StateSet
+{
+    byte    type;
+    uint    token;
+    short   id;
+    short   room;
+    sbyte   index;
+    ushort  key;
+    byte    datasize;
+}
+StateSet;
+
+typedef struct StateResponse
+{
+    byte    type;
+    sbyte   index;
+    ushort  version;
+    ushort  key;
+    byte    datasize;
+}
+StateResponse;
+
+typedef struct StateSnapshot
+{
+    byte    type;
+    uint    token;
+    short   id;
+    short   room;
+    sbyte   index;
+    ushort  offset;
+}
+StateSnapshot;
+
+typedef struct StateSnapshotResponse
+{
+    byte    type;
+    sbyte   error;
+    ushort  version;
+    ushort  size;
+    ushort  offset;
+    byte    datasize;
+    byte    data[STATE_CHUNK_LEN];
+}
+StateSnapshotResponse;
+
 typedef struct ErrorResponse
 {
     byte    type;
@@ -0,0 +1,509 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	bench.c
+	Author:		agent
+	Desc:		Micro benchmarks of the lobby and room functions of the
+                helper and some primitives of the core
+
+                each benchmark is calibrated to run at least the minimum
+                time in a repetition and measured in several repetitions.
+                the median of the repetitions is reported with the min
+                and max to show the noise of the machine. cycles are
+                read from the time stamp counter which ticks at the
+                nominal frequency of the cpu
+*********************************************************************/
+#include "../server.h"
+#include "../helper.h"
+#include "../core/platform.h"
+#include "../core/memory.h"
+#include "../core/string.h"
+#include "../core/timer.h"
+#include "../core/trace.h"
+#include "../core/Json.h"
+#include "../core/crypto.h"
+
+#define BENCH_MAX_REPEATS   64
+
+typedef void (*bench_func)(void* param, const ulong iterations);
+
+typedef struct Options
+{
+    uint        repeats;
+    uint        min_time;       //  microseconds of each repetition
+    bool        csv;
+    const char* filter;
+}
+Options;
+
+typedef struct Result
+{
+    ulong   iterations;
+    double  ns[BENCH_MAX_REPEATS];
+    double  cycles[BENCH_MAX_REPEATS];
+}
+Result;
+
+static Options s_options = { 0 };
+static Server* s_server = null;
+static char s_devices[LOBBY_CAPACITY][DEVICE_LEN];
+static volatile ulong s_sink = 0;      //  results are accumulated to keep the compiler from removing the calls
+
+
+static void bench_measure(bench_func func, void* param, const ulong iterations, double* ns, double* cycles)
+{
+    ulong start_cycles = sx_get_cycles();
+    ulong start = sx_time_now_us();
+    func(param, iterations);
+    ulong elapsed = sx_time_now_us() - start;
+    ulong elapsed_cycles = sx_get_cycles() - start_cycles;
+    *ns = elapsed * 1000.0 / iterations;
+    *cycles = (double)elapsed_cycles / iterations;
+}
+
+// double the iterations until a repetition takes the minimum time. the calibration warms up the caches too
+static ulong bench_calibrate(bench_func func, void* param)
+{
+    ulong iterations = 1;
+    while (true)
+    {
+        ulong start = sx_time_now_us();
+        func(param, iterations);
+        ulong elapsed = sx_time_now_us() - start;
+        if (elapsed >= s_options.min_time) return iterations;
+        iterations = (elapsed * 8 < s_options.min_time) ? iterations * 8 : iterations * 2;
+    }
+}
+
+static void bench_sort(double* values, const uint count)
+{
+    for (uint i = 1; i < count; i++)
+        for (uint j = i; j > 0 && values[j - 1] > values[j]; j--)
+        {
+            double t = values[j];
+            values[j] = values[j - 1];
+            values[j - 1] = t;
+        }
+}
+
+static void bench_run(const char* name, const char* variant, bench_func func, void* param)
+{
+    if (s_options.filter != null && sx_str_str(name, s_options.filter) == null) return;
+
+    Result result = { 0 };
+    result.iterations = bench_calibrate(func, param);
+    for (uint i = 0; i < s_options.repeats; i++)
+        bench_measure(func, param, result.iterations, &result.ns[i], &result.cycles[i]);
+    bench_sort(result.ns, s_options.repeats);
+    bench_sort(result.cycles, s_options.repeats);
+
+    uint mid = s_options.repeats / 2;
+    if (s_options.csv)
+        sx_print("%s,%s,%llu,%u,%.2f,%.2f,%.2f,%.1f", name, variant, result.iterations, s_options.repeats,
+            result.ns[mid], result.ns[0], result.ns[s_options.repeats - 1], result.cycles[mid]);
+    else
+        sx_print("%-28s %-10s %12.2f %12.2f %12.2f %12.1f", name, variant,
+            result.ns[mid], result.ns[0], result.ns[s_options.repeats - 1], result.cycles[mid]);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//  LOBBY
+/////////////////////////////////////////////////////////////////////////////
+static void lobby_fill(const uint count)
+{
+    sx_mem_set(&s_server->lobby, 0, sizeof(Lobby));
+    byte from[ADDRESS_LEN] = { 0 };
+    byte secret[SESSION_KEY_LEN] = { 0 };
+    for (uint i = 0; i < count; i++)
+        lobby_add_player(s_server, s_devices[i], from, i + 1, (ushort)i, secret);
+}
+
+static void bench_lobby_find_hit(void* param, const ulong iterations)
+{
+    uint count = *(const uint*)param;
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+        res += lobby_find_player_by_device(s_server, s_devices[(i * 7919) % count]) != null;
+    s_sink += res;
+}
+
+static void bench_lobby_find_miss(void* param, const ulong iterations)
+{
+    char device[DEVICE_LEN] = "device-missing";
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+        res += lobby_find_player_by_device(s_server, device) != null;
+    s_sink += res;
+}
+
+// a player is added to the first free slot after the filled ones and removed again
+static void bench_lobby_add(void* param, const ulong iterations)
+{
+    byte from[ADDRESS_LEN] = { 0 };
+    byte secret[SESSION_KEY_LEN] = { 0 };
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+    {
+        Player* player = lobby_add_player(s_server, s_devices[LOBBY_CAPACITY - 1], from, 1, 1, secret);
+        res += player->id;
+        lobby_remove_player(s_server, player->id);
+    }
+    s_sink += res;
+}
+
+static void bench_lobby(void)
+{
+    const uint fills[] = { 16, 256, 1024, LOBBY_CAPACITY };
+    char variant[32];
+    for (uint i = 0; i < sizeof(fills) / sizeof(fills[0]); i++)
+    {
+        lobby_fill(fills[i]);
+        sx_sprintf(variant, sizeof(variant), "%u", fills[i]);
+        bench_run("lobby_find_player_by_device", variant, bench_lobby_find_hit, (void*)&fills[i]);
+        sx_sprintf(variant, sizeof(variant), "%u/miss", fills[i]);
+        bench_run("lobby_find_player_by_device", variant, bench_lobby_find_miss, null);
+    }
+
+    const uint adds[] = { 0, 256, 1024, LOBBY_CAPACITY - 1 };
+    for (uint i = 0; i < sizeof(adds) / sizeof(adds[0]); i++)
+    {
+        lobby_fill(adds[i]);
+        sx_sprintf(variant, sizeof(variant), "%u", adds[i]);
+        bench_run("lobby_add_player", variant, bench_lobby_add, null);
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//  ROOM
+/////////////////////////////////////////////////////////////////////////////
+typedef struct RoomBench
+{
+    Player* player;
+    sint    params[ROOM_PARAMS * 2];
+}
+RoomBench;
+
+// open rooms with one free seat and distinct matchmaking values so only the last room matches
+static void rooms_fill(const uint count)
+{
+    sx_mem_set(s_server->rooms, 0, sizeof(s_server->rooms));
+    static Player member = { 0 };
+    for (uint r = 0; r < count; r++)
+    {
+        Room* room = &s_server->rooms[r];
+        room->master = -1;
+        room->open_time = 1;
+        room->matchmaking[0] = r;
+        for (sbyte i = 0; i < s_server->config.room_capacity - 1; i++)
+        {
+            room->players[i] = &member;
+            room->count++;
+        }
+    }
+}
+
+static void bench_room_join(void* param, const ulong iterations)
+{
+    RoomBench* bench = (RoomBench*)param;
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+    {
+        res += room_join(s_server, bench->player, bench->params);
+        room_remove_player(s_server, bench->player);
+    }
+    s_sink += res;
+}
+
+static void bench_room_is_match(void* param, const ulong iterations)
+{
+    RoomBench* bench = (RoomBench*)param;
+    Room* room = &s_server->rooms[0];
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+        res += room_is_match(room, bench->params);
+    s_sink += res;
+}
+
+static void bench_room(void)
+{
+    lobby_fill(1);
+    RoomBench bench = { 0 };
+    bench.player = &s_server->lobby.players[0];
+    for (int i = 1; i < ROOM_PARAMS; i++)
+    {
+        bench.params[i * 2] = -2147483647 - 1;
+        bench.params[i * 2 + 1] = 2147483647;
+    }
+
+    const uint fills[] = { 1, 16, 256, ROOM_COUNT };
+    char variant[32];
+    for (uint i = 0; i < sizeof(fills) / sizeof(fills[0]); i++)
+    {
+        rooms_fill(fills[i]);
+        bench.params[0] = bench.params[1] = fills[i] - 1;
+        sx_sprintf(variant, sizeof(variant), "%u", fills[i]);
+        bench_run("room_join", variant, bench_room_join, &bench);
+
+        bench.params[0] = bench.params[1] = -1;
+        sx_sprintf(variant, sizeof(variant), "%u/miss", fills[i]);
+        bench_run("room_join", variant, bench_room_join, &bench);
+    }
+
+    rooms_fill(1);
+    bench.params[0] = bench.params[1] = 0;
+    bench_run("room_is_match", "match", bench_room_is_match, &bench);
+    bench.params[0] = bench.params[1] = -1;
+    bench_run("room_is_match", "miss", bench_room_is_match, &bench);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//  CORE
+/////////////////////////////////////////////////////////////////////////////
+typedef struct DataBench
+{
+    uint    size;
+    byte    data[PACKET_MAX_LEN];
+}
+DataBench;
+
+static void bench_mac_compute(void* param, const ulong iterations)
+{
+    DataBench* bench = (DataBench*)param;
+    byte key[SESSION_KEY_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+    {
+        bench->data[0] = (byte)i;
+        res += mac_compute(key, bench->data, bench->size);
+    }
+    s_sink += res;
+}
+
+static void bench_seal(void* param, const ulong iterations)
+{
+    DataBench* bench = (DataBench*)param;
+    byte key[CIPHER_KEY_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    byte nonce[SX_CHACHA_NONCE_LEN] = { 0 };
+    byte packet[PACKET_MAX_LEN + SECURE_TAG_LEN];
+    for (ulong i = 0; i < iterations; i++)
+    {
+        sx_mem_copy(nonce + 4, &i, sizeof(ulong));
+        sx_chacha20poly1305_seal(packet, packet + bench->size, key, nonce, bench->data, SECURE_DOWN_HEADER, bench->data, bench->size);
+    }
+    s_sink += packet[0];
+}
+
+// one operation seals a relayed packet for the other players of a full room like the fan-out of the server
+static void bench_seal_room(void* param, const ulong iterations)
+{
+    DataBench* bench = (DataBench*)param;
+    byte keys[ROOM_CAPACITY - 1][CIPHER_KEY_LEN] = { { 1 }, { 2 }, { 3 } };
+    byte nonces[ROOM_CAPACITY - 1][SX_CHACHA_NONCE_LEN] = { { 1 }, { 1 }, { 1 } };
+    byte packets[ROOM_CAPACITY - 1][PACKET_MAX_LEN + SECURE_TAG_LEN];
+    sx_chacha20poly1305_item items[ROOM_CAPACITY - 1];
+    for (int i = 0; i < ROOM_CAPACITY - 1; i++)
+        items[i] = (sx_chacha20poly1305_item){ packets[i], keys[i], nonces[i], bench->data, SECURE_DOWN_HEADER };
+    for (ulong i = 0; i < iterations; i++)
+    {
+        for (int j = 0; j < ROOM_CAPACITY - 1; j++)
+            sx_mem_copy(nonces[j] + 4, &i, sizeof(ulong));
+        sx_chacha20poly1305_seal_many(items, ROOM_CAPACITY - 1, bench->data, bench->size);
+    }
+    s_sink += packets[0][0];
+}
+
+// the packet is sealed once and opened in place so every open verifies a valid tag and decrypts
+static void bench_open(void* param, const ulong iterations)
+{
+    DataBench* bench = (DataBench*)param;
+    byte key[CIPHER_KEY_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    byte nonce[SX_CHACHA_NONCE_LEN] = { 0 };
+    byte packet[PACKET_MAX_LEN + SECURE_TAG_LEN], plain[PACKET_MAX_LEN];
+    sx_chacha20poly1305_seal(packet, packet + bench->size, key, nonce, bench->data, SECURE_UP_HEADER, bench->data, bench->size);
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+        res += sx_chacha20poly1305_open(plain, key, nonce, bench->data, SECURE_UP_HEADER, packet, bench->size, packet + bench->size);
+    s_sink += res;
+}
+
+typedef struct PoolBench
+{
+    struct sx_memory_manager* manager;
+    uint    size;
+    void*   blocks[64];         //  a ring of live blocks to mix the free list like a real workload
+}
+PoolBench;
+
+static void bench_mem_pool(void* param, const ulong iterations)
+{
+    PoolBench* bench = (PoolBench*)param;
+    struct sx_memory_manager* manager = bench->manager;
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+    {
+        void** block = &bench->blocks[(i * 37) & 63];
+        if (*block) manager->free(manager, *block);
+        *block = manager->alloc(manager, bench->size + (uint)(i & 15));
+        res += (ulong)*block;
+    }
+    s_sink += res;
+}
+
+static void bench_mem_libc(void* param, const ulong iterations)
+{
+    PoolBench* bench = (PoolBench*)param;
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+    {
+        void** block = &bench->blocks[(i * 37) & 63];
+        free(*block);
+        *block = malloc(bench->size + (uint)(i & 15));
+        res += (ulong)*block;
+    }
+    s_sink += res;
+}
+
+typedef struct JsonBench
+{
+    const char*     text;
+    int             len;
+    sx_json_node*   nodes;
+    int             count;
+}
+JsonBench;
+
+// the nodes are cleared in each parse like the callers do because the parser links them in place
+static void bench_json_parse(void* param, const ulong iterations)
+{
+    JsonBench* bench = (JsonBench*)param;
+    ulong res = 0;
+    for (ulong i = 0; i < iterations; i++)
+    {
+        sx_mem_set(bench->nodes, 0, bench->count * sizeof(sx_json_node));
+        sx_json json = { 0 };
+        json.nodes = bench->nodes;
+        json.nodescount = bench->count;
+        sx_json_node* root = sx_json_parse(&json, bench->text, bench->len);
+        res += root ? root->childs : 0;
+    }
+    s_sink += res;
+}
+
+static void bench_core(void)
+{
+    DataBench data = { 0 };
+    for (uint i = 0; i < PACKET_MAX_LEN; i++)
+        data.data[i] = (byte)(i * 31);
+
+    const uint sizes[] = { 16, 64, 256, PACKET_MAX_LEN };
+    char variant[32];
+    for (uint i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        data.size = sizes[i];
+        sx_sprintf(variant, sizeof(variant), "%u", sizes[i]);
+        bench_run("mac_compute", variant, bench_mac_compute, &data);
+        bench_run("chacha20poly1305_seal", variant, bench_seal, &data);
+        bench_run("chacha20poly1305_open", variant, bench_open, &data);
+        bench_run("chacha20poly1305_seal_room", variant, bench_seal_room, &data);
+    }
+
+    const uint blocks[] = { 32, 256, 4096 };
+    for (uint i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++)
+    {
+        PoolBench pool = { 0 };
+        pool.size = blocks[i];
+        pool.manager = sx_mem_pool_create(64 * 2 * (blocks[i] + 16) + 64 * 1024);
+        sx_sprintf(variant, sizeof(variant), "%u", blocks[i]);
+        bench_run("sx_mem_pool", variant, bench_mem_pool, &pool);
+        sx_mem_pool_destroy(pool.manager);
+
+        // the allocator of the system as the baseline
+        sx_mem_set(pool.blocks, 0, sizeof(pool.blocks));
+        bench_run("malloc", variant, bench_mem_libc, &pool);
+        for (int b = 0; b < 64; b++)
+            free(pool.blocks[b]);
+    }
+
+    static const char config[] =
+        "{ \"port\": 36000, \"room_capacity\": 4, \"player_timeout\": 300000, \"player_master_timeout\": 5000,"
+        " \"rate_unreliable\": 120, \"burst_unreliable\": 60, \"rate_reliable\": 120, \"burst_reliable\": 60,"
+        " \"shield_login\": 16, \"shield_create\": 16, \"shield_join\": 16 }";
+
+    static char document[32 * 1024];
+    uint len = sx_sprintf(document, sizeof(document), "{ \"players\": [");
+    for (int i = 0; i < 128; i++)
+        len += sx_sprintf(document + len, sizeof(document) - len, "%s{ \"id\": %d, \"device\": \"device-%08d\", \"room\": %d, \"active\": true }",
+            i ? ", " : "", i, i, i / 4);
+    len += sx_sprintf(document + len, sizeof(document) - len, "] }");
+
+    const char* texts[] = { config, document };
+    const char* names[] = { "config", "document" };
+    for (int i = 0; i < 2; i++)
+    {
+        JsonBench json = { texts[i], (int)sx_str_len(texts[i]), null, 0 };
+        sx_json counter = { 0 };
+        json.count = sx_json_node_count(&counter, json.text, json.len);
+        json.nodes = (sx_json_node*)sx_mem_calloc(json.count * sizeof(sx_json_node));
+        sx_sprintf(variant, sizeof(variant), "%s", names[i]);
+        bench_run("sx_json_parse", variant, bench_json_parse, &json);
+        sx_mem_free(json.nodes);
+    }
+}
+
+
+static bool parse_options(int argc, char** argv)
+{
+    s_options.repeats = 9;
+    s_options.min_time = 20000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (sx_str_cmp(argv[i], "-c") == 0)
+            s_options.csv = true;
+        else if (i + 1 < argc && sx_str_cmp(argv[i], "-r") == 0)
+            s_options.repeats = sx_str_to_uint(argv[++i], s_options.repeats);
+        else if (i + 1 < argc && sx_str_cmp(argv[i], "-t") == 0)
+            s_options.min_time = sx_str_to_uint(argv[++i], s_options.min_time / 1000) * 1000;
+        else if (i + 1 < argc && sx_str_cmp(argv[i], "-f") == 0)
+            s_options.filter = argv[++i];
+        else return false;
+    }
+    return s_options.repeats > 0 && s_options.repeats <= BENCH_MAX_REPEATS && s_options.min_time > 0;
+}
+
+int main(int argc, char** argv)
+{
+    sx_trace_attach(64, "trace_bench.txt");
+    sx_trace();
+
+    if (parse_options(argc, argv) == false)
+    {
+        sx_print("usage: bench [options]");
+        sx_print("  -c             print comma separated values");
+        sx_print("  -r count       repetitions of each benchmark (9, max %d)", BENCH_MAX_REPEATS);
+        sx_print("  -t ms          minimum time of each repetition (20)");
+        sx_print("  -f name        run the benchmarks which contain the name");
+        sx_trace_detach();
+        return 1;
+    }
+
+    s_server = (Server*)sx_mem_calloc(sizeof(Server));
+    s_server->config.room_capacity = ROOM_CAPACITY;
+    for (int i = 0; i < LOBBY_CAPACITY; i++)
+        sx_sprintf(s_devices[i], DEVICE_LEN, "device-%08d", i);
+
+    if (s_options.csv)
+        sx_print("benchmark,variant,iterations,repeats,ns_median,ns_min,ns_max,cycles_median");
+    else
+        sx_print("%-28s %-10s %12s %12s %12s %12s", "benchmark", "variant", "ns/op", "min", "max", "cycles/op");
+
+    bench_lobby();
+    bench_room();
+    bench_core();
+
+    sx_mem_free(s_server);
+    sx_trace_detach();
+    return 0;
+}
@@ -0,0 +1,795 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	loadgen.c
+	Author:		agent
+	Desc:		Headless bots which speak the Radio protocol to put a load
+                on the server and measure it. each bot logs in with the
+                cookie round trip, creates or joins the room of its group,
+                pings and relays unreliable and reliable packets to the
+                other members of the room at the configured rates
+*********************************************************************/
+#include "../server.h"
+#include "../helper.h"
+#include "../core/platform.h"
+#include "../core/memory.h"
+#include "../core/string.h"
+#include "../core/timer.h"
+#include "../core/trace.h"
+#include "../core/histogram.h"
+#include "../core/crypto.h"
+#include "../net/socket.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
+#define BOT_LOGIN           0
+#define BOT_ROOM            1
+#define BOT_PLAY            2
+
+#define REQUEST_TIMEOUT     1000000     //  requests and reliable packets are sent again after a second
+#define RETRY_INTERVAL      200000      //  wait for the creator of the room before joining again
+#define PROBE_LEN           12          //  transmit time and sequence at the head of the relay payloads
+#define REPORT_INTERVAL     1000
+
+typedef struct Options
+{
+    uint    ip;
+    ushort  port;
+    uint    clients;
+    uint    threads;
+    uint    duration;           //  seconds
+    uint    ramp;               //  seconds to spread the logins
+    uint    room_size;
+    uint    unreliable_rate;    //  packets per second of each bot
+    uint    reliable_rate;
+    uint    ping_interval;      //  milliseconds
+    uint    payload;
+    uint    secure;             //  seal the packets of the sessions like secure clients
+}
+Options;
+
+typedef struct Stats
+{
+    volatile ulong sent;
+    volatile ulong received;
+    volatile ulong logins;
+    volatile ulong joins;
+    ulong   login_failures;
+    ulong   join_failures;
+    ulong   expired;
+    ulong   unreliable_sent;
+    ulong   unreliable_received;
+    ulong   unreliable_expected;
+    ulong   reordered;
+    ulong   reliable_sent;
+    ulong   reliable_retries;
+    ulong   reliable_retried;               //  acked packets which needed at least one retry
+    ulong   reliable_received;
+    ulong   reliable_acked;
+    ulong   pings;
+    ulong   pongs;
+    sx_histogram ping_rtt;
+    sx_histogram relay_latency;
+    sx_histogram reliable_rtt;
+}
+Stats;
+
+typedef struct Bot
+{
+    uint    socket;
+    uint    number;
+    byte    state;
+    byte    cookie[COOKIE_LEN];
+    uint    token;
+    short   id;
+    short   room;
+    sbyte   index;
+    ushort  key;
+    byte    secret[SESSION_KEY_LEN];
+    byte    scalar[SX_X25519_KEY_LEN];
+    byte    public_key[PUBLIC_KEY_LEN];
+    byte    cipher[CIPHER_KEY_LEN];
+    bool    secure;
+    ulong   counter;                        //  nonce of the sealed packets to the server
+    byte    peers;                          //  bit mask of the members which are heard
+    uint    seq;
+    uint    last_seq[ROOM_CAPACITY];
+    byte    ack;
+    bool    pending;
+    sbyte   pending_target;
+    uint    pending_retries;
+    ulong   pending_first;                  //  first send of the pending packet which the round trip is measured from
+    ulong   pending_time;                   //  last send of the pending packet
+    ulong   next_request;
+    ulong   next_ping;
+    ulong   next_unreliable;
+    ulong   next_reliable;
+}
+Bot;
+
+typedef struct Worker
+{
+    uint            id;
+    Bot*            bots;
+    uint            count;
+    struct pollfd*  fds;
+    Stats           stats;
+}
+Worker;
+
+static Options s_options = { 0 };
+static volatile bool s_running = true;
+static struct sx_semaphore* s_finished = null;
+
+
+static void bot_send(Worker* worker, Bot* bot, const void* buffer, const int size)
+{
+    // all packets after the login of a secure session are sealed like the client does
+    if (bot->secure && ((const byte*)buffer)[0] != TYPE_LOGIN)
+    {
+        byte packet[SECURE_UP_HEADER + PACKET_MAX_LEN + SECURE_TAG_LEN];
+        ulong counter = ++bot->counter;
+        packet[0] = TYPE_SECURE;
+        sx_mem_copy(packet + 1, &bot->id, sizeof(short));
+        sx_mem_copy(packet + 3, &counter, sizeof(ulong));
+
+        byte nonce[SX_CHACHA_NONCE_LEN] = { 0 };
+        sx_mem_copy(nonce + 4, &counter, sizeof(ulong));
+        byte* cipher = packet + SECURE_UP_HEADER;
+        sx_chacha20poly1305_seal(cipher, cipher + size, bot->cipher, nonce, packet, SECURE_UP_HEADER, (const byte*)buffer, size);
+        if (sx_socket_send(bot->socket, s_options.ip, s_options.port, packet, SECURE_UP_HEADER + size + SECURE_TAG_LEN))
+            sx_atomic_inc64(&worker->stats.sent);
+        return;
+    }
+
+    if (sx_socket_send(bot->socket, s_options.ip, s_options.port, buffer, size))
+        sx_atomic_inc64(&worker->stats.sent);
+}
+
+// append the MAC of the session to the packet and send it
+static void bot_send_signed(Worker* worker, Bot* bot, byte* buffer, const int size)
+{
+    uint mac = mac_compute(bot->secret, buffer, size);
+    sx_mem_copy(buffer + size, &mac, PACKET_MAC_LEN);
+    bot_send(worker, bot, buffer, size + PACKET_MAC_LEN);
+}
+
+static void bot_login(Worker* worker, Bot* bot)
+{
+    Login login = { 0 };
+    login.type = TYPE_LOGIN;
+    sx_sprintf(login.device, DEVICE_LEN, "loadgen-%08u", bot->number);
+    login.mode = s_options.secure ? LOGIN_MODE_SECURE : LOGIN_MODE_PLAIN;
+    sx_mem_copy(login.public_key, bot->public_key, PUBLIC_KEY_LEN);
+    sx_mem_copy(login.cookie, bot->cookie, COOKIE_LEN);
+    login.mac = mac_compute(mac_login_key, (const byte*)&login, sizeof(Login) - PACKET_MAC_LEN);
+    bot_send(worker, bot, &login, sizeof(Login));
+}
+
+// the first bot of each group creates the room and the others join it by the group number
+static void bot_enter_room(Worker* worker, Bot* bot)
+{
+    int group = (int)(bot->number / s_options.room_size);
+    if (bot->number % s_options.room_size == 0)
+    {
+        byte buffer[sizeof(Create) + PACKET_MAC_LEN] = { 0 };
+        Create* create = (Create*)buffer;
+        create->type = TYPE_CREATE;
+        create->token = bot->token;
+        create->id = bot->id;
+        create->matchmaking[0] = group;
+        bot_send_signed(worker, bot, buffer, sizeof(Create));
+    }
+    else
+    {
+        byte buffer[sizeof(Join) + PACKET_MAC_LEN] = { 0 };
+        Join* join = (Join*)buffer;
+        join->type = TYPE_JOIN;
+        join->token = bot->token;
+        join->id = bot->id;
+        join->matchmaking[0] = join->matchmaking[1] = group;
+        for (int i = 1; i < ROOM_PARAMS; i++)
+        {
+            join->matchmaking[i * 2] = -2147483647 - 1;
+            join->matchmaking[i * 2 + 1] = 2147483647;
+        }
+        bot_send_signed(worker, bot, buffer, sizeof(Join));
+    }
+}
+
+static void bot_ping(Worker* worker, Bot* bot, const ulong now)
+{
+    byte buffer[sizeof(Ping) + PACKET_MAC_LEN] = { 0 };
+    Ping* ping = (Ping*)buffer;
+    ping->type = TYPE_PING;
+    ping->token = bot->token;
+    ping->id = bot->id;
+    ping->room = bot->room;
+    ping->index = bot->index;
+    ping->time = now;
+    bot_send_signed(worker, bot, buffer, sizeof(Ping));
+    worker->stats.pings++;
+}
+
+// the payload starts with the transmit time so the receiver measures the one way latency on the same clock
+static void bot_write_probe(Bot* bot, byte* data, const ulong now)
+{
+    sx_mem_set(data, 0, s_options.payload);
+    sx_mem_copy(data, &now, sizeof(ulong));
+    sx_mem_copy(data + sizeof(ulong), &bot->seq, sizeof(uint));
+}
+
+static void bot_send_unreliable(Worker* worker, Bot* bot, const ulong now)
+{
+    byte buffer[sizeof(CompactUnreliable) + 255 + PACKET_MAC_LEN];
+    CompactUnreliable* packet = (CompactUnreliable*)buffer;
+    packet->type = TYPE_COMPACT_UNRELY;
+    packet->handle = (ushort)bot->id;
+    packet->key = bot->key;
+    packet->target = -1;
+    packet->datasize = (byte)s_options.payload;
+    bot->seq++;
+    bot_write_probe(bot, buffer + sizeof(CompactUnreliable), now);
+    bot_send_signed(worker, bot, buffer, sizeof(CompactUnreliable) + s_options.payload);
+    worker->stats.unreliable_sent++;
+}
+
+static void bot_send_reliable(Worker* worker, Bot* bot, const ulong now)
+{
+    byte buffer[sizeof(CompactReliable) + 255 + PACKET_MAC_LEN];
+    CompactReliable* packet = (CompactReliable*)buffer;
+    packet->type = TYPE_COMPACT_RELY;
+    packet->handle = (ushort)bot->id;
+    packet->key = bot->key;
+    packet->target = bot->pending_target;
+    packet->ack = bot->ack;
+    packet->datasize = (byte)s_options.payload;
+    bot_write_probe(bot, buffer + sizeof(CompactReliable), now);
+    bot_send_signed(worker, bot, buffer, sizeof(CompactReliable) + s_options.payload);
+}
+
+static void bot_send_relied(Worker* worker, Bot* bot, const sbyte target, const byte ack)
+{
+    byte buffer[sizeof(CompactRelied) + PACKET_MAC_LEN];
+    CompactRelied* packet = (CompactRelied*)buffer;
+    packet->type = TYPE_COMPACT_RELIED;
+    packet->handle = (ushort)bot->id;
+    packet->key = bot->key;
+    packet->target = target;
+    packet->ack = ack;
+    bot_send_signed(worker, bot, buffer, sizeof(CompactRelied));
+}
+
+// pick the next member of the room which is heard from as the target of the reliable packet
+static sbyte bot_pick_peer(Bot* bot)
+{
+    for (int i = 1; i < ROOM_CAPACITY; i++)
+    {
+        sbyte index = (sbyte)((bot->index + i) % ROOM_CAPACITY);
+        if (bot->peers & (1 << index)) return index;
+    }
+    return -1;
+}
+
+// spread the packets of the bots over the interval so they are not sent in bursts
+static ulong bot_schedule(const ulong next, const ulong interval, const ulong now)
+{
+    if (interval == 0) return (ulong)-1;
+    ulong res = next + interval;
+    return (res + REQUEST_TIMEOUT < now) ? now + interval : res;
+}
+
+static void bot_play(Worker* worker, Bot* bot, const ulong now)
+{
+    if (now >= bot->next_ping)
+    {
+        bot_ping(worker, bot, now);
+        bot->next_ping = bot_schedule(bot->next_ping, s_options.ping_interval * 1000ull, now);
+    }
+
+    if (now >= bot->next_unreliable)
+    {
+        bot_send_unreliable(worker, bot, now);
+        bot->next_unreliable = bot_schedule(bot->next_unreliable, s_options.unreliable_rate ? 1000000 / s_options.unreliable_rate : 0, now);
+    }
+
+    // only one reliable packet is in flight so the rate is capped by the round trip
+    if (bot->pending && now >= bot->pending_time + REQUEST_TIMEOUT)
+    {
+        bot->pending_time = now;
+        bot->pending_retries++;
+        bot_send_reliable(worker, bot, now);
+        worker->stats.reliable_retries++;
+    }
+    else if (bot->pending == false && now >= bot->next_reliable)
+    {
+        bot->next_reliable = bot_schedule(bot->next_reliable, s_options.reliable_rate ? 1000000 / s_options.reliable_rate : 0, now);
+        bot->pending_target = bot_pick_peer(bot);
+        if (bot->pending_target >= 0)
+        {
+            bot->ack++;
+            bot->pending = true;
+            bot->pending_retries = 0;
+            bot->pending_first = bot->pending_time = now;
+            bot_send_reliable(worker, bot, now);
+            worker->stats.reliable_sent++;
+        }
+    }
+}
+
+static void bot_update(Worker* worker, Bot* bot, const ulong now)
+{
+    switch (bot->state)
+    {
+    case BOT_LOGIN:
+        if (now < bot->next_request) return;
+        bot->next_request = now + REQUEST_TIMEOUT;
+        bot_login(worker, bot);
+        break;
+
+    case BOT_ROOM:
+        if (now < bot->next_request) return;
+        bot->next_request = now + REQUEST_TIMEOUT;
+        bot_enter_room(worker, bot);
+        break;
+
+    case BOT_PLAY:
+        bot_play(worker, bot, now);
+        break;
+    }
+}
+
+static void bot_joined(Worker* worker, Bot* bot, const short room, const sbyte index, const ulong now)
+{
+    bot->room = room;
+    bot->index = index;
+    bot->state = BOT_PLAY;
+    sx_atomic_inc64(&worker->stats.joins);
+
+    // start the streams with random phases to avoid bots of a worker sending at the same time
+    ulong phase = (ulong)(bot->number * 7919) % 1000000;
+    bot->next_ping = now;
+    bot->next_unreliable = now + (s_options.unreliable_rate ? phase % (1000000 / s_options.unreliable_rate) : 0);
+    bot->next_reliable = now + (s_options.reliable_rate ? phase % (1000000 / s_options.reliable_rate) : 0);
+    if (s_options.unreliable_rate == 0) bot->next_unreliable = (ulong)-1;
+    if (s_options.reliable_rate == 0) bot->next_reliable = (ulong)-1;
+}
+
+static void bot_receive_unreliable(Worker* worker, Bot* bot, const byte* buffer, const sint size, const ulong now)
+{
+    sbyte sender = (sbyte)buffer[1];
+    if (size < 3 + PROBE_LEN || buffer[2] < PROBE_LEN || validate_player_index_range(sender) == false) return;
+
+    ulong time = 0;
+    uint seq = 0;
+    sx_mem_copy(&time, buffer + 3, sizeof(ulong));
+    sx_mem_copy(&seq, buffer + 3 + sizeof(ulong), sizeof(uint));
+    bot->peers |= (byte)(1 << sender);
+
+    // the first packet of a sender starts its sequence. older packets are counted as reordered
+    Stats* stats = &worker->stats;
+    uint last = bot->last_seq[sender];
+    if (seq <= last)
+    {
+        stats->reordered++;
+        return;
+    }
+    stats->unreliable_expected += last ? seq - last : 1;
+    stats->unreliable_received++;
+    bot->last_seq[sender] = seq;
+    sx_histogram_record(&stats->relay_latency, now > time ? now - time : 0);
+}
+
+// return the size of the opened packet or zero if it must be dropped
+static sint bot_open(Bot* bot, byte* buffer, const sint size)
+{
+    if (bot->secure == false || size < SECURE_DOWN_HEADER + SECURE_TAG_LEN + 1) return 0;
+
+    byte nonce[SX_CHACHA_NONCE_LEN] = { 1, 0, 0, 0 };
+    sx_mem_copy(nonce + 4, buffer + 1, sizeof(ulong));
+    sint innersize = size - SECURE_DOWN_HEADER - SECURE_TAG_LEN;
+    byte* cipher = buffer + SECURE_DOWN_HEADER;
+    if (sx_chacha20poly1305_open(cipher, bot->cipher, nonce, buffer, SECURE_DOWN_HEADER, cipher, innersize, cipher + innersize) == false)
+        return 0;
+    sx_mem_move(buffer, cipher, innersize);
+    return innersize;
+}
+
+static void bot_receive(Worker* worker, Bot* bot, const byte* buffer, const sint size, const ulong now)
+{
+    Stats* stats = &worker->stats;
+    sbyte error = size > 1 ? (sbyte)buffer[1] : 0;
+
+    switch (buffer[0])
+    {
+    case TYPE_LOGIN:
+        if (bot->state != BOT_LOGIN) break;
+        if (error == ERR_COOKIE && size >= (sint)sizeof(LoginCookie))
+        {
+            sx_mem_copy(bot->cookie, ((const LoginCookie*)buffer)->cookie, COOKIE_LEN);
+            bot->next_request = now;
+        }
+        else if (error == 0 && size == sizeof(LoginResponse))
+        {
+            const LoginResponse* response = (const LoginResponse*)buffer;
+            if (mac_is_invalid(mac_login_key, buffer, sizeof(LoginResponse) - PACKET_MAC_LEN, response->mac)) break;
+            bot->token = response->token;
+            bot->id = response->id;
+            bot->room = response->room;
+            bot->index = response->index;
+            bot->key = response->key;
+            sx_mem_copy(bot->secret, response->secret, SESSION_KEY_LEN);
+            if (s_options.secure)
+            {
+                static const byte nonce[16] = { 0 };
+                byte shared[SX_X25519_KEY_LEN];
+                sx_x25519(shared, bot->scalar, response->public_key);
+                sx_hchacha20(bot->cipher, shared, nonce);
+                bot->counter = 0;
+                bot->secure = true;
+            }
+            bot->state = BOT_ROOM;
+            bot->next_request = now;
+            sx_atomic_inc64(&stats->logins);
+        }
+        else stats->login_failures++;
+        break;
+
+    case TYPE_CREATE:
+        if (bot->state != BOT_ROOM) break;
+        if (error == 0 && size >= (sint)sizeof(CreateResponse))
+            bot_joined(worker, bot, ((const CreateResponse*)buffer)->room, ((const CreateResponse*)buffer)->index, now);
+        else stats->join_failures++;
+        break;
+
+    case TYPE_JOIN:
+        if (bot->state != BOT_ROOM) break;
+        if (error == 0 && size >= (sint)(sizeof(JoinResponse) - ROOM_CAPACITY * sizeof(RoomMember)))
+        {
+            const JoinResponse* response = (const JoinResponse*)buffer;
+            bot_joined(worker, bot, response->room, response->index, now);
+        }
+        else
+        {
+            // the room of the group is not created yet
+            stats->join_failures++;
+            bot->next_request = now + RETRY_INTERVAL;
+        }
+        break;
+
+    case TYPE_PING:
+        if (error == 0 && size == sizeof(PingResponse))
+        {
+            // take the processing time of the server out of the round trip
+            const PingResponse* response = (const PingResponse*)buffer;
+            ulong server_time = response->transmit - response->receive;
+            ulong round_trip = now - response->time;
+            sx_histogram_record(&stats->ping_rtt, round_trip > server_time ? round_trip - server_time : 0);
+            stats->pongs++;
+        }
+        else stats->expired++;
+        break;
+
+    case TYPE_PACKET_UNRELY:
+        if (size == 2) stats->expired++;
+        else bot_receive_unreliable(worker, bot, buffer, size, now);
+        break;
+
+    case TYPE_PACKET_RELY:
+        if (size == 2) stats->expired++;
+        else if (size >= 4)
+        {
+            stats->reliable_received++;
+            bot_send_relied(worker, bot, (sbyte)buffer[1], buffer[2]);
+        }
+        break;
+
+    case TYPE_PACKET_RELIED:
+        if (size == 2) stats->expired++;
+        else if (size >= 3 && bot->pending && (sbyte)buffer[1] == bot->pending_target && buffer[2] == bot->ack)
+        {
+            bot->pending = false;
+            stats->reliable_acked++;
+            if (bot->pending_retries > 0) stats->reliable_retried++;
+            sx_histogram_record(&stats->reliable_rtt, now - bot->pending_first);
+        }
+        break;
+    }
+}
+
+static void thread_worker(void* param)
+{
+    sx_trace_attach(64, "trace_loadgen.txt");
+    sx_trace();
+
+    Worker* worker = (Worker*)param;
+    ulong start = sx_time_now_us();
+    ulong ramp = s_options.ramp * 1000000ull;
+    for (uint i = 0; i < worker->count; i++)
+    {
+        Bot* bot = &worker->bots[i];
+        bot->next_request = start + ramp * bot->number / s_options.clients;
+        worker->fds[i].fd = bot->socket;
+        worker->fds[i].events = POLLIN;
+    }
+
+    while (s_running)
+    {
+        // sleep until a packet arrives or the next bot is due
+        ulong now = sx_time_now_us();
+        ulong next = now + 10000;
+        for (uint i = 0; i < worker->count; i++)
+        {
+            Bot* bot = &worker->bots[i];
+            bot_update(worker, bot, now);
+
+            ulong due = bot->state == BOT_PLAY ? bot->next_ping : bot->next_request;
+            if (bot->state == BOT_PLAY)
+            {
+                if (bot->next_unreliable < due) due = bot->next_unreliable;
+                if (bot->pending == false && bot->next_reliable < due) due = bot->next_reliable;
+            }
+            if (due < next) next = due;
+        }
+
+        now = sx_time_now_us();
+        int timeout = next > now ? (int)((next - now) / 1000) : 0;
+        if (poll(worker->fds, worker->count, timeout) < 1) continue;
+
+        for (uint i = 0; i < worker->count; i++)
+        {
+            if ((worker->fds[i].revents & POLLIN) == 0) continue;
+
+            Bot* bot = &worker->bots[i];
+            byte buffer[SECURE_DOWN_HEADER + PACKET_MAX_LEN + SECURE_TAG_LEN];
+            byte from[ADDRESS_LEN];
+            sint size = 0;
+            while ((size = sx_socket_receive(bot->socket, buffer, sizeof(buffer), (struct sockaddr*)from)) > 0)
+            {
+                sx_atomic_inc64(&worker->stats.received);
+                if (buffer[0] == TYPE_SECURE && (size = bot_open(bot, buffer, size)) < 1) continue;
+                bot_receive(worker, bot, buffer, size, sx_time_now_us());
+            }
+        }
+    }
+
+    sx_semaphore_post(s_finished);
+    sx_trace_detach();
+}
+
+static void print_histogram(const char* name, const sx_histogram* histogram)
+{
+    sx_print("%-12s: count %llu mean %.0f p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu (us)", name,
+        histogram->count, sx_histogram_mean(histogram),
+        sx_histogram_percentile(histogram, 50), sx_histogram_percentile(histogram, 90),
+        sx_histogram_percentile(histogram, 99), sx_histogram_percentile(histogram, 99.9),
+        histogram->count ? histogram->max : 0);
+}
+
+static void print_usage(void)
+{
+    sx_print("usage: loadgen [options]");
+    sx_print("  -a address     address of the server (127.0.0.1)");
+    sx_print("  -p port        port of the server (36000)");
+    sx_print("  -c clients     number of bots (1000)");
+    sx_print("  -t threads     number of worker threads (4)");
+    sx_print("  -d seconds     duration of the test (30)");
+    sx_print("  -w seconds     ramp up time to spread the logins (5)");
+    sx_print("  -r size        number of bots in each room (%d)", ROOM_CAPACITY);
+    sx_print("  -u rate        unreliable packets per second of each bot (20)");
+    sx_print("  -l rate        reliable packets per second of each bot (2)");
+    sx_print("  -i interval    ping interval in milliseconds (1000)");
+    sx_print("  -s size        payload size of relayed packets (%d..255, 32)", PROBE_LEN);
+    sx_print("  -e secure      seal the packets with ChaCha20-Poly1305 after a secure login (0)");
+}
+
+static bool parse_options(int argc, char** argv)
+{
+    const char* address = "127.0.0.1";
+    s_options.port = 36000;
+    s_options.clients = 1000;
+    s_options.threads = 4;
+    s_options.duration = 30;
+    s_options.ramp = 5;
+    s_options.room_size = ROOM_CAPACITY;
+    s_options.unreliable_rate = 20;
+    s_options.reliable_rate = 2;
+    s_options.ping_interval = 1000;
+    s_options.payload = 32;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-' || i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        switch (argv[i - 1][1])
+        {
+        case 'a': address = value; break;
+        case 'p': s_options.port = (ushort)sx_str_to_uint(value, s_options.port); break;
+        case 'c': s_options.clients = sx_str_to_uint(value, s_options.clients); break;
+        case 't': s_options.threads = sx_str_to_uint(value, s_options.threads); break;
+        case 'd': s_options.duration = sx_str_to_uint(value, s_options.duration); break;
+        case 'w': s_options.ramp = sx_str_to_uint(value, s_options.ramp); break;
+        case 'r': s_options.room_size = sx_str_to_uint(value, s_options.room_size); break;
+        case 'u': s_options.unreliable_rate = sx_str_to_uint(value, s_options.unreliable_rate); break;
+        case 'l': s_options.reliable_rate = sx_str_to_uint(value, s_options.reliable_rate); break;
+        case 'i': s_options.ping_interval = sx_str_to_uint(value, s_options.ping_interval); break;
+        case 's': s_options.payload = sx_str_to_uint(value, s_options.payload); break;
+        case 'e': s_options.secure = sx_str_to_uint(value, s_options.secure); break;
+        default: return false;
+        }
+    }
+
+    uint ip[4] = { 0 };
+    if (sscanf_s(address, "%u.%u.%u.%u", &ip[0], &ip[1], &ip[2], &ip[3]) != 4) return false;
+    s_options.ip = ip[0] | (ip[1] << 8) | (ip[2] << 16) | (ip[3] << 24);
+
+    if (s_options.clients < 1 || s_options.threads < 1 || s_options.threads > s_options.clients) return false;
+    if (s_options.room_size < 1 || s_options.room_size > ROOM_CAPACITY) return false;
+    if (s_options.payload < PROBE_LEN || s_options.payload > 255) return false;
+    if (s_options.unreliable_rate > 1000000 || s_options.reliable_rate > 1000000) return false;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    sx_trace_attach(64, "trace_loadgen.txt");
+    sx_trace();
+
+    if (parse_options(argc, argv) == false)
+    {
+        print_usage();
+        sx_return(1);
+    }
+
+    sx_net_initialize();
+    s_finished = sx_semaphore_create(0, s_options.threads);
+
+    Bot* bots = (Bot*)sx_mem_calloc(s_options.clients * sizeof(Bot));
+    Worker* workers = (Worker*)sx_mem_calloc(s_options.threads * sizeof(Worker));
+    for (uint i = 0; i < s_options.clients; i++)
+    {
+        bots[i].number = i;
+        // each bot has its own ephemeral port to be a separate client for the server
+        bots[i].socket = sx_socket_open(0, true, false);
+        if (bots[i].socket == 0 || sx_socket_set_nonblocking(bots[i].socket) == false)
+        {
+            sx_print("Error: Can't open socket of bot %u. the limit of open files may need to be raised!", i);
+            sx_return(1);
+        }
+
+        if (s_options.secure)
+        {
+            sx_random(bots[i].scalar, SX_X25519_KEY_LEN);
+            sx_x25519_public(bots[i].public_key, bots[i].scalar);
+        }
+    }
+
+    uint first = 0;
+    for (uint i = 0; i < s_options.threads; i++)
+    {
+        Worker* worker = &workers[i];
+        worker->id = i;
+        worker->bots = bots + first;
+        worker->count = s_options.clients / s_options.threads + (i < s_options.clients % s_options.threads ? 1 : 0);
+        worker->fds = (struct pollfd*)sx_mem_calloc(worker->count * sizeof(struct pollfd));
+        sx_histogram_reset(&worker->stats.ping_rtt);
+        sx_histogram_reset(&worker->stats.relay_latency);
+        sx_histogram_reset(&worker->stats.reliable_rtt);
+        first += worker->count;
+    }
+    struct sx_thread** threads = (struct sx_thread**)sx_mem_calloc(s_options.threads * sizeof(struct sx_thread*));
+    for (uint i = 0; i < s_options.threads; i++)
+        threads[i] = sx_thread_create(i + 1, thread_worker, &workers[i]);
+
+    sx_print("loadgen: %u %s bots in rooms of %u on %u threads for %u seconds", s_options.clients, s_options.secure ? "secure" : "plain",
+        s_options.room_size, s_options.threads, s_options.duration);
+
+    ulong start = sx_time_now();
+    ulong last_sent = 0, last_received = 0, last_time = start;
+    ulong measure_start = start, measure_sent = 0, measure_received = 0;
+    bool measuring = false;
+    while (sx_time_now() < start + s_options.duration * 1000ull)
+    {
+        sx_sleep(REPORT_INTERVAL);
+
+        ulong sent = 0, received = 0, logins = 0, joins = 0;
+        for (uint i = 0; i < s_options.threads; i++)
+        {
+            sent += sx_atomic_load64(&workers[i].stats.sent);
+            received += sx_atomic_load64(&workers[i].stats.received);
+            logins += sx_atomic_load64(&workers[i].stats.logins);
+            joins += sx_atomic_load64(&workers[i].stats.joins);
+        }
+
+        ulong now = sx_time_now();
+        double seconds = (now - last_time) / 1000.0;
+        sx_print("%5.1fs logged in %llu joined %llu sent %.0f/s received %.0f/s", (now - start) / 1000.0,
+            logins, joins, (sent - last_sent) / seconds, (received - last_received) / seconds);
+        last_sent = sent;
+        last_received = received;
+        last_time = now;
+
+        // the rates of the summary are measured once all bots are playing
+        if (measuring == false && joins >= s_options.clients)
+        {
+            measuring = true;
+            measure_start = now;
+            measure_sent = sent;
+            measure_received = received;
+        }
+    }
+
+    s_running = false;
+    for (uint i = 0; i < s_options.threads; i++)
+        sx_semaphore_wait(s_finished);
+    for (uint i = 0; i < s_options.threads; i++)
+        sx_thread_destroy(threads[i]);
+    sx_mem_free(threads);
+
+    Stats total = { 0 };
+    sx_histogram_reset(&total.ping_rtt);
+    sx_histogram_reset(&total.relay_latency);
+    sx_histogram_reset(&total.reliable_rtt);
+    for (uint i = 0; i < s_options.threads; i++)
+    {
+        Stats* stats = &workers[i].stats;
+        total.sent += stats->sent;
+        total.received += stats->received;
+        total.logins += stats->logins;
+        total.joins += stats->joins;
+        total.login_failures += stats->login_failures;
+        total.join_failures += stats->join_failures;
+        total.expired += stats->expired;
+        total.unreliable_sent += stats->unreliable_sent;
+        total.unreliable_received += stats->unreliable_received;
+        total.unreliable_expected += stats->unreliable_expected;
+        total.reordered += stats->reordered;
+        total.reliable_sent += stats->reliable_sent;
+        total.reliable_retries += stats->reliable_retries;
+        total.reliable_retried += stats->reliable_retried;
+        total.reliable_received += stats->reliable_received;
+        total.reliable_acked += stats->reliable_acked;
+        total.pings += stats->pings;
+        total.pongs += stats->pongs;
+        sx_histogram_merge(&total.ping_rtt, &stats->ping_rtt);
+        sx_histogram_merge(&total.relay_latency, &stats->relay_latency);
+        sx_histogram_merge(&total.reliable_rtt, &stats->reliable_rtt);
+    }
+
+    double seconds = (last_time - measure_start) / 1000.0;
+    sx_print("\nsummary:");
+    sx_print("bots        : logged in %llu joined %llu login failures %llu join retries %llu expired %llu",
+        total.logins, total.joins, total.login_failures, total.join_failures, total.expired);
+    if (measuring && seconds > 0)
+        sx_print("throughput  : sent %.0f/s received %.0f/s while all bots were playing",
+            (last_sent - measure_sent) / seconds, (last_received - measure_received) / seconds);
+    else
+        sx_print("throughput  : not all bots joined before the end of the test");
+    sx_print("unreliable  : sent %llu received %llu expected %llu loss %.3f%% reordered %llu",
+        total.unreliable_sent, total.unreliable_received, total.unreliable_expected,
+        total.unreliable_expected ? 100.0 * (total.unreliable_expected - total.unreliable_received) / total.unreliable_expected : 0.0,
+        total.reordered);
+    sx_print("reliable    : sent %llu retries %llu received %llu acked %llu acked after retry %llu",
+        total.reliable_sent, total.reliable_retries, total.reliable_received, total.reliable_acked, total.reliable_retried);
+    sx_print("ping        : sent %llu received %llu loss %.3f%%",
+        total.pings, total.pongs, total.pings ? 100.0 * (total.pings - total.pongs) / total.pings : 0.0);
+    print_histogram("ping rtt", &total.ping_rtt);
+    print_histogram("relay", &total.relay_latency);
+    print_histogram("reliable rtt", &total.reliable_rtt);
+
+    for (uint i = 0; i < s_options.clients; i++)
+        sx_socket_close(bots[i].socket);
+    for (uint i = 0; i < s_options.threads; i++)
+        sx_mem_free(workers[i].fds);
+    sx_mem_free(workers);
+    sx_mem_free(bots);
+    sx_semaphore_destroy(s_finished);
+    sx_net_finalize();
+
+    sx_trace_detach();
+    return 0;
+}
@@ -0,0 +1,435 @@
+/********************************************************************
+	created:	2026/10/19
+	filename: 	probe.c
+	Author:		agent
+	Desc:		Latency probe which measures the time from the send of a
+                client to the receive of its peer through a real room of
+                the server. a sender and a receiver join a room of their
+                own and timestamped unreliable packets are relayed from
+                the sender at a fixed rate. latencies are recorded in a
+                histogram with less than 1% error
+
+                the timestamp of each probe is the time it was scheduled
+                to be sent so a stall of the sender is counted in the
+                latency of the packets behind it instead of hiding them
+
+                background load is put on the server by running loadgen
+                at the same time. to split the latency, enable the probe
+                mode of the server by "probe on" and read the relay time
+                inside the server by "report probe"
+*********************************************************************/
+#include "../server.h"
+#include "../helper.h"
+#include "../core/platform.h"
+#include "../core/memory.h"
+#include "../core/string.h"
+#include "../core/timer.h"
+#include "../core/trace.h"
+#include "../core/crypto.h"
+#include "../core/histogram.h"
+#include "../net/socket.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
+#define PROBE_LEN           12          //  scheduled time and sequence at the head of the payload
+#define REQUEST_TIMEOUT     1000        //  milliseconds
+#define REQUEST_RETRIES     10
+#define KEEPALIVE_INTERVAL  1000000000  //  nanoseconds between pings of the clients
+
+typedef struct Options
+{
+    uint    ip;
+    ushort  port;
+    uint    rate;               //  probes per second
+    uint    duration;           //  seconds
+    uint    payload;
+    const char* output;         //  file of the percentile distribution
+}
+Options;
+
+typedef struct Client
+{
+    uint    socket;
+    char    device[DEVICE_LEN];
+    uint    token;
+    short   id;
+    short   room;
+    sbyte   index;
+    ushort  key;
+    byte    secret[SESSION_KEY_LEN];
+}
+Client;
+
+static Options s_options = { 0 };
+static Client s_sender = { 0 };
+static Client s_receiver = { 0 };
+static volatile bool s_running = true;
+static struct sx_semaphore* s_finished = null;
+
+
+static void client_send(Client* client, const void* buffer, const int size)
+{
+    sx_socket_send(client->socket, s_options.ip, s_options.port, buffer, size);
+}
+
+static void client_send_signed(Client* client, byte* buffer, const int size)
+{
+    uint mac = mac_compute(client->secret, buffer, size);
+    sx_mem_copy(buffer + size, &mac, PACKET_MAC_LEN);
+    client_send(client, buffer, size + PACKET_MAC_LEN);
+}
+
+// wait for a response of the type and skip the others. return size of the response or zero on timeout
+static sint client_receive(Client* client, const byte type, byte* buffer, const int size)
+{
+    ulong deadline = sx_time_now() + REQUEST_TIMEOUT;
+    while (true)
+    {
+        ulong now = sx_time_now();
+        if (now >= deadline) return 0;
+
+        struct pollfd fd = { 0 };
+        fd.fd = client->socket;
+        fd.events = POLLIN;
+        if (poll(&fd, 1, (int)(deadline - now)) < 1) continue;
+
+        byte from[ADDRESS_LEN];
+        sint res = sx_socket_receive(client->socket, buffer, size, (struct sockaddr*)from);
+        if (res > 1 && buffer[0] == type) return res;
+    }
+}
+
+static bool client_login(Client* client)
+{
+    Login login = { 0 };
+    login.type = TYPE_LOGIN;
+    sx_mem_copy(login.device, client->device, DEVICE_LEN);
+    login.mode = LOGIN_MODE_PLAIN;
+
+    for (int i = 0; i < REQUEST_RETRIES; i++)
+    {
+        login.mac = mac_compute(mac_login_key, (const byte*)&login, sizeof(Login) - PACKET_MAC_LEN);
+        client_send(client, &login, sizeof(Login));
+
+        byte buffer[PACKET_MAX_LEN];
+        sint size = client_receive(client, TYPE_LOGIN, buffer, sizeof(buffer));
+        if (size < 2) continue;
+
+        if ((sbyte)buffer[1] == ERR_COOKIE && size >= (sint)sizeof(LoginCookie))
+        {
+            sx_mem_copy(login.cookie, ((LoginCookie*)buffer)->cookie, COOKIE_LEN);
+            continue;
+        }
+
+        LoginResponse* response = (LoginResponse*)buffer;
+        if (response->error != 0 || size != sizeof(LoginResponse)) return false;
+        if (mac_is_invalid(mac_login_key, buffer, sizeof(LoginResponse) - PACKET_MAC_LEN, response->mac)) return false;
+
+        client->token = response->token;
+        client->id = response->id;
+        client->room = response->room;
+        client->index = response->index;
+        client->key = response->key;
+        sx_mem_copy(client->secret, response->secret, SESSION_KEY_LEN);
+        return true;
+    }
+    return false;
+}
+
+static bool client_create(Client* client, const sint group)
+{
+    byte buffer[PACKET_MAX_LEN] = { 0 };
+    for (int i = 0; i < REQUEST_RETRIES; i++)
+    {
+        Create* create = (Create*)buffer;
+        sx_mem_set(buffer, 0, sizeof(Create));
+        create->type = TYPE_CREATE;
+        create->token = client->token;
+        create->id = client->id;
+        create->matchmaking[0] = group;
+        client_send_signed(client, buffer, sizeof(Create));
+
+        sint size = client_receive(client, TYPE_CREATE, buffer, sizeof(buffer));
+        CreateResponse* response = (CreateResponse*)buffer;
+        if (size < (sint)sizeof(CreateResponse)) continue;
+        if (response->error != 0) return false;
+
+        client->room = response->room;
+        client->index = response->index;
+        return true;
+    }
+    return false;
+}
+
+static bool client_join(Client* client, const sint group)
+{
+    byte buffer[PACKET_MAX_LEN] = { 0 };
+    for (int i = 0; i < REQUEST_RETRIES; i++)
+    {
+        Join* join = (Join*)buffer;
+        sx_mem_set(buffer, 0, sizeof(Join));
+        join->type = TYPE_JOIN;
+        join->token = client->token;
+        join->id = client->id;
+        join->matchmaking[0] = join->matchmaking[1] = group;
+        for (int p = 1; p < ROOM_PARAMS; p++)
+        {
+            join->matchmaking[p * 2] = -2147483647 - 1;
+            join->matchmaking[p * 2 + 1] = 2147483647;
+        }
+        client_send_signed(client, buffer, sizeof(Join));
+
+        sint size = client_receive(client, TYPE_JOIN, buffer, sizeof(buffer));
+        JoinResponse* response = (JoinResponse*)buffer;
+        if (size < 2 || response->error != 0) continue;
+
+        client->room = response->room;
+        client->index = response->index;
+        return true;
+    }
+    return false;
+}
+
+static void client_ping(Client* client)
+{
+    byte buffer[sizeof(Ping) + PACKET_MAC_LEN] = { 0 };
+    Ping* ping = (Ping*)buffer;
+    ping->type = TYPE_PING;
+    ping->token = client->token;
+    ping->id = client->id;
+    ping->room = client->room;
+    ping->index = client->index;
+    ping->time = sx_time_now_us();
+    client_send_signed(client, buffer, sizeof(Ping));
+}
+
+// sleep most of the wait and spin the rest because the sleep of the system is too coarse for the pace
+static void wait_until(const ulong time)
+{
+    while (true)
+    {
+        ulong now = sx_time_now_ns();
+        if (now >= time) return;
+        if (time - now > 2000000) sx_sleep((uint)((time - now) / 1000000) - 1);
+    }
+}
+
+static void thread_sender(void* param)
+{
+    sx_trace_attach(64, "trace_probe.txt");
+    sx_trace();
+
+    byte buffer[sizeof(CompactUnreliable) + 255 + PACKET_MAC_LEN] = { 0 };
+    CompactUnreliable* packet = (CompactUnreliable*)buffer;
+    packet->type = TYPE_COMPACT_UNRELY;
+    packet->handle = (ushort)s_sender.id;
+    packet->key = s_sender.key;
+    packet->target = -1;
+    packet->datasize = (byte)s_options.payload;
+    byte* data = buffer + sizeof(CompactUnreliable);
+
+    ulong interval = 1000000000ull / s_options.rate;
+    ulong scheduled = sx_time_now_ns();
+    ulong keepalive = scheduled;
+    uint seq = 0;
+    while (s_running)
+    {
+        wait_until(scheduled);
+
+        seq++;
+        sx_mem_copy(data, &scheduled, sizeof(ulong));
+        sx_mem_copy(data + sizeof(ulong), &seq, sizeof(uint));
+        client_send_signed(&s_sender, buffer, sizeof(CompactUnreliable) + s_options.payload);
+        scheduled += interval;
+
+        // the receiver sends nothing else so it must ping to stay in the lobby
+        if (scheduled >= keepalive)
+        {
+            client_ping(&s_receiver);
+            client_ping(&s_sender);
+            keepalive = scheduled + KEEPALIVE_INTERVAL;
+        }
+    }
+
+    sx_semaphore_post(s_finished);
+    sx_trace_detach();
+}
+
+static void print_histogram(const char* name, const sx_histogram* histogram, const ulong lost)
+{
+    sx_print("%-8s count %8llu lost %6llu p50 %9.1f p99 %9.1f p99.9 %9.1f max %9.1f (us)", name, histogram->count, lost,
+        sx_histogram_percentile(histogram, 50) / 1000.0, sx_histogram_percentile(histogram, 99) / 1000.0,
+        sx_histogram_percentile(histogram, 99.9) / 1000.0, sx_histogram_percentile(histogram, 100) / 1000.0);
+}
+
+static bool parse_options(int argc, char** argv)
+{
+    const char* address = "127.0.0.1";
+    s_options.port = 36000;
+    s_options.rate = 1000;
+    s_options.duration = 30;
+    s_options.payload = 32;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-' || i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        switch (argv[i - 1][1])
+        {
+        case 'a': address = value; break;
+        case 'p': s_options.port = (ushort)sx_str_to_uint(value, s_options.port); break;
+        case 'r': s_options.rate = sx_str_to_uint(value, s_options.rate); break;
+        case 'd': s_options.duration = sx_str_to_uint(value, s_options.duration); break;
+        case 's': s_options.payload = sx_str_to_uint(value, s_options.payload); break;
+        case 'o': s_options.output = value; break;
+        default: return false;
+        }
+    }
+
+    uint ip[4] = { 0 };
+    if (sscanf_s(address, "%u.%u.%u.%u", &ip[0], &ip[1], &ip[2], &ip[3]) != 4) return false;
+    s_options.ip = ip[0] | (ip[1] << 8) | (ip[2] << 16) | (ip[3] << 24);
+
+    if (s_options.rate < 1 || s_options.rate > 1000000 || s_options.duration < 1) return false;
+    if (s_options.payload < PROBE_LEN || s_options.payload > 255) return false;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    sx_trace_attach(64, "trace_probe.txt");
+    sx_trace();
+
+    if (parse_options(argc, argv) == false)
+    {
+        sx_print("usage: probe [options]");
+        sx_print("  -a address     address of the server (127.0.0.1)");
+        sx_print("  -p port        port of the server (36000)");
+        sx_print("  -r rate        probes per second (1000)");
+        sx_print("  -d seconds     duration of the test (30)");
+        sx_print("  -s size        payload size of the probes (%d..255, 32)", PROBE_LEN);
+        sx_print("  -o file        write the percentile distribution to the file");
+        sx_trace_detach();
+        return 1;
+    }
+
+    sx_net_initialize();
+
+    // a random room parameter keeps other clients and other probes out of the room
+    sint group = 0;
+    sx_random(&group, sizeof(group));
+    group = -(group & 0x3fffffff) - 1;
+
+    s_sender.socket = sx_socket_open(0, true, false);
+    s_receiver.socket = sx_socket_open(0, true, false);
+    sx_socket_set_nonblocking(s_sender.socket);
+    sx_socket_set_nonblocking(s_receiver.socket);
+    sx_sprintf(s_sender.device, DEVICE_LEN, "probe-sender-%08x", (uint)group);
+    sx_sprintf(s_receiver.device, DEVICE_LEN, "probe-receiver-%08x", (uint)group);
+
+    if (client_login(&s_sender) == false || client_login(&s_receiver) == false)
+    {
+        sx_print("Error: Can't login to the server!");
+        sx_trace_detach();
+        return 1;
+    }
+    if (client_create(&s_sender, group) == false || client_join(&s_receiver, group) == false)
+    {
+        sx_print("Error: Can't create the room of the probe!");
+        sx_trace_detach();
+        return 1;
+    }
+
+    sx_print("probe: %u packets per second of %u bytes for %u seconds through room %d", s_options.rate, s_options.payload, s_options.duration, s_sender.room);
+
+    sx_histogram* total = (sx_histogram*)sx_mem_alloc(sizeof(sx_histogram));
+    sx_histogram* interval = (sx_histogram*)sx_mem_alloc(sizeof(sx_histogram));
+    sx_histogram_reset(total);
+    sx_histogram_reset(interval);
+
+    s_finished = sx_semaphore_create(0, 1);
+    struct sx_thread* sender = sx_thread_create(1, thread_sender, null);
+
+    ulong start = sx_time_now_ns();
+    ulong end = start + s_options.duration * 1000000000ull;
+    ulong report = start + 1000000000ull;
+    ulong lost = 0, interval_lost = 0;
+    uint last_seq = 0;
+    while (true)
+    {
+        ulong now = sx_time_now_ns();
+        if (now >= report)
+        {
+            char name[16];
+            sx_sprintf(name, sizeof(name), "%.0fs", (now - start) / 1000000000.0);
+            print_histogram(name, interval, interval_lost);
+            sx_histogram_reset(interval);
+            interval_lost = 0;
+            report += 1000000000ull;
+        }
+        if (now >= end) break;
+
+        struct pollfd fd = { 0 };
+        fd.fd = s_receiver.socket;
+        fd.events = POLLIN;
+        if (poll(&fd, 1, 10) < 1) continue;
+
+        byte buffer[PACKET_MAX_LEN];
+        byte from[ADDRESS_LEN];
+        sint size = 0;
+        while ((size = sx_socket_receive(s_receiver.socket, buffer, sizeof(buffer), (struct sockaddr*)from)) > 0)
+        {
+            ulong received = sx_time_now_ns();
+            if (buffer[0] != TYPE_PACKET_UNRELY || size < 3 + PROBE_LEN || buffer[2] < PROBE_LEN) continue;
+
+            ulong scheduled = 0;
+            uint seq = 0;
+            sx_mem_copy(&scheduled, buffer + 3, sizeof(ulong));
+            sx_mem_copy(&seq, buffer + 3 + sizeof(ulong), sizeof(uint));
+            if (seq <= last_seq) continue;
+
+            ulong gap = last_seq > 0 ? seq - last_seq - 1 : 0;
+            lost += gap;
+            interval_lost += gap;
+            last_seq = seq;
+
+            ulong latency = received > scheduled ? received - scheduled : 0;
+            sx_histogram_record(total, latency);
+            sx_histogram_record(interval, latency);
+        }
+    }
+
+    s_running = false;
+    sx_semaphore_wait(s_finished);
+    sx_thread_destroy(sender);
+
+    sx_print("\nsummary:");
+    print_histogram("total", total, lost);
+    sx_print("mean %.1f min %.1f (us)", sx_histogram_mean(total) / 1000.0, total->count ? total->min / 1000.0 : 0.0);
+
+    if (s_options.output != null)
+    {
+        FILE* file = null;
+        if (fopen_s(&file, s_options.output, "w") == 0)
+        {
+            sx_histogram_write(total, file, 1000.0);
+            fclose(file);
+        }
+        else sx_print("Error: Can't open file %s", s_options.output);
+    }
+
+    sx_mem_free(interval);
+    sx_mem_free(total);
+    sx_socket_close(s_sender.socket);
+    sx_socket_close(s_receiver.socket);
+    sx_semaphore_destroy(s_finished);
+    sx_net_finalize();
+
+    sx_trace_detach();
+    return 0;
+}